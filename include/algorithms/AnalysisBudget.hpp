@@ -0,0 +1,184 @@
+/*
+Part of the Fluid Corpus Manipulation Project (http://www.flucoma.org/)
+Copyright 2017-2019 University of Huddersfield.
+Licensed under the BSD-3 License.
+See license.md file in the project root for full license information.
+This project has received funding from the European Research Council (ERC)
+under the European Union’s Horizon 2020 research and innovation programme
+(grant agreement No 725899).
+*/
+#pragma once
+
+#include "algorithms/DistanceBand.hpp"
+#include "data/FluidIndex.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <string>
+
+namespace fluid {
+namespace algorithm {
+
+// Projected size and duration of a graph analysis, worked out from the
+// frame count and settings before anything is allocated. The algorithms add
+// what each stage keeps in the model, its largest temporaries and a rough
+// operation count; link counts assume the worst case, every pair that may be
+// linked. Time is the operation count over a nominal single core rate and
+// only good for an order of magnitude.
+class AnalysisEstimate {
+
+public:
+  AnalysisEstimate() = default;
+
+  AnalysisEstimate(index numSamples, index windowSize, index fftSize,
+                   index hopSize, index maxLinks)
+      : mFrames(numSamples / hopSize + 1), mBins(fftSize / 2 + 1),
+        mWindowSize(windowSize), mFFTSize(fftSize), mHopSize(hopSize),
+        mMaxLinks(maxLinks) {}
+
+  index frames() const { return mFrames; }
+  index bins() const { return mBins; }
+  index hopSize() const { return mHopSize; }
+  index maxLinks() const { return mMaxLinks; }
+
+  // links kept per frame out of candidates
+  double rowLinks(double candidates) const {
+    return mMaxLinks > 0 ? std::min(candidates, double(mMaxLinks))
+                         : candidates;
+  }
+
+  // a stage keeping modelBytes, with temporaries of tempBytes on top of
+  // everything kept so far
+  void add(double modelBytes, double tempBytes, double operations) {
+    mPeakBytes = std::max(mPeakBytes, mModelBytes + modelBytes + tempBytes);
+    mModelBytes += modelBytes;
+    mOperations += operations;
+  }
+
+  // STFT frames of the source
+  void spectrum() {
+    double n = mFrames;
+    add(16 * n * mBins, 8.0 * mWindowSize,
+        n * 5 * mFFTSize * std::log2(double(mFFTSize)));
+  }
+
+  void features(index numBands) {
+    double n = mFrames;
+    add(8 * n * numBands, 0, n * mBins * numBands);
+  }
+
+  // whether distances within width frames make a band (DistanceBand)
+  bool banded(index width) const {
+    return DistanceBand::useful(width, mFrames);
+  }
+
+  // frames each frame may be linked to, itself included
+  double span(index width) const {
+    return banded(width) ? 2.0 * width + 1 : double(mFrames);
+  }
+
+  // N x N matrix, returned by the distance computation and then copied; a
+  // band of width is filled in place, a window of frames at a time
+  void distances(index numBands, index segmentSize, index numNeighbours,
+                 index width = 0) {
+    double n = mFrames;
+    if (banded(width)) {
+      double block = double(std::max(width, index(kBandBlock)));
+      double window = std::min(block + 2 * width, n);
+      add(8 * n * span(width), 8 * window * window + 8 * n * numBands,
+          3 * std::ceil(n / block) * window * window * numBands);
+      return;
+    }
+    double pairs = n * n;
+    if (segmentSize > 1) {
+      double segments = std::ceil(n / segmentSize);
+      pairs = segments * segments +
+              n * segmentSize * double(std::min(numNeighbours + 3,
+                                                index(segments)));
+      pairs = std::min(pairs, n * n);
+    }
+    add(8 * n * n, 8 * n * n + 8 * n * numBands, 3 * pairs * numBands);
+  }
+
+  // spectrum and features of a corpus of corpusSamples, the tree over them
+  // and numLinks corpus frames per frame, each found in the tree among
+  // numCandidates and re-ranked on their exact distances
+  void cross(index corpusSamples, index numBands, index numLinks,
+             index numCandidates) {
+    double n = mFrames;
+    double m = corpusSamples / mHopSize + 1;
+    double c = numCandidates + 1.0;
+    add(16 * m * mBins, 8.0 * mWindowSize,
+        m * 5 * mFFTSize * std::log2(double(mFFTSize)));
+    add(16 * m * numBands, 8 * m * numBands,
+        m * mBins * numBands + m * std::log2(m) * numBands);
+    add(0, 8 * c * c + 8 * c * numBands,
+        n * (std::log2(m) + numCandidates) * numBands +
+            n * c * c * numBands);
+    links(n * numLinks, 12);
+  }
+
+  // count links of bytesPerLink, sorted per row
+  void links(double count, double bytesPerLink) {
+    double n = mFrames;
+    double row = std::max(count / std::max(n, 1.0), 2.0);
+    add(count * bytesPerLink + 16 * n, 8 * n, count * std::log2(row));
+  }
+
+  double modelBytes() const { return mModelBytes; }
+  double peakBytes() const { return mPeakBytes; }
+  double seconds() const { return mOperations / kOperationsPerSecond; }
+
+  // peak while analysing, with copies - 1 models already held elsewhere
+  double totalBytes(index copies = 1) const {
+    return mPeakBytes + (copies - 1) * mModelBytes;
+  }
+
+  std::string report(index copies = 1) const {
+    char text[160];
+    std::snprintf(text, sizeof(text),
+                  "%ld frames, hop %ld, %s links per frame, model %.1f MB, "
+                  "peak %.1f MB, about %.1f s",
+                  static_cast<long>(mFrames), static_cast<long>(mHopSize),
+                  mMaxLinks > 0 ? std::to_string(mMaxLinks).c_str() : "all",
+                  mModelBytes / 1e6, totalBytes(copies) / 1e6, seconds());
+    return text;
+  }
+
+private:
+  static constexpr double kOperationsPerSecond = 1e9;
+  static constexpr index  kBandBlock = 64;
+
+  index  mFrames{0};
+  index  mBins{0};
+  index  mWindowSize{0};
+  index  mFFTSize{0};
+  index  mHopSize{1};
+  index  mMaxLinks{0};
+  double mModelBytes{0};
+  double mPeakBytes{0};
+  double mOperations{0};
+};
+
+// links per frame kept by a compact graph
+constexpr index kCompactLinks = 64;
+
+// Most detailed settings that fit in budget bytes (0: no limit), with
+// copies models held at once: the full graph first, then kCompactLinks links
+// per frame, then that with the analysis hop doubled up to the window size.
+// estimate(hopSize, maxLinks) projects one candidate; if none fits, the
+// most compact is returned and the caller should refuse to analyse.
+template <typename EstimateFunc>
+AnalysisEstimate fitBudget(double budget, index copies, index hopSize,
+                           index windowSize, EstimateFunc estimate) {
+  AnalysisEstimate best = estimate(hopSize, index(0));
+  if (budget <= 0 || best.totalBytes(copies) <= budget) return best;
+  for (index hop = hopSize; hop <= std::max(windowSize, hopSize); hop *= 2) {
+    best = estimate(hop, kCompactLinks);
+    if (best.totalBytes(copies) <= budget) break;
+  }
+  return best;
+}
+
+} // namespace algorithm
+} // namespace fluid
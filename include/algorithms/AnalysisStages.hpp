@@ -0,0 +1,126 @@
+/*
+Part of the Fluid Corpus Manipulation Project (http://www.flucoma.org/)
+Copyright 2017-2019 University of Huddersfield.
+Licensed under the BSD-3 License.
+See license.md file in the project root for full license information.
+This project has received funding from the European Research Council (ERC)
+under the European Union’s Horizon 2020 research and innovation programme
+(grant agreement No 725899).
+*/
+#pragma once
+
+#include "algorithms/AudioSource.hpp"
+#include "algorithms/GraphArchive.hpp"
+#include "data/FluidIndex.hpp"
+#include "data/TensorTypes.hpp"
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace fluid {
+namespace algorithm {
+
+// Dirty tracking for the graph analysis pipeline. Each stage records the
+// parameters it was last computed with; a stage is redone when those differ
+// or when any earlier stage was redone in the same pass. Stages are checked
+// in pipeline order between begin() calls.
+class AnalysisStages {
+
+public:
+  enum Stage {
+    kSpectrum,  // STFT of the source
+    kFeatures,  // mel bands
+    kDistances, // distance matrix
+    kStructure, // onsets, clustering, beat spectrum
+    kGraph,     // links derived from all of the above
+    kNumStages
+  };
+
+  using Key = std::vector<double>;
+
+  // starts a pass; a different source invalidates everything
+  void begin(const AudioSource& source) {
+    std::uint64_t hash = hashAudio(source);
+    mUpstreamDirty = hash != mAudioHash;
+    mAudioHash = hash;
+  }
+
+  // true if the stage has to be recomputed for key
+  bool dirty(Stage stage, const Key& key) {
+    if (mUpstreamDirty || !mValid[stage] || mKeys[stage] != key) {
+      mKeys[stage] = key;
+      mValid[stage] = true;
+      mUpstreamDirty = true;
+    }
+    return mUpstreamDirty;
+  }
+
+  // the source has changed and the stages have been brought up to date with
+  // it in place, by a partial update
+  void updated(const AudioSource& source) { mAudioHash = hashAudio(source); }
+
+  // whether stage was computed, with the parameters of key(stage)
+  bool valid(Stage stage) const { return mValid[stage]; }
+
+  // parameters the stage was last computed with
+  const Key& key(Stage stage) const { return mKeys[stage]; }
+
+  // whether the stages were computed from this source
+  bool matches(const AudioSource& source) const {
+    return hashAudio(source) == mAudioHash;
+  }
+
+  void write(archive::Writer& writer) const {
+    writer.value(mAudioHash);
+    for (index i = 0; i < kNumStages; i++) {
+      writer.value(static_cast<std::uint8_t>(mValid[i]));
+      writer.values(mKeys[i]);
+    }
+  }
+
+  void read(archive::Reader& reader) {
+    mAudioHash = reader.value<std::uint64_t>();
+    for (index i = 0; i < kNumStages; i++) {
+      mValid[i] = reader.value<std::uint8_t>() != 0;
+      mKeys[i] = reader.values();
+    }
+  }
+
+  void invalidate() { mValid.fill(false); }
+
+  void invalidate(Stage stage) { mValid[stage] = false; }
+
+private:
+  // The 64-bit FNV offset basis xor the length, then each sample's 64-bit
+  // pattern folded in whole, hash = (hash ^ bits) * FNV prime, read in
+  // chunks. Not byte-wise FNV-1a; the value is stored in analysis files, so
+  // changing it makes older files fail to match their source.
+  static std::uint64_t hashAudio(const AudioSource& source) {
+    std::uint64_t hash = 14695981039346656037ull ^
+                         static_cast<std::uint64_t>(source.size());
+    RealVector chunk(kChunkSize);
+    for (index start = 0; start < source.size(); start += kChunkSize) {
+      index n = std::min(index(kChunkSize), source.size() - start);
+      source.read(start, chunk);
+      for (index i = 0; i < n; i++) {
+        std::uint64_t bits;
+        double        sample = chunk(i);
+        std::memcpy(&bits, &sample, sizeof(bits));
+        hash = (hash ^ bits) * 1099511628211ull;
+      }
+    }
+    return hash;
+  }
+
+  static constexpr index kChunkSize = 16384;
+
+  std::array<Key, kNumStages>  mKeys;
+  std::array<bool, kNumStages> mValid{};
+  std::uint64_t                mAudioHash{0};
+  bool                         mUpstreamDirty{true};
+};
+
+} // namespace algorithm
+} // namespace fluid
@@ -0,0 +1,62 @@
+/*
+Part of the Fluid Corpus Manipulation Project (http://www.flucoma.org/)
+Copyright 2017-2019 University of Huddersfield.
+Licensed under the BSD-3 License.
+See license.md file in the project root for full license information.
+This project has received funding from the European Research Council (ERC)
+under the European Union’s Horizon 2020 research and innovation programme
+(grant agreement No 725899).
+*/
+#pragma once
+
+#include "data/FluidIndex.hpp"
+#include "data/TensorTypes.hpp"
+#include <algorithm>
+
+namespace fluid {
+namespace algorithm {
+
+// Mono audio the graph analysis reads in hop-aligned chunks, so that it never
+// needs a full copy of the source. read() fills out with the samples starting
+// at start, which may lie partly or wholly outside [0, size()); those samples
+// are zero.
+class AudioSource {
+
+public:
+  virtual ~AudioSource() = default;
+  virtual index size() const = 0;
+  virtual void  read(index start, RealVectorView out) const = 0;
+
+protected:
+  // splits [start, start + count) into the part inside the source and the
+  // zero padding around it; returns the offset into out of the inside part
+  index clip(index start, index count, index& first, index& length) const {
+    first = std::max(start, index(0));
+    index last = std::min(start + count, size());
+    length = std::max(last - first, index(0));
+    return first - start;
+  }
+};
+
+// Source over audio already in memory
+class VectorSource : public AudioSource {
+
+public:
+  VectorSource(RealVectorView audio) : mAudio(audio) {}
+
+  index size() const override { return mAudio.size(); }
+
+  void read(index start, RealVectorView out) const override {
+    index first, length;
+    index offset = clip(start, out.size(), first, length);
+    std::fill(out.begin(), out.end(), 0);
+    if (length > 0)
+      std::copy_n(mAudio.data() + first, length, out.data() + offset);
+  }
+
+private:
+  RealVectorView mAudio;
+};
+
+} // namespace algorithm
+} // namespace fluid
@@ -0,0 +1,246 @@
+/*
+Part of the Fluid Corpus Manipulation Project (http://www.flucoma.org/)
+Copyright 2017-2019 University of Huddersfield.
+Licensed under the BSD-3 License.
+See license.md file in the project root for full license information.
+This project has received funding from the European Research Council (ERC)
+under the European Union’s Horizon 2020 research and innovation programme
+(grant agreement No 725899).
+*/
+#pragma once
+
+#include "data/FluidIndex.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace fluid {
+namespace algorithm {
+
+// Dense boolean matrix packed 64 entries to a word, rows padded to whole
+// words. Masks combine a word at a time and forEachSet visits only the set
+// entries of a row, so sparse rows cost a scan of N / 64 words.
+class BitMatrix {
+
+public:
+  using Word = std::uint64_t;
+  static constexpr index kWordBits = 64;
+
+  BitMatrix() = default;
+
+  BitMatrix(index rows, index cols, bool value = false) {
+    resize(rows, cols, value);
+  }
+
+  void resize(index rows, index cols, bool value = false) {
+    mRows = rows;
+    mCols = cols;
+    mStride = (cols + kWordBits - 1) / kWordBits;
+    mWords.assign(static_cast<size_t>(mRows * mStride), 0);
+    if (value)
+      for (index i = 0; i < mRows; i++) setRow(i);
+  }
+
+  index rows() const { return mRows; }
+  index cols() const { return mCols; }
+
+  bool test(index i, index j) const {
+    return (word(i, j) >> (j % kWordBits)) & 1;
+  }
+
+  // reads as 0/1 where code expects a numeric mask
+  double operator()(index i, index j) const { return test(i, j); }
+
+  void set(index i, index j) { word(i, j) |= bit(j); }
+
+  void reset(index i, index j) { word(i, j) &= ~bit(j); }
+
+  void setRow(index i) {
+    std::fill_n(row(i), mStride, ~Word(0));
+    if (mCols % kWordBits) row(i)[mStride - 1] = bit(mCols) - 1;
+  }
+
+  void resetRow(index i) { std::fill_n(row(i), mStride, Word(0)); }
+
+  // clears columns [first, last) in every row
+  void resetColumns(index first, index last) {
+    for (index w = first / kWordBits; w * kWordBits < last; w++) {
+      index lo = std::max(first - w * kWordBits, index(0));
+      index hi = std::min(last - w * kWordBits, index(kWordBits));
+      Word  mask = (hi == kWordBits ? ~Word(0) : bit(hi) - 1) & ~(bit(lo) - 1);
+      for (index i = 0; i < mRows; i++) row(i)[w] &= ~mask;
+    }
+  }
+
+  // row i &= row j of other, which must have the same number of columns
+  void andRow(index i, const BitMatrix& other, index j) {
+    Word*       dst = row(i);
+    const Word* src = other.row(j);
+    for (index w = 0; w < mStride; w++) dst[w] &= src[w];
+  }
+
+  // calls f(j) for every set entry of row i, in increasing j
+  template <typename Func>
+  void forEachSet(index i, Func&& f) const {
+    const Word* r = row(i);
+    for (index w = 0; w < mStride; w++) {
+      for (Word bits = r[w]; bits != 0; bits &= bits - 1)
+        f(w * kWordBits + lowestBit(bits));
+    }
+  }
+
+private:
+  static Word bit(index j) { return Word(1) << (j % kWordBits); }
+
+  static index lowestBit(Word bits) {
+#ifdef _MSC_VER
+    unsigned long position;
+    _BitScanForward64(&position, bits);
+    return static_cast<index>(position);
+#else
+    return __builtin_ctzll(bits);
+#endif
+  }
+
+  Word*       row(index i) { return mWords.data() + i * mStride; }
+  const Word* row(index i) const { return mWords.data() + i * mStride; }
+
+  Word&       word(index i, index j) { return row(i)[j / kWordBits]; }
+  const Word& word(index i, index j) const { return row(i)[j / kWordBits]; }
+
+  index             mRows{0};
+  index             mCols{0};
+  index             mStride{0};
+  std::vector<Word> mWords;
+};
+
+// Links the walk recently followed, each blocked for a number of hops. The
+// links are held as a bit matrix plus a short list of expiry times, so a hop
+// costs the length of that list instead of a pass over an N x N matrix.
+// With a band width, only links between frames at most that far apart can
+// be followed, and the matrix holds N x (2 width + 1) bits. Links between
+// two sets of frames, too many for a matrix, are kept in the list alone.
+// The list is reserved by init, so marking never allocates; when it is full,
+// the link due to be released first makes room.
+class VisitedLinks {
+
+public:
+  // holds up to numFrames links
+  void init(index numFrames, index width = 0) {
+    mWidth = width;
+    mBits.resize(numFrames, width > 0 ? 2 * width + 1 : numFrames);
+    reserve(numFrames);
+  }
+
+  // without the matrix: test searches the list, which forget keeps short;
+  // holds up to capacity links
+  void initSparse(index capacity) {
+    mWidth = kSparse;
+    mBits.resize(0, 0);
+    reserve(capacity);
+  }
+
+  bool test(index from, index to) const {
+    if (sparse())
+      return std::any_of(mLinks.begin(), mLinks.end(), [&](const Link& l) {
+        return l.from == from && l.to == to;
+      });
+    index column = columnOf(from, to);
+    return column >= 0 && mBits.test(from, column);
+  }
+
+  // blocks from -> to for the next hops hops
+  void mark(index from, index to, index hops) {
+    if (columnOf(from, to) < 0) return;
+    auto link = find(from, to);
+    if (hops <= 0) {
+      if (link != mLinks.end()) remove(link);
+      return;
+    }
+    if (link != mLinks.end())
+      link->expiry = mHop + hops;
+    else {
+      if (asSigned(mLinks.size()) == mCapacity) remove(soonest());
+      mLinks.push_back({from, to, mHop + hops});
+      if (!sparse()) mBits.set(from, columnOf(from, to));
+    }
+  }
+
+  // one hop has passed: releases the links whose time is up
+  void advance() {
+    mHop++;
+    releaseIf([this](const Link& l) { return l.expiry <= mHop; });
+  }
+
+  void clearRow(index from) {
+    releaseIf([from](const Link& l) { return l.from == from; });
+  }
+
+private:
+  struct Link {
+    index from;
+    index to;
+    index expiry;
+  };
+
+  using Iterator = std::vector<Link>::iterator;
+
+  static constexpr index kSparse = -1;
+
+  bool sparse() const { return mWidth == kSparse; }
+
+  void reserve(index capacity) {
+    mCapacity = std::max(capacity, index(1));
+    mLinks.clear();
+    mLinks.reserve(asUnsigned(mCapacity));
+    mHop = 0;
+  }
+
+  // column of the link in the bit matrix, -1 outside the band
+  index columnOf(index from, index to) const {
+    if (sparse()) return 0;
+    if (mWidth <= 0) return to;
+    index offset = to - from;
+    return offset >= -mWidth && offset <= mWidth ? offset + mWidth : -1;
+  }
+
+  Iterator find(index from, index to) {
+    return std::find_if(mLinks.begin(), mLinks.end(), [&](const Link& l) {
+      return l.from == from && l.to == to;
+    });
+  }
+
+  Iterator soonest() {
+    return std::min_element(
+        mLinks.begin(), mLinks.end(),
+        [](const Link& a, const Link& b) { return a.expiry < b.expiry; });
+  }
+
+  void remove(Iterator link) {
+    if (!sparse()) mBits.reset(link->from, columnOf(link->from, link->to));
+    *link = mLinks.back();
+    mLinks.pop_back();
+  }
+
+  template <typename Pred>
+  void releaseIf(Pred pred) {
+    auto last = std::partition(mLinks.begin(), mLinks.end(),
+                               [&](const Link& l) { return !pred(l); });
+    if (!sparse())
+      for (auto link = last; link != mLinks.end(); ++link)
+        mBits.reset(link->from, columnOf(link->from, link->to));
+    mLinks.erase(last, mLinks.end());
+  }
+
+  BitMatrix         mBits;
+  std::vector<Link> mLinks;
+  index             mWidth{0};
+  index             mHop{0};
+  index             mCapacity{1};
+};
+
+} // namespace algorithm
+} // namespace fluid
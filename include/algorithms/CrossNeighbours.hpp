@@ -0,0 +1,151 @@
+/*
+Part of the Fluid Corpus Manipulation Project (http://www.flucoma.org/)
+Copyright 2017-2019 University of Huddersfield.
+Licensed under the BSD-3 License.
+See license.md file in the project root for full license information.
+This project has received funding from the European Research Council (ERC)
+under the European Union’s Horizon 2020 research and innovation programme
+(grant agreement No 725899).
+*/
+#pragma once
+
+#include "algorithms/public/DataSetIdSequence.hpp"
+#include "algorithms/public/KDTree.hpp"
+#include "algorithms/util/DistanceFuncs.hpp"
+#include "data/FluidDataSet.hpp"
+#include "data/FluidIndex.hpp"
+#include "data/TensorTypes.hpp"
+#include <Eigen/Core>
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <numeric>
+#include <string>
+#include <vector>
+
+namespace fluid {
+namespace algorithm {
+
+// The nearest frames of a second source, the corpus, to each frame of the
+// target, for walks that play the target and jump into matching moments of
+// the corpus. Only target x k links are kept, never the distances between
+// all frames of both. The corpus features, scaled to unit length, go in a
+// KDTree once; each target frame takes kOversample times k candidates from
+// it in O(log corpus) and re-ranks them on the exact distance. The tree's
+// order is the cosine order, so with the cosine distance (7), which the
+// graph algorithms always use, the candidates hold the exact k nearest and
+// re-ranking only sorts them. Any other distance is re-ranked from cosine
+// candidates, which may miss some of its nearest frames. Copies share the
+// tree.
+class CrossNeighbours {
+
+public:
+  using DataSet = FluidDataSet<std::string, double, 1>;
+
+  static constexpr index kNeighbours = 16;
+  static constexpr index kOversample = 4;
+
+  // neighbours kept per target frame, maxLinks > 0 being a lower cap
+  static index neighbours(index maxLinks) {
+    return maxLinks > 0 ? std::min(maxLinks, index(kNeighbours))
+                        : index(kNeighbours);
+  }
+
+  void init(const Eigen::MatrixXd& target, const Eigen::MatrixXd& corpus,
+            index dist, index k) {
+    mCorpus = corpus;
+    mDist = dist;
+    mRows = target.rows();
+    mSize = std::min(k, corpus.rows());
+    DataSetIdSequence seq("", 0, 0);
+    DataSet           dataSet(corpus.cols());
+    RealVector        point(corpus.cols());
+    for (index i = 0; i < corpus.rows(); i++) {
+      unit(corpus.row(i), point);
+      dataSet.add(seq.next(), point);
+    }
+    mTree = std::make_shared<const KDTree>(dataSet);
+    mIds.assign(asUnsigned(mRows * mSize), 0);
+    mDistances.assign(asUnsigned(mRows * mSize), 1);
+    update(target, 0, mRows);
+  }
+
+  // looks up target frames [first, first + count) again after they changed
+  void update(const Eigen::MatrixXd& target, index first, index count) {
+    using namespace Eigen;
+    if (mSize <= 0) return;
+    RealVector          point(target.cols());
+    MatrixXd            pair(2, mCorpus.cols());
+    std::vector<index>  order;
+    std::vector<double> exact;
+    std::vector<index>  rank;
+    for (index i = first; i < first + count; i++) {
+      unit(target.row(i), point);
+      auto nearest = mTree->kNearest(
+          point, std::min(mSize * kOversample, mCorpus.rows()));
+      auto ids = nearest.getIds();
+      // only the frame's own distances, one candidate at a time
+      pair.row(0) = target.row(i);
+      order.resize(asUnsigned(ids.size()));
+      exact.resize(order.size());
+      for (index c = 0; c < ids.size(); c++) {
+        order[asUnsigned(c)] = std::stol(ids(c));
+        pair.row(1) = mCorpus.row(order[asUnsigned(c)]);
+        exact[asUnsigned(c)] = DistanceMatrix(pair, mDist)(0, 1);
+      }
+      rank.resize(order.size());
+      std::iota(rank.begin(), rank.end(), 0);
+      std::partial_sort(rank.begin(), rank.begin() + mSize, rank.end(),
+                        [&](index x, index y) {
+                          return exact[asUnsigned(x)] < exact[asUnsigned(y)];
+                        });
+      for (index k = 0; k < mSize; k++) {
+        index c = rank[asUnsigned(k)];
+        mIds[asUnsigned(i * mSize + k)] =
+            static_cast<std::int32_t>(order[asUnsigned(c)]);
+        mDistances[asUnsigned(i * mSize + k)] =
+            static_cast<float>(exact[asUnsigned(c)]);
+      }
+    }
+  }
+
+  // target frames
+  index rows() const { return mRows; }
+
+  // neighbours per target frame
+  index size() const { return mSize; }
+
+  index corpusSize() const { return mCorpus.rows(); }
+
+  // k-th nearest corpus frame to target frame i
+  index neighbour(index i, index k) const {
+    return mIds[asUnsigned(i * mSize + k)];
+  }
+
+  double distance(index i, index k) const {
+    return mDistances[asUnsigned(i * mSize + k)];
+  }
+
+private:
+  static size_t asUnsigned(index x) { return static_cast<size_t>(x); }
+
+  // Euclidean order of unit rows is their cosine order, which leaves out
+  // the level of the frames
+  static void unit(const Eigen::Ref<const Eigen::RowVectorXd>& row,
+                   RealVector& out) {
+    double norm = row.norm();
+    for (index j = 0; j < row.size(); j++)
+      out(j) = norm > 0 ? row(j) / norm : 0;
+  }
+
+  Eigen::MatrixXd               mCorpus;
+  std::shared_ptr<const KDTree> mTree;
+  std::vector<std::int32_t>     mIds;
+  std::vector<float>            mDistances;
+  index                         mRows{0};
+  index                         mSize{0};
+  index                         mDist{0};
+};
+
+} // namespace algorithm
+} // namespace fluid
@@ -0,0 +1,73 @@
+/*
+Part of the Fluid Corpus Manipulation Project (http://www.flucoma.org/)
+Copyright 2017-2019 University of Huddersfield.
+Licensed under the BSD-3 License.
+See license.md file in the project root for full license information.
+This project has received funding from the European Research Council (ERC)
+under the European Union’s Horizon 2020 research and innovation programme
+(grant agreement No 725899).
+*/
+#pragma once
+
+#include "data/FluidIndex.hpp"
+#include <Eigen/Core>
+#include <algorithm>
+#include <cstdlib>
+
+namespace fluid {
+namespace algorithm {
+
+// Distances between frames at most width apart, for graphs whose jumps stay
+// within a moving horizon: N x (2 width + 1) entries instead of N x N. Row i
+// holds the frames from i - width to i + width, in that order; frames
+// further apart read as 1, which is never linked, as do the entries that
+// fall outside the matrix.
+class DistanceBand {
+
+public:
+  DistanceBand() = default;
+
+  DistanceBand(index size, index width)
+      : mSize(size), mWidth(width),
+        mData(Storage::Ones(size, 2 * width + 1)) {}
+
+  // whether a band of width saves anything over N x N distances
+  static bool useful(index width, index size) {
+    return width > 0 && width < size - 1;
+  }
+
+  index rows() const { return mSize; }
+  index cols() const { return mSize; }
+  index width() const { return mWidth; }
+
+  bool contains(index i, index j) const { return std::abs(i - j) <= mWidth; }
+
+  double operator()(index i, index j) const {
+    return contains(i, j) ? mData(i, j - i + mWidth) : 1;
+  }
+
+  // entry of a pair within the band
+  double& at(index i, index j) { return mData(i, j - i + mWidth); }
+
+  // frames [first(i), last(i)) of the matrix are within the band of i
+  index first(index i) const { return std::max(i - mWidth, index(0)); }
+  index last(index i) const { return std::min(i + mWidth + 1, mSize); }
+
+  // distances from each frame to the one k after it, k <= width
+  Eigen::ArrayXd diagonal(index k) const {
+    return mData.col(mWidth + k).head(mSize - k).array();
+  }
+
+  void zeroDiagonal() { mData.col(mWidth).setZero(); }
+
+private:
+  using Storage =
+      Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>;
+
+  index   mSize{0};
+  index   mWidth{0};
+  Storage mData;
+};
+
+} // namespace algorithm
+} // namespace fluid
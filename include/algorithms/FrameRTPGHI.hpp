@@ -0,0 +1,192 @@
+/*
+Part of the Fluid Corpus Manipulation Project (http://www.flucoma.org/)
+Copyright 2017-2019 University of Huddersfield.
+Licensed under the BSD-3 License.
+See license.md file in the project root for full license information.
+This project has received funding from the European Research Council (ERC)
+under the European Union’s Horizon 2020 research and innovation programme
+(grant agreement No 725899).
+*/
+#pragma once
+
+#include "algorithms/ModelArena.hpp"
+#include "algorithms/util/AlgorithmUtils.hpp"
+#include "algorithms/util/FluidEigenMappings.hpp"
+#include "data/FluidIndex.hpp"
+#include "data/TensorTypes.hpp"
+#include <Eigen/Core>
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace fluid {
+namespace algorithm {
+
+// Real-time phase gradient heap integration (Prusa & Holighaus) over the
+// frames of a stored spectrogram. Everything that depends on one frame only
+// (log-magnitudes, the tolerance level and the phase time derivative, which
+// comes from the log-magnitude slope across bins) is computed once by init
+// and kept in the model's arena; processFrame only takes the time difference
+// to the previous frame played, which may be any frame, and runs the heap
+// propagation.
+class FrameRTPGHI {
+
+public:
+  // room init takes in the arena
+  static index arenaBytes(index numFrames, index numBins) {
+    return 2 * ArenaMatrix<float>::bytes(numFrames, numBins);
+  }
+
+  void init(ComplexMatrixView spectrogram, std::shared_ptr<ModelArena> arena,
+            index windowSize, index fftSize, index hopSize,
+            double tolerance = 1e-5) {
+    using namespace Eigen;
+    index numFrames = spectrogram.rows();
+    index numBins = spectrogram.cols();
+    double gamma = 0.25645 * windowSize * windowSize; // Hann window
+    double aM = static_cast<double>(hopSize) * fftSize;
+    mFreqScale = gamma / aM;
+    // frames start at the window's first sample, so its centre is half a
+    // window later: a constant phase step between neighbouring bins
+    mBinShift = -pi * windowSize / fftSize;
+    ArrayXXd logMag =
+        _impl::asEigen<Array>(spectrogram).abs().max(double(kEpsilon)).log();
+    mLogMag = ArenaMatrix<float>(arena, numFrames, numBins);
+    auto logMagView = mLogMag.view();
+    _impl::asEigen<Array>(logMagView) = logMag.cast<float>();
+    mThreshold = (logMag.rowwise().maxCoeff() + std::log(tolerance))
+                     .cast<float>();
+    // phase advance per hop: the bin's own frequency plus the correction
+    // from the log-magnitude slope across bins
+    ArrayXd binAdvance =
+        ArrayXd::LinSpaced(numBins, 0, numBins - 1) * (2 * pi * hopSize) /
+        fftSize;
+    ArrayXXd timeGrad = binAdvance.transpose().replicate(numFrames, 1);
+    if (numBins > 2)
+      timeGrad.middleCols(1, numBins - 2) +=
+          (aM / gamma / 2) * (logMag.rightCols(numBins - 2) -
+                              logMag.leftCols(numBins - 2));
+    mTimeGrad = ArenaMatrix<float>(arena, numFrames, numBins);
+    auto timeGradView = mTimeGrad.view();
+    _impl::asEigen<Array>(timeGradView) = timeGrad.cast<float>();
+    mPhase.assign(numBins, 0);
+    mPrevPhase.assign(numBins, 0);
+    mFreqGrad.assign(numBins, 0);
+    mDone.assign(numBins, 0);
+    mHeap.clear();
+    mHeap.reserve(2 * numBins);
+    mPrev = -1;
+  }
+
+  // the next frame starts the integration afresh
+  void reset() { mPrev = -1; }
+
+  void processFrame(index frame, ComplexMatrixView spectrogram,
+                    ComplexVectorView out) {
+    index prev = mPrev < 0 ? frame : mPrev;
+    index numBins = asSigned(mPhase.size());
+    auto  logMag = mLogMag.row(frame);
+    auto  prevLogMag = mLogMag.row(prev);
+    auto  timeGrad = mTimeGrad.row(frame);
+    auto  prevTimeGrad = mTimeGrad.row(prev);
+    float threshold = mThreshold(frame);
+    index remaining = 0;
+    mHeap.clear();
+    for (index m = 0; m < numBins; m++) {
+      // phase derivative across bins from the log-magnitude change in time
+      mFreqGrad[m] = mBinShift - mFreqScale * (logMag(m) - prevLogMag(m));
+      mDone[m] = logMag(m) < threshold;
+      if (mDone[m])
+        mPhase[m] = random();
+      else {
+        remaining++;
+        if (mPrev >= 0) mHeap.push_back({prevLogMag(m), m, true});
+      }
+    }
+    std::make_heap(mHeap.begin(), mHeap.end());
+    while (remaining > 0) {
+      if (mHeap.empty()) {
+        // no previous frame to follow: start from the loudest bin left
+        index loudest = -1;
+        for (index m = 0; m < numBins; m++)
+          if (!mDone[m] && (loudest < 0 || logMag(m) > logMag(loudest)))
+            loudest = m;
+        mPhase[loudest] = 0;
+        mDone[loudest] = true;
+        remaining--;
+        push({logMag(loudest), loudest, false});
+        continue;
+      }
+      std::pop_heap(mHeap.begin(), mHeap.end());
+      Bin bin = mHeap.back();
+      mHeap.pop_back();
+      index m = bin.bin;
+      if (bin.previous) {
+        if (mDone[m]) continue;
+        mPhase[m] = mPrevPhase[m] + (prevTimeGrad(m) + timeGrad(m)) / 2;
+        mDone[m] = true;
+        remaining--;
+        push({logMag(m), m, false});
+      } else {
+        for (index k : {m - 1, m + 1}) {
+          if (k < 0 || k >= numBins || mDone[k]) continue;
+          double step = (mFreqGrad[m] + mFreqGrad[k]) / 2;
+          mPhase[k] = mPhase[m] + (k > m ? step : -step);
+          mDone[k] = true;
+          remaining--;
+          push({logMag(k), k, false});
+        }
+      }
+    }
+    for (index m = 0; m < numBins; m++) {
+      mPhase[m] = std::remainder(mPhase[m], 2 * pi);
+      out(m) = std::polar(std::abs(spectrogram(frame, m)), mPhase[m]);
+    }
+    std::swap(mPhase, mPrevPhase);
+    mPrev = frame;
+  }
+
+private:
+  struct Bin {
+    float value;
+    index bin;
+    bool  previous;
+    bool  operator<(const Bin& other) const { return value < other.value; }
+  };
+
+  static constexpr double kEpsilon = 1e-10;
+
+  static index asSigned(size_t x) { return static_cast<index>(x); }
+
+  void push(Bin bin) {
+    mHeap.push_back(bin);
+    std::push_heap(mHeap.begin(), mHeap.end());
+  }
+
+  // phases of bins under the tolerance
+  double random() {
+    mSeed ^= mSeed << 13;
+    mSeed ^= mSeed >> 7;
+    mSeed ^= mSeed << 17;
+    return (mSeed >> 11) * (2 * pi / 9007199254740992.0);
+  }
+
+  ArenaMatrix<float>  mLogMag;
+  ArenaMatrix<float>  mTimeGrad;
+  Eigen::ArrayXf      mThreshold;
+  double              mFreqScale{0};
+  double              mBinShift{0};
+  std::vector<double> mPhase;
+  std::vector<double> mPrevPhase;
+  std::vector<double> mFreqGrad;
+  std::vector<char>   mDone;
+  std::vector<Bin>    mHeap;
+  index               mPrev{-1};
+  std::uint64_t       mSeed{0x9E3779B97F4A7C15ull};
+};
+
+} // namespace algorithm
+} // namespace fluid
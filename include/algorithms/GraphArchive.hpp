@@ -0,0 +1,250 @@
+/*
+Part of the Fluid Corpus Manipulation Project (http://www.flucoma.org/)
+Copyright 2017-2019 University of Huddersfield.
+Licensed under the BSD-3 License.
+See license.md file in the project root for full license information.
+This project has received funding from the European Research Council (ERC)
+under the European Union’s Horizon 2020 research and innovation programme
+(grant agreement No 725899).
+*/
+#pragma once
+
+#include "algorithms/DistanceBand.hpp"
+#include "data/FluidIndex.hpp"
+#include "data/TensorTypes.hpp"
+#include <Eigen/Core>
+#include <algorithm>
+#include <cstdint>
+#include <istream>
+#include <limits>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace fluid {
+namespace algorithm {
+
+// Binary analysis files, written by graph_analyze and the objects' write
+// message and loaded by their read message. A file holds the analysis
+// settings, a hash of the source and the stage results; the spectrogram is
+// not stored and is recomputed from the source on load. Values are in host
+// byte order, the distance matrix in single precision.
+namespace archive {
+
+constexpr char          kMagic[4] = {'F', 'G', 'R', 'A'};
+constexpr std::uint32_t kVersion = 1;
+
+class Writer {
+
+public:
+  Writer(std::ostream& out, const std::string& kind) : mOut(out) {
+    mOut.write(kMagic, 4);
+    value(kVersion);
+    string(kind);
+  }
+
+  template <typename T>
+  void value(T x) {
+    mOut.write(reinterpret_cast<const char*>(&x), sizeof(T));
+  }
+
+  void string(const std::string& s) {
+    value(static_cast<std::uint32_t>(s.size()));
+    mOut.write(s.data(), static_cast<std::streamsize>(s.size()));
+  }
+
+  void values(const std::vector<double>& v) {
+    value(static_cast<std::int64_t>(v.size()));
+    for (double x : v) value(x);
+  }
+
+  void indices(const std::vector<index>& v) {
+    value(static_cast<std::int64_t>(v.size()));
+    for (index x : v) value(static_cast<std::int64_t>(x));
+  }
+
+  void indices(const FluidTensor<index, 1>& v) {
+    value(static_cast<std::int64_t>(v.size()));
+    for (index i = 0; i < v.size(); i++)
+      value(static_cast<std::int64_t>(v(i)));
+  }
+
+  void matrix(const RealMatrix& m) {
+    value(static_cast<std::int64_t>(m.rows()));
+    value(static_cast<std::int64_t>(m.cols()));
+    for (index i = 0; i < m.rows(); i++)
+      for (index j = 0; j < m.cols(); j++) value(m(i, j));
+  }
+
+  void distances(const Eigen::MatrixXd& m) {
+    value(static_cast<std::int64_t>(m.rows()));
+    value(static_cast<std::int64_t>(m.cols()));
+    std::vector<float> column(m.rows());
+    for (index j = 0; j < m.cols(); j++) {
+      for (index i = 0; i < m.rows(); i++)
+        column[i] = static_cast<float>(m(i, j));
+      mOut.write(reinterpret_cast<const char*>(column.data()),
+                 static_cast<std::streamsize>(column.size() * sizeof(float)));
+    }
+  }
+
+  // a band row by row, each of 2 width + 1 entries
+  void band(const DistanceBand& b) {
+    value(static_cast<std::int64_t>(b.rows()));
+    value(static_cast<std::int64_t>(b.width()));
+    std::vector<float> row(2 * b.width() + 1);
+    for (index i = 0; i < b.rows(); i++) {
+      for (index k = 0; k < asSigned(row.size()); k++)
+        row[k] = static_cast<float>(b(i, i - b.width() + k));
+      mOut.write(reinterpret_cast<const char*>(row.data()),
+                 static_cast<std::streamsize>(row.size() * sizeof(float)));
+    }
+  }
+
+  bool ok() const { return mOut.good(); }
+
+private:
+  std::ostream& mOut;
+};
+
+// Every size read is checked against the bytes left in the stream, and the
+// rows of frame data against limitFrames, before anything is allocated.
+class Reader {
+
+public:
+  Reader(std::istream& in) : mIn(in) {
+    std::streamoff start = mIn.tellg();
+    if (start < 0) return; // not seekable: only the frame limit applies
+    if (mIn.seekg(0, std::ios::end)) mEnd = mIn.tellg();
+    mIn.clear();
+    mIn.seekg(start);
+  }
+
+  // matrices, distances, bands and index lists hold at most frames rows
+  void limitFrames(index frames) { mMaxFrames = std::max(frames, index(0)); }
+
+  // checks magic, version and that the file holds a model of this kind
+  bool open(const std::string& kind, std::string& error) {
+    char magic[4];
+    mIn.read(magic, 4);
+    if (!mIn || std::string(magic, 4) != std::string(kMagic, 4)) {
+      error = "Not an analysis file";
+      return false;
+    }
+    if (value<std::uint32_t>() != kVersion) {
+      error = "Unsupported analysis file version";
+      return false;
+    }
+    std::string fileKind = string();
+    if (fileKind != kind) {
+      error = "Analysis file is for " + fileKind + ", not " + kind;
+      return false;
+    }
+    return ok();
+  }
+
+  template <typename T>
+  T value() {
+    T x{};
+    mIn.read(reinterpret_cast<char*>(&x), sizeof(T));
+    return x;
+  }
+
+  std::string string() {
+    index       size = checkedSize(value<std::uint32_t>(), 1, 1);
+    std::string s(asUnsigned(size), '\0');
+    mIn.read(&s[0], static_cast<std::streamsize>(s.size()));
+    return s;
+  }
+
+  std::vector<double> values() {
+    std::vector<double> v(
+        asUnsigned(checkedSize(value<std::int64_t>(), 1, sizeof(double))));
+    for (double& x : v) x = value<double>();
+    return v;
+  }
+
+  std::vector<index> indices() {
+    std::vector<index> v(asUnsigned(
+        checkedRows(value<std::int64_t>(), 1, sizeof(std::int64_t))));
+    for (index& x : v) x = static_cast<index>(value<std::int64_t>());
+    return v;
+  }
+
+  RealMatrix matrix() {
+    std::int64_t rows = value<std::int64_t>();
+    index        cols = checkedSize(value<std::int64_t>(), 1, 1);
+    rows = checkedRows(rows, cols, sizeof(double));
+    RealMatrix m(rows, ok() ? cols : 0);
+    for (index i = 0; i < rows && ok(); i++)
+      for (index j = 0; j < cols; j++) m(i, j) = value<double>();
+    return m;
+  }
+
+  Eigen::MatrixXd distances() {
+    std::int64_t       rows = value<std::int64_t>();
+    index              cols = checkedSize(value<std::int64_t>(), 1, 1);
+    rows = checkedRows(rows, cols, sizeof(float));
+    Eigen::MatrixXd    m(rows, ok() ? cols : 0);
+    std::vector<float> column(rows);
+    for (index j = 0; j < cols && ok(); j++) {
+      mIn.read(reinterpret_cast<char*>(column.data()),
+               static_cast<std::streamsize>(column.size() * sizeof(float)));
+      for (index i = 0; i < rows; i++) m(i, j) = column[i];
+    }
+    return m;
+  }
+
+  DistanceBand band() {
+    std::int64_t       rows = value<std::int64_t>();
+    index              width = checkedRows(value<std::int64_t>(), 1, 1);
+    rows = checkedRows(rows, 2 * width + 1, sizeof(float));
+    DistanceBand       b(rows, ok() ? width : 0);
+    std::vector<float> row(2 * b.width() + 1);
+    for (index i = 0; i < rows && ok(); i++) {
+      mIn.read(reinterpret_cast<char*>(row.data()),
+               static_cast<std::streamsize>(row.size() * sizeof(float)));
+      for (index k = 0; k < asSigned(row.size()); k++)
+        b.at(i, i - b.width() + k) = row[k];
+    }
+    return b;
+  }
+
+  bool ok() const { return mIn.good(); }
+
+private:
+  // A truncated or corrupt file must not turn into a huge allocation: size
+  // entries of count values of bytes each have to be left in the stream,
+  // otherwise the stream fails and the size is 0.
+  index checkedSize(std::int64_t size, index count, index bytes) {
+    if (!ok() || size < 0 || size > (std::int64_t(1) << 32) ||
+        (size > 0 && count > remaining() / bytes / size)) {
+      mIn.setstate(std::ios::failbit);
+      return 0;
+    }
+    return static_cast<index>(size);
+  }
+
+  // the same for a number of frames, which the source bounds as well
+  index checkedRows(std::int64_t rows, index count, index bytes) {
+    if (rows > mMaxFrames) {
+      mIn.setstate(std::ios::failbit);
+      return 0;
+    }
+    return checkedSize(rows, count, bytes);
+  }
+
+  std::int64_t remaining() {
+    if (mEnd < 0) return std::numeric_limits<std::int64_t>::max();
+    std::streamoff at = mIn.tellg();
+    return at < 0 ? 0 : mEnd - at;
+  }
+
+  std::istream&  mIn;
+  std::streamoff mEnd{-1};
+  index          mMaxFrames{std::numeric_limits<index>::max()};
+};
+
+} // namespace archive
+} // namespace algorithm
+} // namespace fluid
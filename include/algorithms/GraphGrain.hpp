@@ -9,8 +9,15 @@ under the European Union’s Horizon 2020 research and innovation programme
 */
 #pragma once
 
+#include "algorithms/AnalysisBudget.hpp"
+#include "algorithms/AnalysisStages.hpp"
+#include "algorithms/FrameRTPGHI.hpp"
+#include "algorithms/GraphPlayback.hpp"
 #include "algorithms/GraphPlayUtils.hpp"
-#include "algorithms/util/RTPGHI.hpp"
+#include "algorithms/GraphStats.hpp"
+#include "algorithms/GraphWalk.hpp"
+#include "algorithms/SuccessorTable.hpp"
+#include "algorithms/ThresholdSweep.hpp"
 #include "algorithms/public/STFT.hpp"
 #include "algorithms/util/AlgorithmUtils.hpp"
 #include "algorithms/util/FluidEigenMappings.hpp"
@@ -20,11 +27,18 @@ under the European Union’s Horizon 2020 research and innovation programme
 #include <Eigen/Dense>
 #include <fstream>
 #include <random>
+#include <string>
 #include <vector>
 
 namespace fluid {
 namespace algorithm {
 
+// With a corpus, a second source, init builds no self-similarity graph,
+// onsets or clusters: each frame of the source is linked to its nearest
+// frames of the corpus (CrossNeighbours), and every hop plays a corpus frame
+// that matches the source frame under the threshold, or the source frame
+// itself without one. Corpus frames are numbered after the source's in the
+// frames step returns, and are in no cluster (-1).
 class GraphGrain {
 
 public:
@@ -32,9 +46,12 @@ public:
   using VectorXd = Eigen::VectorXd;
   using DataSet = FluidDataSet<std::string, double, 1>;
 
-  void init(RealVectorView audio, index sampleRate, index windowSize,
+  void init(const AudioSource& source, index sampleRate, index windowSize,
             index fftSize, index hopSize, index numBands, index distance,
-            double threshold, index nClusters, RealVectorView output) {
+            double threshold, index nClusters, index segmentSize,
+            index coarseNeighbours, RealVectorView output,
+            index maxLinks = 0, bool compressedSearch = false,
+            index maxJump = 0, const AudioSource* corpus = nullptr) {
     using namespace Eigen;
     using namespace _impl;
     using namespace std;
@@ -42,175 +59,614 @@ public:
     mFFTSize = fftSize;
     mHopSize = hopSize;
     mFrameSize = (mFFTSize / 2) + 1;
-    mThreshold = threshold;
-    STFT stft = STFT(mWindowSize, mFFTSize, mHopSize);
-    mLength = std::floor((audio.size() + mHopSize) / mHopSize);
-    mSpectrogram = ComplexMatrix(mLength, mFrameSize);
-    stft.process(audio, mSpectrogram);
-    mMagnitude = RealMatrix(mLength, mFrameSize);
-    stft.magnitude(mSpectrogram, mMagnitude);
-    mDM = mUtils.computeDM(mMagnitude, numBands, sampleRate, windowSize,
-                           fftSize, distance);
-    mDM.diagonal().setZero();
-    mForbidden = ArrayXXd::Ones(mDM.rows(), mDM.cols());
-    mVisited = ArrayXXd::Zero(mDM.rows(), mDM.cols());
-    ArrayXd odf = mDM.diagonal(1).array();
-    mClusters = FluidTensor<index, 1>(mLength);
-    mUtils.onsetDetection(odf, mForbidden);
-    if (nClusters != 1) {
-      mClusters = mUtils.spectralClustering(mDM, nClusters);
-      for (index i = 0; i < mLength; i++) {
-        for (index j = 0; j < mLength; j++) {
-          if (mClusters(i) != mClusters(j)) {
-            mForbidden(i, j) = 0;
-            mForbidden(j, i) = 0;
-          }
-        }
+    mWalk.threshold = threshold;
+    mStats.reset();
+    mStages.begin(source);
+    if (mStages.dirty(AnalysisStages::kSpectrum,
+                      {double(windowSize), double(fftSize), double(hopSize)})) {
+      GraphStats::ScopedTimer timer(mStats, GraphStats::kSTFT);
+      // the phase data shares the spectrogram's arena
+      mSpectrogram = mUtils.arenaSpectrogram(
+          source, mWindowSize, mFFTSize, mHopSize,
+          FrameRTPGHI::arenaBytes(mUtils.numFrames(source.size(), mHopSize),
+                                  mFrameSize));
+      mLength = mSpectrogram.rows();
+      mPhase.init(mSpectrogram.view(), mSpectrogram.arena(), mWindowSize,
+                  mFFTSize, mHopSize);
+    }
+    if (mStages.dirty(AnalysisStages::kFeatures,
+                      {double(numBands), double(sampleRate)})) {
+      GraphStats::ScopedTimer timer(mStats, GraphStats::kMel);
+      mMelSpectrogram = mUtils.melSpectrogram(mSpectrogram.view(), numBands,
+                                              sampleRate, windowSize, fftSize);
+    }
+    if (corpus) {
+      initCross(*corpus, sampleRate, numBands, distance, maxLinks);
+      mPlayback.init(mWindowSize, mFFTSize, mHopSize);
+      resetPlayback();
+      return;
+    }
+    mCross = CrossNeighbours();
+    mCorpusSpectrogram = ArenaMatrix<std::complex<double>>();
+    mCorpusLength = 0;
+    if (mStages.dirty(AnalysisStages::kDistances,
+                      {double(distance), double(segmentSize),
+                       double(coarseNeighbours),
+                       double(compressedSearch), double(maxJump)})) {
+      GraphStats::ScopedTimer timer(mStats, GraphStats::kDistance);
+      if (DistanceBand::useful(maxJump, mLength)) {
+        mBand = mUtils.bandDistances(mMelSpectrogram, distance, maxJump);
+        mBand.zeroDiagonal();
+        mDM = MatrixXd();
+      } else {
+        mDM = mUtils.distanceMatrix(mMelSpectrogram, distance, segmentSize,
+                                    coarseNeighbours, compressedSearch);
+        mDM.diagonal().setZero();
+        mBand = DistanceBand();
       }
     }
-    mRP = (mDM.array() < threshold).cast<double>();
-    mRP = mRP.array() * mForbidden.array();
-    mRTPGHI.init(fftSize);
-    mPrevMag = RealVector(mFrameSize);
-    mPrevMag = mMagnitude.row(0);
-    mInitialized = true;
+    if (mStages.dirty(AnalysisStages::kStructure, {double(nClusters)})) {
+      {
+        GraphStats::ScopedTimer timer(mStats, GraphStats::kOnsets);
+        ArrayXd odf = successiveDistances();
+        mOnsets = mUtils.onsets(odf);
+      }
+      mClusters = FluidTensor<index, 1>(mLength);
+      if (nClusters != 1) {
+        GraphStats::ScopedTimer timer(mStats, GraphStats::kClustering);
+        mClusters = banded() ? mUtils.spectralClustering(mBand, nClusters)
+                             : mUtils.spectralClustering(mDM, nClusters);
+      }
+    }
+    if (mStages.dirty(AnalysisStages::kGraph, {double(maxLinks)})) {
+      mMaxLinks = maxLinks;
+      buildGraph();
+    }
+    mPlayback.init(mWindowSize, mFFTSize, mHopSize);
+    resetPlayback();
   }
 
-  index selectProb() {
-    index nNeighbors = mRP.col(mPos).sum();
-    if (nNeighbors == 0)
-      return nextInCluster(mPos);
-    std::vector<index> candidates(nNeighbors);
-    std::vector<double> acumProbs(nNeighbors);
-    index nCandidates = 0;
-    double prob = 0;
-    for (index i = 0; i < mRP.rows(); i++) {
-      if (mRP(mPos, i) > 0 && mVisited(mPos, i) <= 0) {
-        prob = prob + (1 - mDM(mPos, i));
-        acumProbs[nCandidates] = prob;
-        candidates[nCandidates++] = i;
+  // brings the analysis up to date after samples [start, start + count) of
+  // source were overwritten, with the settings it was made with: only the
+  // frames over them and their distances to all others are recomputed, then
+  // the onsets and the links. Clustering is global and is not run again;
+  // each changed frame joins the cluster of its nearest unchanged one. With
+  // a corpus, the changed frames are looked up in it again.
+  bool update(const AudioSource& source, index start, index count,
+              std::string& error) {
+    if (!mInitialized ||
+        (!cross() && !mStages.valid(AnalysisStages::kStructure))) {
+      error = "No analysis to update";
+      return false;
+    }
+    if (mUtils.numFrames(source.size(), mHopSize) != mLength) {
+      error = "Source length changed, analyze again";
+      return false;
+    }
+    auto frames =
+        mUtils.framesOver(start, count, mWindowSize, mHopSize, mLength);
+    if (frames.second <= 0) {
+      error = "No frames in the updated range";
+      return false;
+    }
+    const auto& features = mStages.key(AnalysisStages::kFeatures);
+    const auto& distances = mStages.key(AnalysisStages::kDistances);
+    mStats.reset();
+    {
+      GraphStats::ScopedTimer timer(mStats, GraphStats::kSTFT);
+      mSpectrogram = mUtils.updateSpectrogram(
+          mSpectrogram, source, mWindowSize, mFFTSize, mHopSize, frames.first,
+          frames.second, FrameRTPGHI::arenaBytes(mLength, mFrameSize));
+      mPhase.init(mSpectrogram.view(), mSpectrogram.arena(), mWindowSize,
+                  mFFTSize, mHopSize);
+    }
+    RealMatrix oldFeatures = mMelSpectrogram;
+    {
+      GraphStats::ScopedTimer timer(mStats, GraphStats::kMel);
+      RealMatrix mel = mUtils.melSpectrogram(
+          mSpectrogram.view()(Slice(frames.first, frames.second), Slice(0)),
+          static_cast<index>(features[0]), features[1], mWindowSize,
+          mFFTSize);
+      for (index i = 0; i < frames.second; i++)
+        mMelSpectrogram.row(frames.first + i) = mel.row(i);
+    }
+    if (cross()) {
+      {
+        GraphStats::ScopedTimer timer(mStats, GraphStats::kDistance);
+        mUtils.updateCross(mMelSpectrogram, frames.first, frames.second,
+                           mCross);
+      }
+      mStages.updated(source);
+      buildGraph();
+      resetPlayback();
+      return true;
+    }
+    {
+      GraphStats::ScopedTimer timer(mStats, GraphStats::kDistance);
+      if (banded()) {
+        mUtils.updateBand(mMelSpectrogram, static_cast<index>(distances[0]),
+                          frames.first, frames.second, mBand);
+        mBand.zeroDiagonal();
+      } else {
+        mUtils.updateDistances(oldFeatures, mMelSpectrogram,
+                               static_cast<index>(distances[0]),
+                               static_cast<index>(distances[1]),
+                               static_cast<index>(distances[2]),
+                               distances.size() > 3 && distances[3] != 0,
+                               frames.first, frames.second, mDM);
+        mDM.diagonal().setZero();
+      }
+    }
+    {
+      GraphStats::ScopedTimer timer(mStats, GraphStats::kOnsets);
+      Eigen::ArrayXd odf = successiveDistances();
+      mOnsets = mUtils.onsets(odf);
+    }
+    index last = frames.first + frames.second;
+    if (frames.second < mLength) {
+      // banded, the nearest unchanged frame is looked for within the band,
+      // and failing that is the closest in time
+      for (index i = frames.first; i < last; i++) {
+        index  nearest = frames.first > 0 ? frames.first - 1 : last;
+        double best = 2;
+        index  lo = banded() ? mBand.first(i) : 0;
+        index  hi = banded() ? mBand.last(i) : mLength;
+        for (index j = lo; j < hi; j++) {
+          double d = banded() ? mBand(i, j) : mDM(i, j);
+          if ((j < frames.first || j >= last) && d < best) {
+            nearest = j;
+            best = d;
+          }
+        }
+        mClusters(i) = mClusters(nearest);
       }
     }
-    double rnd = prob * mUtils.rand();
-    index selected = 0;
-    while (acumProbs[selected] < rnd)
-      selected++;
-    return candidates[selected];
+    mStages.updated(source);
+    buildGraph();
+    resetPlayback();
+    return true;
   }
 
-  index nextInCluster(index current) {
-    for (index i = current + 1; i < mLength + current; i++) {
-      index pos = i % mLength;
-      if (mClusters(pos) == mClusters(current))
-        return pos;
+  // projected cost of init for a source of numSamples
+  static AnalysisEstimate estimate(index numSamples, index windowSize,
+                                   index fftSize, index hopSize,
+                                   index numBands, index nClusters,
+                                   index segmentSize, index coarseNeighbours,
+                                   index maxLinks, index maxJump = 0,
+                                   index corpusSamples = 0) {
+    AnalysisEstimate e(numSamples, windowSize, fftSize, hopSize, maxLinks);
+    double n = e.frames();
+    double span = e.span(maxJump);
+    e.spectrum();
+    e.add(8 * n * e.bins(), 8 * n * e.bins(), 4 * n * e.bins()); // phase
+    e.features(numBands);
+    if (corpusSamples > 0) {
+      double m = corpusSamples / hopSize + 1;
+      index  links = CrossNeighbours::neighbours(maxLinks);
+      e.cross(corpusSamples, numBands, links,
+              links * CrossNeighbours::kOversample);
+      e.add(8 * m * e.bins(), 8 * m * e.bins(), 4 * m * e.bins()); // phase
+      e.add(16 * n, 0, 0); // clusters, candidates
+      return e;
     }
+    e.distances(numBands, segmentSize, coarseNeighbours, maxJump);
+    // affinity, weights and the embedding of spectral clustering, which
+    // tries up to 50 clusters when choosing the number itself; banded, the
+    // affinity is sparse
+    double clusters = nClusters > 0 ? nClusters : 50;
+    if (nClusters != 1)
+      e.add(8 * n, 3 * 8 * n * span, 10 * n * span * clusters);
+    // allowed links and cluster members, or an onset mask when banded
+    if (e.banded(maxJump)) e.add(0, n, 0);
+    else e.add(0, n * n / 4, 0);
+    e.links(n * e.rowLinks(span - 1), 12);
+    e.add(20 * n, 0, 3 * n); // successor tree, next frame in cluster
+    e.add(n * span / 8 + 8 * n, 0, 0); // visited links, candidates
+    return e;
   }
 
-  index selectRand(double randomness) {
-    index nNeighbors = mRP.col(mPos).sum();
-    if (nNeighbors == 0) {
-      mVisited.row(mPos).setZero();
-      return nextInCluster(mPos);
+  // saves the analysis; the spectrogram is recomputed from the source on read.
+  // Analyses with a corpus are not saved.
+  bool write(std::ostream& out) const {
+    if (cross()) return false;
+    archive::Writer writer(out, "graphgrain");
+    writer.value<std::int64_t>(mWindowSize);
+    writer.value<std::int64_t>(mFFTSize);
+    writer.value<std::int64_t>(mHopSize);
+    mStages.write(writer);
+    writer.matrix(mMelSpectrogram);
+    if (banded())
+      writer.band(mBand);
+    else
+      writer.distances(mDM);
+    writer.indices(mOnsets);
+    writer.indices(mClusters);
+    return writer.ok();
+  }
+
+  bool read(std::istream& in, const AudioSource& source, std::string& error) {
+    archive::Reader reader(in);
+    if (!reader.open("graphgrain", error)) return false;
+    index windowSize = reader.value<std::int64_t>();
+    index fftSize = reader.value<std::int64_t>();
+    index hopSize = reader.value<std::int64_t>();
+    reader.limitFrames(hopSize > 0 ? mUtils.numFrames(source.size(), hopSize)
+                                   : 0);
+    AnalysisStages stages;
+    stages.read(reader);
+    if (reader.ok() && !stages.matches(source)) {
+      error = "Analysis file was made from a different source";
+      return false;
     }
-    std::vector<index> candidates(nNeighbors);
-    index nCandidates = 0;
-    for (index i = 0; i < mRP.rows(); i++)
-      if (i != mPos && mRP(mPos, i) > 0 && mVisited(mPos, i) <= 0) {
-        candidates[nCandidates++] = i;
-      }
-    std::sort(candidates.begin(), candidates.end(),
-              [this](index a, index b) { return mDM(mPos, a) < mDM(mPos, b); });
-    if (randomness == 0)
-      return candidates[0];
-    index k = lrint(randomness * nCandidates);
-    index next = mUtils.randInt(k);
-    return candidates[next];
-  }
-
-  index selectNearest() {
-    index nNeighbors = mRP.col(mPos).sum();
-    if (nNeighbors == 0) {
-      return nextInCluster(mPos);
-    }
-    double minDist = infinity;
-    index selected = 0;
-    for (index i = 0; i < mRP.rows(); i++) {
-      if ((i != mPos) && (mRP(mPos, i) > 0) && (mDM(mPos, i) < minDist) &&
-          (mVisited(mPos, i) == 0)) {
-        selected = i;
-        minDist = mDM(mPos, i);
-      }
+    RealMatrix         mel = reader.matrix();
+    const auto&        distances = stages.key(AnalysisStages::kDistances);
+    index              maxJump = distances.size() > 4 ? index(distances[4]) : 0;
+    bool               isBanded = DistanceBand::useful(maxJump, mel.rows());
+    MatrixXd           dm;
+    DistanceBand       band;
+    if (isBanded)
+      band = reader.band();
+    else
+      dm = reader.distances();
+    std::vector<index> onsets = reader.indices();
+    std::vector<index> clusters = reader.indices();
+    if (!reader.ok() || windowSize <= 0 || hopSize <= 0 || fftSize <= 0) {
+      error = "Analysis file is truncated or corrupt";
+      return false;
+    }
+    auto spectrogram = mUtils.arenaSpectrogram(
+        source, windowSize, fftSize, hopSize,
+        FrameRTPGHI::arenaBytes(mUtils.numFrames(source.size(), hopSize),
+                                fftSize / 2 + 1));
+    index length = spectrogram.rows();
+    index rows = isBanded ? band.rows() : dm.rows();
+    if (rows != length || mel.rows() != length ||
+        asSigned(clusters.size()) != length) {
+      error = "Analysis file does not match the source length";
+      return false;
+    }
+    mWindowSize = windowSize;
+    mFFTSize = fftSize;
+    mHopSize = hopSize;
+    mFrameSize = (mFFTSize / 2) + 1;
+    mSpectrogram = spectrogram;
+    mLength = length;
+    mPhase.init(mSpectrogram.view(), mSpectrogram.arena(), mWindowSize,
+                mFFTSize, mHopSize);
+    mMelSpectrogram = mel;
+    mDM = dm;
+    mBand = band;
+    mCross = CrossNeighbours();
+    mCorpusSpectrogram = ArenaMatrix<std::complex<double>>();
+    mCorpusLength = 0;
+    mOnsets = onsets;
+    mClusters = FluidTensor<index, 1>(mLength);
+    std::copy(clusters.begin(), clusters.end(), mClusters.begin());
+    mStages = stages;
+    const auto& graphKey = mStages.key(AnalysisStages::kGraph);
+    mMaxLinks = graphKey.empty() ? 0 : static_cast<index>(graphKey[0]);
+    buildGraph();
+    mPlayback.init(mWindowSize, mFFTSize, mHopSize);
+    resetPlayback();
+    return true;
+  }
+
+  index nextInCluster(index current) const {
+    return mSuccessors.nextInCluster(current);
+  }
+
+  template <typename Policy>
+  index select(double randomness, double temperature) {
+    WalkContext context =
+        mWalk.context(mTable, mWalk.pos, 0, randomness, temperature);
+    index selected = Policy::select(context);
+    if (selected < 0) {
+      mStats.count(GraphStats::kClusterFallback);
+      mWalk.visited.clearRow(mWalk.pos);
+      return nextInCluster(mWalk.pos);
     }
-    if (selected == 0)
-      return nextInCluster(mPos);
     return selected;
   }
 
+  template <typename Policy = RankRandomPolicy>
   void processFrame(ComplexVectorView out, double start, double threshold,
-                    index forget, double rand, index phaseGen,
-                    RealVectorView output) {
-    using namespace Eigen;
-    using namespace _impl;
+                    index forget, double rand, double temperature,
+                    index phaseGen, RealVectorView output) {
+    GraphStats::HopTimer hopTimer(mStats);
+    for (index hops = hopsDue(); hops > 0; hops--)
+      step<Policy>(start, threshold, forget, rand, temperature);
+    render(out, current(), phaseGen, output);
+  }
 
-    if (mThreshold != threshold) {
-      mRP = (mDM.array() < threshold).cast<double>();
-      mRP = mRP.array() * mForbidden.array();
-      mThreshold = threshold;
+  // plays a frame chosen by step on a planner thread; frame < 0 when the
+  // planner fell behind, and playback carries on from the last frame
+  void playFrame(ComplexVectorView out, index frame, index phaseGen,
+                 RealVectorView output) {
+    GraphStats::HopTimer hopTimer(mStats);
+    if (frame < 0) {
+      mStats.count(GraphStats::kPlannerUnderruns);
+      frame = following(mPlayed);
     }
+    render(out, frame, phaseGen, output);
+  }
+
+  // the frame played last
+  index playing() const { return mPlayed; }
+
+  // allocates playback at resolutions up to maxFFTSize, off the audio
+  // thread; assignments keep it
+  void preparePlayback(index maxFFTSize) { mPlayback.prepare(maxFFTSize); }
 
-    index next = (mPos + 1) % mSpectrogram.rows();
-    mVisited = (mVisited.array() - 1).cwiseMax(0);
+  // playback STFT settings for the following frames; when they differ from
+  // the analysis, frames are cut from source and corpus, which have to
+  // outlive them
+  void setPlayback(index windowSize, index fftSize, index hopSize,
+                   const AudioSource* source,
+                   const AudioSource* corpus = nullptr) {
+    mPlayback.setResolution(windowSize, fftSize, hopSize, source, corpus);
+  }
+
+  // walk steps due for the next playback frame: 1 at the analysis
+  // resolution, otherwise as many analysis hops as the playback hop covers
+  index hopsDue() { return mPlayback.advance(); }
+
+  // advances the walk by one hop and returns the frame to play
+  template <typename Policy = RankRandomPolicy>
+  index step(double start, double threshold, index forget, double rand,
+             double temperature) {
+    mWalk.threshold = threshold;
+    index next = (mWalk.pos + 1) % mSpectrogram.rows();
+    mWalk.visited.advance();
     index startFrame = lrint(start * (mSpectrogram.rows() - 1));
-    if (startFrame != mStartFrame) {
-      mStartFrame = startFrame;
-      mPos = mStartFrame;
-      index nNeighbors = mRP.col(mPos).sum();
-      while (nNeighbors == 0) {
-        nNeighbors = mRP.col(mPos).sum();
-        mPos = (mPos + 1) % mSpectrogram.rows();
-      }
-      mCount = 0;
+    if (cross())
+      return crossStep<Policy>(startFrame, forget, rand, temperature);
+    if (startFrame != mWalk.startFrame) {
+      mStats.count(GraphStats::kSeeks);
+      mWalk.startFrame = startFrame;
+      // from the first frame on with somewhere to jump to, if any
+      index linked = mSuccessors.nextLinked(mWalk.startFrame, mWalk.threshold);
+      if (linked != mWalk.startFrame) mStats.count(GraphStats::kNoNeighbours);
+      mWalk.pos = linked >= 0 ? linked : mWalk.startFrame;
+      mWalk.count = 0;
     } else {
-      index prevPos = mPos;
-      mPos = selectRand(rand);
-      mVisited(prevPos, mPos) = forget;
+      index prevPos = mWalk.pos;
+      mWalk.pos = select<Policy>(rand, temperature);
+      mWalk.visited.mark(prevPos, mWalk.pos, forget);
+      if (mWalk.pos != (prevPos + 1) % mLength)
+        mStats.count(GraphStats::kJumps);
     }
-    RealVectorView frame = mMagnitude.row(mPos);
-    if (phaseGen > 0)
-      mRTPGHI.processFrame(frame, out, mWindowSize, mFFTSize, mHopSize, 1e-5);
-    else
-      out = mSpectrogram.row(mPos);
-    output(0) = mPos;
-    output(1) = mClusters(mPos);
+    return mWalk.pos;
+  }
+
+  // the walk continues from frame at the next step; from a corpus frame,
+  // the source carries on where it was
+  void moveTo(index frame) {
+    if (cross() && frame >= mLength)
+      mWalk.corpusPos = frame - mLength;
+    else {
+      mWalk.pos = frame;
+      mWalk.corpusPos = -1;
+    }
+  }
+
+  // nearest frame linked from frame, -1 without links under threshold or
+  // with a corpus, whose links lead out of the source
+  index nearest(index frame, double threshold) const {
+    if (cross()) return -1;
+    return mTable.degree(frame, threshold) > 0 ? mTable.neighbour(frame, 0)
+                                               : -1;
   }
 
+  void seed(index seed) { mWalk.utils.seed(seed); }
+
+  index numFrames() { return mLength; }
+
   bool initialized() { return mInitialized; }
 
+  // whether the analysis links the source to a corpus instead of itself
+  bool cross() const { return mCorpusLength > 0; }
+
+  const GraphStats& stats() const { return mStats; }
+
+  // link statistics of the distance matrix at out.cols() thresholds, see
+  // ThresholdSweep; there is none with a corpus
+  void sweep(RealMatrixView out) const {
+    if (cross()) return;
+    ThresholdSweep sweep;
+    if (banded())
+      sweep.process(mBand, out);
+    else
+      sweep.process(mDM, out);
+  }
+
   index mWindowSize;
   index mHopSize;
   index mFFTSize;
 
 private:
+  void render(ComplexVectorView out, index frame, index phaseGen,
+              RealVectorView output) {
+    // each source integrates the phase of its own frames, starting afresh
+    // when playback moves from one to the other
+    bool         fromCorpus = frame >= mLength;
+    index        local = fromCorpus ? frame - mLength : frame;
+    FrameRTPGHI& phase = fromCorpus ? mCorpusPhase : mPhase;
+    auto         spectrogram =
+        fromCorpus ? mCorpusSpectrogram.view() : mSpectrogram.view();
+    (fromCorpus ? mPhase : mCorpusPhase).reset();
+    // phase generation works on the stored frames, at the analysis resolution
+    if (mPlayback.render(local, out, fromCorpus))
+      phase.reset();
+    else if (phaseGen > 0) {
+      GraphStats::ScopedTimer timer(mStats, GraphStats::kRTPGHI);
+      phase.processFrame(local, spectrogram, out);
+    } else {
+      out = spectrogram.row(local);
+      phase.reset();
+    }
+    output(0) = frame;
+    output(1) = fromCorpus ? -1 : mClusters(frame);
+    mPlayed = frame;
+  }
+
+  // the source's frames and their nearest corpus frames; the source's own
+  // distances, structure and graph are not computed, and the stages after
+  // the features are done again by the next analysis without a corpus
+  void initCross(const AudioSource& corpus, index sampleRate, index numBands,
+                 index distance, index maxLinks) {
+    {
+      GraphStats::ScopedTimer timer(mStats, GraphStats::kSTFT);
+      mCorpusSpectrogram = mUtils.arenaSpectrogram(
+          corpus, mWindowSize, mFFTSize, mHopSize,
+          FrameRTPGHI::arenaBytes(mUtils.numFrames(corpus.size(), mHopSize),
+                                  mFrameSize));
+      mCorpusLength = mCorpusSpectrogram.rows();
+      mCorpusPhase.init(mCorpusSpectrogram.view(),
+                        mCorpusSpectrogram.arena(), mWindowSize, mFFTSize,
+                        mHopSize);
+    }
+    RealMatrix corpusMel;
+    {
+      GraphStats::ScopedTimer timer(mStats, GraphStats::kMel);
+      corpusMel = mUtils.melSpectrogram(mCorpusSpectrogram.view(), numBands,
+                                        sampleRate, mWindowSize, mFFTSize);
+    }
+    {
+      GraphStats::ScopedTimer timer(mStats, GraphStats::kDistance);
+      mCross = mUtils.crossNeighbours(mMelSpectrogram, corpusMel, distance,
+                                      CrossNeighbours::neighbours(maxLinks));
+    }
+    mStages.invalidate(AnalysisStages::kDistances);
+    mStages.invalidate(AnalysisStages::kStructure);
+    mStages.invalidate(AnalysisStages::kGraph);
+    mDM = MatrixXd();
+    mBand = DistanceBand();
+    mOnsets.clear();
+    mClusters = FluidTensor<index, 1>(mLength);
+    mMaxLinks = maxLinks;
+    buildGraph();
+  }
+
+  // the source plays on, and each hop plays a corpus frame linked from the
+  // source frame instead, if there is one
+  template <typename Policy>
+  index crossStep(index startFrame, index forget, double rand,
+                  double temperature) {
+    if (startFrame != mWalk.startFrame) {
+      mStats.count(GraphStats::kSeeks);
+      mWalk.startFrame = startFrame;
+      mWalk.pos = startFrame;
+      mWalk.corpusPos = -1;
+      return current();
+    }
+    mWalk.pos = (mWalk.pos + 1) % mLength;
+    // corpus frames are never close in time to the source frame
+    WalkContext context =
+        mWalk.context(mTable, mWalk.pos, -1, rand, temperature);
+    mWalk.corpusPos = Policy::select(context);
+    if (mWalk.corpusPos >= 0) {
+      mStats.count(GraphStats::kJumps);
+      mWalk.visited.mark(mWalk.pos, mWalk.corpusPos, forget);
+    } else
+      mStats.count(GraphStats::kNoNeighbours);
+    return current();
+  }
+
+  // the frame the walk is at, corpus frames after the source's
+  index current() const {
+    return mWalk.corpusPos >= 0 ? mLength + mWalk.corpusPos : mWalk.pos;
+  }
+
+  // the frame after frame in its own source
+  index following(index frame) const {
+    if (frame >= mLength)
+      return mLength + (frame - mLength + 1) % mCorpusLength;
+    return (frame + 1) % mLength;
+  }
+
+  // distances are kept for frames at most maxJump apart only
+  bool banded() const { return mBand.rows() > 0; }
+
+  // distance from each frame to the next, the onset detection function
+  Eigen::ArrayXd successiveDistances() const {
+    return banded() ? mBand.diagonal(1) : Eigen::ArrayXd(mDM.diagonal(1));
+  }
+
+  // onset and cluster constraints on top of the distance matrix; banded,
+  // they are tested per link within the band instead of held as bits
+  void buildGraph() {
+    if (cross()) {
+      mTable.init(mCross);
+      return;
+    }
+    index numClusters = 0;
+    for (index i = 0; i < mLength; i++)
+      numClusters = std::max(numClusters, mClusters(i) + 1);
+    if (banded()) {
+      std::vector<bool> onset = mUtils.onsetMask(mOnsets, mLength);
+      mTable.init(
+          mBand,
+          [&](index i, index j) {
+            return !onset[asUnsigned(i)] && !onset[asUnsigned(j)] &&
+                   mClusters(i) == mClusters(j);
+          },
+          mMaxLinks);
+      mSuccessors.init(mTable);
+      mSuccessors.setClusters(mClusters, numClusters);
+      return;
+    }
+    BitMatrix allowed(mLength, mLength, true);
+    mUtils.forbidOnsets(mOnsets, allowed);
+    // one row of members per cluster, and'ed into the rows of its frames
+    BitMatrix members(numClusters, mLength);
+    for (index i = 0; i < mLength; i++) members.set(mClusters(i), i);
+    for (index i = 0; i < mLength; i++)
+      allowed.andRow(i, members, mClusters(i));
+    mTable.init(mDM, allowed, mMaxLinks);
+    mSuccessors.init(mTable);
+    mSuccessors.setClusters(mClusters, numClusters);
+  }
+
+  void resetPlayback() {
+    if (cross())
+      mWalk.visited.initSparse(mLength);
+    else
+      mWalk.visited.init(mLength, mBand.width());
+    mWalk.restart();
+    mPlayed = 0;
+    mPhase.reset();
+    mCorpusPhase.reset();
+    mWalk.candidates.resize(std::max(mLength, mCross.size()));
+    mInitialized = true;
+  }
+
   GraphPlayUtils mUtils;
-  ComplexMatrix mSpectrogram;
-  RealMatrix mMagnitude;
-  RealVector mPrevMag;
+  ArenaMatrix<std::complex<double>> mSpectrogram;
+  ArenaMatrix<std::complex<double>> mCorpusSpectrogram;
+  RealMatrix mMelSpectrogram;
   index mFrameSize;
   MatrixXd mDM;
-  MatrixXd mRP;
-  MatrixXd mForbidden;
-  MatrixXd mVisited;
+  DistanceBand mBand;
+  CrossNeighbours mCross;
   VectorXd mDeg;
   bool mInitialized{false};
-  int mPos{0};
   index mLength;
-  index mStartFrame{-1};
+  index mCorpusLength{0};
   index mEndFrame;
-  double mThreshold;
-  index mCount{0};
-  RTPGHI mRTPGHI;
+  index mMaxLinks{0};
   FluidTensor<index, 1> mClusters;
+  std::vector<index> mOnsets;
+  TransitionTable mTable;
+  SuccessorTable mSuccessors;
+  // step and moveTo own the walk, playFrame and hopsDue the playback
+  WalkState mWalk;
+  FrameRTPGHI mPhase;
+  FrameRTPGHI mCorpusPhase;
+  GraphPlayback mPlayback;
+  index mPlayed{0};
   double mPrevGain{0};
+  AnalysisStages mStages;
+  GraphStats mStats;
 };
 } // namespace algorithm
 } // namespace fluid
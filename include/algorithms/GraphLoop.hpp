@@ -19,13 +19,20 @@ under the European Union’s Horizon 2020 research and innovation programme
 #include "algorithms/public/MelBands.hpp"
 #include "algorithms/util/AlgorithmUtils.hpp"
 #include "algorithms/util/FluidEigenMappings.hpp"
+#include "algorithms/AnalysisBudget.hpp"
+#include "algorithms/AnalysisStages.hpp"
+#include "algorithms/GraphPlayback.hpp"
 #include "algorithms/GraphPlayUtils.hpp"
+#include "algorithms/GraphStats.hpp"
+#include "algorithms/LoopCatalogue.hpp"
+#include "algorithms/ThresholdSweep.hpp"
 #include "data/TensorTypes.hpp"
 #include "data/FluidDataSet.hpp"
 #include <Eigen/Core>
 #include <Eigen/Dense>
 #include <vector>
 #include <fstream>
+#include <string>
 
 namespace fluid {
 namespace algorithm {
@@ -36,9 +43,10 @@ public:
   using  MatrixXd = Eigen::MatrixXd;
   using DataSet = FluidDataSet<std::string, double, 1>;
 
-  void init(RealVectorView audio, index sampleRate,
+  void init(const AudioSource& source, index sampleRate,
             index windowSize, index fftSize, index hopSize, index numBands,
-            index distance, double threshold, bool quantize, RealVectorView output) {
+            index distance, double threshold, bool quantize, RealVectorView output,
+            index maxJump = 0) {
     using namespace Eigen;
     using namespace _impl;
     using namespace std;
@@ -48,41 +56,45 @@ public:
     mHopSize = hopSize;
     mFrameSize = (mFFTSize / 2) + 1;
     mThreshold = threshold;
-    mBeat = 0;
-
-
-    STFT stft = STFT(mWindowSize, mFFTSize, mHopSize);
-    mLength = std::floor((audio.size() + mHopSize) / mHopSize);
-    mSpectrogram = ComplexMatrix(mLength, mFrameSize);
-    stft.process(audio, mSpectrogram);
-    mMagnitude = RealMatrix(mLength, mFrameSize);
-    stft.magnitude(mSpectrogram, mMagnitude);
-    mDM = mUtils.computeDM(mMagnitude, numBands, sampleRate, windowSize,
-                           fftSize, distance);
-    mDM.diagonal().setZero();
-
-    MatrixXd sim = 1 - mDM.array();
-    ArrayXd beatSpectrum = ArrayXd::Zero(mLength);
-    for(index i = 0; i < mLength; i++){
-      beatSpectrum(i) = sim.diagonal(i).sum() / (mLength - i);
-    }
-    PeakDetection pd;
-    auto bsPeaks = pd.process(beatSpectrum.segment(1,lrint(beatSpectrum.size()/2)), 3, 0, false, true);
-    mBeat = bsPeaks[0].first;
-    if(bsPeaks.size() > 1 && bsPeaks[1].first < mBeat)mBeat = bsPeaks[1].first;
-    if(bsPeaks.size() > 2 && bsPeaks[2].first < mBeat)mBeat = bsPeaks[2].first;
-    mFilter.init(5);
-    ArrayXd odf = mDM.diagonal(1).array();
-    for(index i = 0; i < odf.size(); i++){
-      odf(i) = odf(i) - mFilter.processSample(odf(i));
-    }
-    auto onsets = mPD.process(odf, 0, 0.1, false, false);
-    mOnsets = Eigen::VectorXi::Zero(mLength);
-    for(index i = 0; i < onsets.size(); i++){
-      mOnsets(onsets[i].first) = 1;
+    mStats.reset();
+    mStages.begin(source);
+
+    if(mStages.dirty(AnalysisStages::kSpectrum,
+                     {double(windowSize), double(fftSize), double(hopSize)})){
+      GraphStats::ScopedTimer timer(mStats, GraphStats::kSTFT);
+      mSpectrogram = mUtils.arenaSpectrogram(source, mWindowSize, mFFTSize,
+                                             mHopSize);
+      mLength = mSpectrogram.rows();
+    }
+    if(mStages.dirty(AnalysisStages::kFeatures,
+                     {double(numBands), double(sampleRate)})){
+      GraphStats::ScopedTimer timer(mStats, GraphStats::kMel);
+      mMelSpectrogram = mUtils.melSpectrogram(mSpectrogram.view(), numBands,
+                                              sampleRate, windowSize, fftSize);
+    }
+    if(mStages.dirty(AnalysisStages::kDistances,
+                     {double(distance), double(maxJump)})){
+      GraphStats::ScopedTimer timer(mStats, GraphStats::kDistance);
+      if(DistanceBand::useful(maxJump, mLength)){
+        mBand = mUtils.bandDistances(mMelSpectrogram, distance, maxJump);
+        mBand.zeroDiagonal();
+        mDM = MatrixXd();
+      }
+      else{
+        mDM = mUtils.distanceMatrix(mMelSpectrogram, distance);
+        mDM.diagonal().setZero();
+        mBand = DistanceBand();
+      }
     }
+
+    if(mStages.dirty(AnalysisStages::kStructure, {})) findStructure();
     mLoop = RealVector{0, static_cast<double>(mLength)};
-    fit(threshold, quantize);
+    mPos = 0;
+    mPlayback.init(mWindowSize, mFFTSize, mHopSize);
+    mQuantize = quantize;
+    if(mStages.dirty(AnalysisStages::kGraph,
+                     {threshold, double(quantize)}))
+      fitLinks(threshold, quantize);
     output(0)  = mLoop(0);
     output(1)  = mLoop(1);
     output(2)  = mBeat;
@@ -90,84 +102,385 @@ public:
     mInitialized = true;
   }
 
-  void fit(double threshold, bool quantize){
-    index stride = quantize?mBeat:1;
-    algorithm::DataSetIdSequence seq("", 0, 0);
-    mDataSet = DataSet(2);
-    for(index i = 0; i <mLength; i++){
-      for(index j = i + stride; j < mDM.rows(); j+=stride){
-        if(mDM(i,j) < threshold || (quantize && mOnsets(i) > 0)){
-          RealVector tmp{
-            static_cast<double>(i),
-            static_cast<double>(j)
-          };
-          mDataSet.add(seq.next(),tmp);
-        }
+  // brings the analysis up to date after samples [start, start + count) of
+  // source were overwritten, with the settings it was made with: only the
+  // frames over them and their distances to all others are recomputed, then
+  // the beat, onsets and loops, which are found over the whole matrix
+  bool update(const AudioSource& source, index start, index count,
+              std::string& error) {
+    if(!mInitialized || !mStages.valid(AnalysisStages::kStructure)){
+      error = "No analysis to update";
+      return false;
+    }
+    if(mUtils.numFrames(source.size(), mHopSize) != mLength){
+      error = "Source length changed, analyze again";
+      return false;
+    }
+    auto frames = mUtils.framesOver(start, count, mWindowSize, mHopSize,
+                                    mLength);
+    if(frames.second <= 0){
+      error = "No frames in the updated range";
+      return false;
+    }
+    const auto& features = mStages.key(AnalysisStages::kFeatures);
+    const auto& distances = mStages.key(AnalysisStages::kDistances);
+    mStats.reset();
+    {
+      GraphStats::ScopedTimer timer(mStats, GraphStats::kSTFT);
+      mSpectrogram = mUtils.updateSpectrogram(mSpectrogram, source,
+                                              mWindowSize, mFFTSize, mHopSize,
+                                              frames.first, frames.second);
+    }
+    RealMatrix oldFeatures = mMelSpectrogram;
+    {
+      GraphStats::ScopedTimer timer(mStats, GraphStats::kMel);
+      RealMatrix mel = mUtils.melSpectrogram(
+          mSpectrogram.view()(Slice(frames.first, frames.second), Slice(0)),
+          static_cast<index>(features[0]), features[1], mWindowSize,
+          mFFTSize);
+      for(index i = 0; i < frames.second; i++)
+        mMelSpectrogram.row(frames.first + i) = mel.row(i);
+    }
+    {
+      GraphStats::ScopedTimer timer(mStats, GraphStats::kDistance);
+      if(banded()){
+        mUtils.updateBand(mMelSpectrogram, static_cast<index>(distances[0]),
+                          frames.first, frames.second, mBand);
+        mBand.zeroDiagonal();
+      }
+      else{
+        mUtils.updateDistances(oldFeatures, mMelSpectrogram,
+                               static_cast<index>(distances[0]), 1, 0, false,
+                               frames.first, frames.second, mDM);
+        mDM.diagonal().setZero();
       }
     }
-    mTree = KDTree(mDataSet);
-    mNumLinks = mTree.size();
+    findStructure();
+    mStages.updated(source);
+    mLoop = RealVector{0, static_cast<double>(mLength)};
+    mPos = 0;
+    fitLinks(mThreshold, mQuantize);
+    return true;
+  }
+
+  // projected cost of init for a source of numSamples; the loop graph keeps
+  // every link under threshold, so only a coarser hop or a band makes it
+  // smaller
+  static AnalysisEstimate estimate(index numSamples, index windowSize,
+                                   index fftSize, index hopSize,
+                                   index numBands, double threshold,
+                                   index maxJump = 0){
+    AnalysisEstimate e(numSamples, windowSize, fftSize, hopSize, 0);
+    double n = e.frames();
+    double span = e.span(maxJump);
+    e.spectrum();
+    e.features(numBands);
+    e.distances(numBands, 1, 0, maxJump);
+    // onsets; similarity for the beat, copied only when dense
+    e.add(4 * n, e.banded(maxJump) ? 0 : 8 * n * n, n * span);
+    // pairs under threshold, taking distances as spread evenly over [0, 1];
+    // each is a dataset entry plus a tree node, kept only while the
+    // catalogue is built
+    double links = n * (span - 1) / 2 * std::min(threshold, 1.0);
+    double cells = std::min(n, double(LoopCatalogue::kMaxCells));
+    double lookups = cells * cells * LoopCatalogue::kAlternatives;
+    e.add(LoopCatalogue::bytes(e.frames()), links * kBytesPerLink,
+          (links + lookups) * std::log2(std::max(links, 2.0)));
+    return e;
+  }
+
+  // whether maxJump leaves enough lags to look for a beat in, the fewest
+  // that can hold a peak; 0 keeps all distances
+  static bool beatSearchable(index maxJump) {
+    return maxJump <= 0 || maxJump >= index(kMinBeatLags);
   }
 
+  void fit(double threshold, bool quantize){
+    mStages.invalidate(AnalysisStages::kGraph);
+    mThreshold = threshold;
+    mQuantize = quantize;
+    fitLinks(threshold, quantize);
+  }
+
+  // saves the analysis; the spectrogram is recomputed from the source on read
+  bool write(std::ostream& out) const {
+    archive::Writer writer(out, "graphloop");
+    writer.value<std::int64_t>(mWindowSize);
+    writer.value<std::int64_t>(mFFTSize);
+    writer.value<std::int64_t>(mHopSize);
+    writer.value(mThreshold);
+    writer.value<std::uint8_t>(mQuantize);
+    mStages.write(writer);
+    writer.matrix(mMelSpectrogram);
+    if(banded()) writer.band(mBand);
+    else writer.distances(mDM);
+    writer.value<std::int64_t>(mBeat);
+    std::vector<index> onsets;
+    for(index i = 0; i < mOnsets.size(); i++)
+      if(mOnsets(i) > 0) onsets.push_back(i);
+    writer.indices(onsets);
+    return writer.ok();
+  }
+
+  bool read(std::istream& in, const AudioSource& source, std::string& error) {
+    archive::Reader reader(in);
+    if(!reader.open("graphloop", error)) return false;
+    index windowSize = reader.value<std::int64_t>();
+    index fftSize = reader.value<std::int64_t>();
+    index hopSize = reader.value<std::int64_t>();
+    double threshold = reader.value<double>();
+    bool quantize = reader.value<std::uint8_t>() != 0;
+    reader.limitFrames(hopSize > 0 ? mUtils.numFrames(source.size(), hopSize)
+                                   : 0);
+    AnalysisStages stages;
+    stages.read(reader);
+    if(reader.ok() && !stages.matches(source)){
+      error = "Analysis file was made from a different source";
+      return false;
+    }
+    RealMatrix mel = reader.matrix();
+    const auto& distances = stages.key(AnalysisStages::kDistances);
+    index maxJump = distances.size() > 1 ? index(distances[1]) : 0;
+    bool isBanded = DistanceBand::useful(maxJump, mel.rows());
+    MatrixXd dm;
+    DistanceBand band;
+    if(isBanded) band = reader.band();
+    else dm = reader.distances();
+    index beat = reader.value<std::int64_t>();
+    std::vector<index> onsets = reader.indices();
+    if(!reader.ok() || windowSize <= 0 || hopSize <= 0 || fftSize <= 0 ||
+       beat <= 0){
+      error = "Analysis file is truncated or corrupt";
+      return false;
+    }
+    auto spectrogram =
+        mUtils.arenaSpectrogram(source, windowSize, fftSize, hopSize);
+    index length = spectrogram.rows();
+    index rows = isBanded ? band.rows() : dm.rows();
+    if(rows != length || mel.rows() != length){
+      error = "Analysis file does not match the source length";
+      return false;
+    }
+    mWindowSize = windowSize;
+    mFFTSize = fftSize;
+    mHopSize = hopSize;
+    mFrameSize = (mFFTSize / 2) + 1;
+    mThreshold = threshold;
+    mQuantize = quantize;
+    mSpectrogram = spectrogram;
+    mLength = length;
+    mMelSpectrogram = mel;
+    mDM = dm;
+    mBand = band;
+    mBeat = beat;
+    mOnsets = Eigen::VectorXi::Zero(mLength);
+    for(index onset : onsets)
+      if(onset >= 0 && onset < mLength) mOnsets(onset) = 1;
+    mStages = stages;
+    mLoop = RealVector{0, static_cast<double>(mLength)};
+    mPos = 0;
+    mPlayback.init(mWindowSize, mFFTSize, mHopSize);
+    fitLinks(mThreshold, mQuantize);
+    mInitialized = true;
+    return true;
+  }
+
+  // loop of the current cell and rank, looked up in the catalogue
   void findLoop(){
-    RealVector tmpPoint(2);
-    auto query = RealVector { static_cast<double>(mStartFrame), static_cast<double>(mEndFrame)};
-    auto nearest = mTree.kNearest(query, 1);
-    auto nearestIds = nearest.getIds();
-    if(nearestIds.size() > 0){
-      mDataSet.get(nearestIds(0), mLoop);
+    mStats.count(GraphStats::kLoopSearches);
+    auto loop = mCatalogue.find(mCell, mRank);
+    if(loop){
+      mLoop(0) = loop->start;
+      mLoop(1) = loop->end;
     }
+    else mStats.count(GraphStats::kNoNeighbours);
+  }
+
+  // allocates playback at resolutions up to maxFFTSize, off the audio
+  // thread; assignments keep it
+  void preparePlayback(index maxFFTSize) { mPlayback.prepare(maxFFTSize); }
 
+  // playback STFT settings for the following frames; when they differ from
+  // the analysis, frames are cut from source, which has to outlive them
+  void setPlayback(index windowSize, index fftSize, index hopSize,
+                   const AudioSource* source) {
+    mPlayback.setResolution(windowSize, fftSize, hopSize, source);
   }
 
-  void processFrame(ComplexVectorView out, double start, double end, RealVectorView output) {
+  index loopStart() const { return static_cast<index>(mLoop(0)); }
+
+  // playback continues from frame, wrapped into the current loop
+  void moveTo(index frame){
+    index first = static_cast<index>(mLoop(0));
+    index length = std::max(static_cast<index>(mLoop(1)) - first, index(1));
+    mPos = static_cast<int>(frame < mLoop(1) ? frame
+                                             : first + (frame - first) % length);
+  }
+
+  // rank picks among the catalogued alternatives for the start/end cell
+  void processFrame(ComplexVectorView out, double start, double end,
+                    index rank, RealVectorView output) {
     using namespace Eigen;
     using namespace _impl;
+    GraphStats::HopTimer hopTimer(mStats);
     index startFrame = lrint(start * mSpectrogram.rows());
     index endFrame = lrint(end * mSpectrogram.rows());
-    if(startFrame != mStartFrame || endFrame != mEndFrame){
-      mStartFrame = startFrame;
-      mEndFrame = endFrame;
+    index cell = mCatalogue.cellOf(startFrame, endFrame);
+    if(cell != mCell || rank != mRank){
+      mCell = cell;
+      mRank = rank;
       findLoop();
     }
-    out = mSpectrogram.row(mPos);
-    mPos = (mPos + 1) % mSpectrogram.rows();
-    if(mPos >= mLoop(1))mPos = mLoop(0);
+    if(!mPlayback.render(mPos, out)) out = mSpectrogram.row(mPos);
+    for(index hops = mPlayback.advance(); hops > 0; hops--){
+      mPos = (mPos + 1) % mSpectrogram.rows();
+      if(mPos >= mLoop(1))mPos = mLoop(0);
+    }
     output(0)  = mLoop(0);
     output(1)  = mLoop(1);
     output(2)  = mBeat;
     output(3)  = mNumLinks;
   }
 
+  void seed(index) {}
+
+  index numFrames() { return mLength; }
+
   bool initialized(){
     return mInitialized;
   }
 
+  const GraphStats& stats() const { return mStats; }
+
+  // link statistics of the distance matrix at out.cols() thresholds, see
+  // ThresholdSweep
+  void sweep(RealMatrixView out) const {
+    ThresholdSweep sweep;
+    if(banded()) sweep.process(mBand, out);
+    else sweep.process(mDM, out);
+  }
+
   index mWindowSize;
   index mHopSize;
   index mFFTSize;
 
 private:
+  // distances are kept for frames at most maxJump apart only
+  bool banded() const { return mBand.rows() > 0; }
+
+  double distance(index i, index j) const {
+    return banded() ? mBand(i, j) : mDM(i, j);
+  }
+
+  // beat period from the beat spectrum, and onsets, of the distance matrix;
+  // banded, the beat is looked for among the lags within the band
+  void findStructure(){
+    using namespace Eigen;
+    {
+      GraphStats::ScopedTimer timer(mStats, GraphStats::kBeatSpectrum);
+      mBeat = 0;
+      ArrayXd beatSpectrum = ArrayXd::Zero(mLength);
+      index lags = lrint(beatSpectrum.size()/2);
+      if(banded()){
+        lags = std::min(lags, mBand.width());
+        for(index i = 0; i <= lags; i++)
+          beatSpectrum(i) = (1 - mBand.diagonal(i)).sum() / (mLength - i);
+      }
+      else{
+        MatrixXd sim = 1 - mDM.array();
+        for(index i = 0; i < mLength; i++){
+          beatSpectrum(i) = sim.diagonal(i).sum() / (mLength - i);
+        }
+      }
+      PeakDetection pd;
+      auto bsPeaks = pd.process(beatSpectrum.segment(1,lags), 3, 0, false, true);
+      // without a peak among the lags, every frame is a beat
+      mBeat = bsPeaks.empty() ? 1 : bsPeaks[0].first;
+      if(bsPeaks.size() > 1 && bsPeaks[1].first < mBeat)mBeat = bsPeaks[1].first;
+      if(bsPeaks.size() > 2 && bsPeaks[2].first < mBeat)mBeat = bsPeaks[2].first;
+      // quantized links step by the beat
+      mBeat = std::max(mBeat, index(1));
+    }
+    {
+      GraphStats::ScopedTimer timer(mStats, GraphStats::kOnsets);
+      mFilter.init(5);
+      ArrayXd odf = banded() ? mBand.diagonal(1)
+                             : ArrayXd(mDM.diagonal(1).array());
+      for(index i = 0; i < odf.size(); i++){
+        odf(i) = odf(i) - mFilter.processSample(odf(i));
+      }
+      auto onsets = mPD.process(odf, 0, 0.1, false, false);
+      mOnsets = Eigen::VectorXi::Zero(mLength);
+      for(index i = 0; i < onsets.size(); i++){
+        mOnsets(onsets[i].first) = 1;
+      }
+    }
+  }
+
+  void fitLinks(double threshold, bool quantize){
+    GraphStats::ScopedTimer timer(mStats, GraphStats::kFit);
+    index stride = quantize?mBeat:1;
+    algorithm::DataSetIdSequence seq("", 0, 0);
+    DataSet dataSet(2);
+    for(index i = 0; i <mLength; i++){
+      index last = banded() ? mBand.last(i) : mLength;
+      for(index j = i + stride; j < last; j+=stride){
+        if(distance(i,j) < threshold || (quantize && mOnsets(i) > 0)){
+          RealVector tmp{
+            static_cast<double>(i),
+            static_cast<double>(j)
+          };
+          dataSet.add(seq.next(),tmp);
+        }
+      }
+    }
+    // the tree is only searched here; playback uses the catalogue
+    KDTree tree(dataSet);
+    mNumLinks = tree.size();
+    RealVector point(2);
+    mCatalogue.build(mLength,
+        [&](double start, double end, index k,
+            std::vector<LoopCatalogue::Loop>& loops){
+          auto nearest = tree.kNearest(RealVector{start, end}, k);
+          auto nearestIds = nearest.getIds();
+          for(index i = 0; i < nearestIds.size(); i++){
+            dataSet.get(nearestIds(i), point);
+            loops.push_back({static_cast<std::int32_t>(point(0)),
+                             static_cast<std::int32_t>(point(1)), 0});
+          }
+        },
+        [&](index start, index end){
+          return static_cast<float>(1 - distance(start, end));
+        });
+    mCell = -1;
+  }
+
+  static constexpr double kBytesPerLink = 128;
+  static constexpr index kMinBeatLags = 3;
+
   index mFrameSize;
   GraphPlayUtils mUtils;
   RealVector mLoop;
-  ComplexMatrix mSpectrogram;
-  RealMatrix mMagnitude;
+  ArenaMatrix<std::complex<double>> mSpectrogram;
   RealMatrix mMelSpectrogram;
   Eigen::VectorXi mOnsets;
-  KDTree mTree;
   MatrixXd mDM;
-  DataSet mDataSet;
+  DistanceBand mBand;
+  LoopCatalogue mCatalogue;
   bool mInitialized{false};
   int mPos{0};
   index mLength;
   index mBeat;
-  index mStartFrame;
-  index mEndFrame;
+  index mCell{-1};
+  index mRank{0};
   double mThreshold;
+  bool mQuantize{false};
   index mNumLinks;
   MedianFilter mFilter;
   PeakDetection mPD;
+  GraphPlayback mPlayback;
+  AnalysisStages mStages;
+  GraphStats mStats;
 };
 } // namespace algorithm
 } // namespace fluid
@@ -13,18 +13,31 @@ under the European Union’s Horizon 2020 research and innovation programme
 #include "algorithms/public/STFT.hpp"
 #include "algorithms/util/AlgorithmUtils.hpp"
 #include "algorithms/util/FluidEigenMappings.hpp"
+#include "algorithms/AnalysisBudget.hpp"
+#include "algorithms/AnalysisStages.hpp"
+#include "algorithms/GraphPlayback.hpp"
 #include "algorithms/GraphPlayUtils.hpp"
+#include "algorithms/GraphStats.hpp"
+#include "algorithms/GraphWalk.hpp"
+#include "algorithms/SuccessorTable.hpp"
+#include "algorithms/ThresholdSweep.hpp"
 #include "data/TensorTypes.hpp"
 #include "data/FluidDataSet.hpp"
 #include <Eigen/Core>
 #include <Eigen/Dense>
 #include <vector>
 #include <fstream>
+#include <string>
 #include <random>
 
 namespace fluid {
 namespace algorithm {
 
+// With a corpus, a second source, init builds no self-similarity graph:
+// each frame of the source is linked to its nearest frames of the corpus
+// (CrossNeighbours), and the walk plays the source on, jumping into the
+// corpus for minLength frames at a time where it matches. Corpus frames are
+// numbered after the source's in the frames step returns.
 class GraphPlay {
 
 public:
@@ -32,9 +45,12 @@ public:
   using  VectorXd = Eigen::VectorXd;
   using  DataSet = FluidDataSet<std::string, double, 1>;
 
-  void init(RealVectorView audio, index sampleRate,
+  void init(const AudioSource& source, index sampleRate,
             index windowSize, index fftSize, index hopSize, index numBands,
-            index distance, double threshold, RealVectorView output) {
+            index distance, double threshold, index segmentSize,
+            index coarseNeighbours, RealVectorView output,
+            index maxLinks = 0, bool compressedSearch = false,
+            index maxJump = 0, const AudioSource* corpus = nullptr) {
     using namespace Eigen;
     using namespace _impl;
     using namespace std;
@@ -42,78 +58,350 @@ public:
     mFFTSize = fftSize;
     mHopSize = hopSize;
     mFrameSize = (mFFTSize / 2) + 1;
-    mThreshold = threshold;
-    STFT stft = STFT(mWindowSize, mFFTSize, mHopSize);
-    mLength = std::floor((audio.size() + mHopSize) / mHopSize);
-    mSpectrogram = ComplexMatrix(mLength, mFrameSize);
-    stft.process(audio, mSpectrogram);
-    RealMatrix magnitude(mLength, mFrameSize);
-    stft.magnitude(mSpectrogram, magnitude);
-    mDM = mUtils.computeDM(magnitude, numBands, sampleRate, windowSize, fftSize, distance);
-    mDM.diagonal().setZero();
-    mForbidden = ArrayXXd::Ones(mDM.rows(), mDM.cols());
-    mVisited = ArrayXXd::Zero(mDM.rows(), mDM.cols());
-    ArrayXd odf = mDM.diagonal(1).array();
-    mRP = (mDM.array() < threshold).cast<double>();
-    mRP = mRP.array() * mForbidden.array();
-    mInitialized = true;
+    mWalk.threshold = threshold;
+    mSegmentSize = std::max(segmentSize, index(1));
+    mStats.reset();
+    mStages.begin(source);
+    if(mStages.dirty(AnalysisStages::kSpectrum,
+                     {double(windowSize), double(fftSize), double(hopSize)})){
+      GraphStats::ScopedTimer timer(mStats, GraphStats::kSTFT);
+      mSpectrogram = mUtils.arenaSpectrogram(source, mWindowSize, mFFTSize,
+                                             mHopSize);
+      mLength = mSpectrogram.rows();
+    }
+    if(mStages.dirty(AnalysisStages::kFeatures,
+                     {double(numBands), double(sampleRate)})){
+      GraphStats::ScopedTimer timer(mStats, GraphStats::kMel);
+      mMelSpectrogram = mUtils.melSpectrogram(mSpectrogram.view(), numBands,
+                                              sampleRate, windowSize, fftSize);
+    }
+    if(corpus){
+      initCross(*corpus, sampleRate, numBands, distance, maxLinks);
+      mPlayback.init(mWindowSize, mFFTSize, mHopSize);
+      resetPlayback();
+      return;
+    }
+    mCross = CrossNeighbours();
+    mCorpusSpectrogram = ArenaMatrix<std::complex<double>>();
+    mCorpusLength = 0;
+    if(mStages.dirty(AnalysisStages::kDistances,
+                     {double(distance), double(mSegmentSize),
+                      double(coarseNeighbours),
+                      double(compressedSearch), double(maxJump)})){
+      GraphStats::ScopedTimer timer(mStats, GraphStats::kDistance);
+      if(DistanceBand::useful(maxJump, mLength)){
+        mBand = mUtils.bandDistances(mMelSpectrogram, distance, maxJump);
+        mBand.zeroDiagonal();
+        mDM = MatrixXd();
+      }
+      else{
+        mDM = mUtils.distanceMatrix(mMelSpectrogram, distance, mSegmentSize,
+                                    coarseNeighbours, compressedSearch);
+        mDM.diagonal().setZero();
+        mBand = DistanceBand();
+      }
+    }
+    if(mStages.dirty(AnalysisStages::kGraph, {double(maxLinks)})){
+      mMaxLinks = maxLinks;
+      buildGraph();
+    }
+    mPlayback.init(mWindowSize, mFFTSize, mHopSize);
+    resetPlayback();
   }
 
+  // brings the analysis up to date after samples [start, start + count) of
+  // source were overwritten, with the settings it was made with: only the
+  // frames over them and their distances to all others are recomputed, then
+  // the links
+  bool update(const AudioSource& source, index start, index count,
+              std::string& error) {
+    if(!mInitialized ||
+       (!cross() && !mStages.valid(AnalysisStages::kDistances))){
+      error = "No analysis to update";
+      return false;
+    }
+    if(mUtils.numFrames(source.size(), mHopSize) != mLength){
+      error = "Source length changed, analyze again";
+      return false;
+    }
+    auto frames = mUtils.framesOver(start, count, mWindowSize, mHopSize,
+                                    mLength);
+    if(frames.second <= 0){
+      error = "No frames in the updated range";
+      return false;
+    }
+    const auto& features = mStages.key(AnalysisStages::kFeatures);
+    const auto& distances = mStages.key(AnalysisStages::kDistances);
+    mStats.reset();
+    {
+      GraphStats::ScopedTimer timer(mStats, GraphStats::kSTFT);
+      mSpectrogram = mUtils.updateSpectrogram(mSpectrogram, source,
+                                              mWindowSize, mFFTSize, mHopSize,
+                                              frames.first, frames.second);
+    }
+    RealMatrix oldFeatures = mMelSpectrogram;
+    {
+      GraphStats::ScopedTimer timer(mStats, GraphStats::kMel);
+      RealMatrix mel = mUtils.melSpectrogram(
+          mSpectrogram.view()(Slice(frames.first, frames.second), Slice(0)),
+          static_cast<index>(features[0]), features[1], mWindowSize,
+          mFFTSize);
+      for(index i = 0; i < frames.second; i++)
+        mMelSpectrogram.row(frames.first + i) = mel.row(i);
+    }
+    {
+      GraphStats::ScopedTimer timer(mStats, GraphStats::kDistance);
+      if(cross())
+        mUtils.updateCross(mMelSpectrogram, frames.first, frames.second,
+                           mCross);
+      else if(banded()){
+        mUtils.updateBand(mMelSpectrogram, static_cast<index>(distances[0]),
+                          frames.first, frames.second, mBand);
+        mBand.zeroDiagonal();
+      }
+      else{
+        mUtils.updateDistances(oldFeatures, mMelSpectrogram,
+                               static_cast<index>(distances[0]), mSegmentSize,
+                               static_cast<index>(distances[2]),
+                               distances.size() > 3 && distances[3] != 0,
+                               frames.first, frames.second,
+                               mDM);
+        mDM.diagonal().setZero();
+      }
+    }
+    mStages.updated(source);
+    buildGraph();
+    resetPlayback();
+    return true;
+  }
 
-  void processFrame(ComplexVectorView out, double start, double threshold,
-    index minLength, index minDist, index forget, RealVectorView output) {
+  // projected cost of init for a source of numSamples
+  static AnalysisEstimate estimate(index numSamples, index windowSize,
+                                   index fftSize, index hopSize,
+                                   index numBands, index segmentSize,
+                                   index coarseNeighbours, index maxLinks,
+                                   index maxJump = 0,
+                                   index corpusSamples = 0) {
+    AnalysisEstimate e(numSamples, windowSize, fftSize, hopSize, maxLinks);
+    double n = e.frames();
+    double span = e.span(maxJump);
+    e.spectrum();
+    e.features(numBands);
+    if(corpusSamples > 0){
+      index links = CrossNeighbours::neighbours(maxLinks);
+      e.cross(corpusSamples, numBands, links,
+              links * CrossNeighbours::kOversample);
+      e.add(8 * n, 0, 0); // candidates
+      return e;
+    }
+    e.distances(numBands, segmentSize, coarseNeighbours, maxJump);
+    e.links(n * e.rowLinks(span - 1), 12);
+    e.add(16 * n, 0, 2 * n); // successor tree
+    e.add(n * span / 8 + 8 * n, 0, 0); // visited links, candidates
+    return e;
+  }
+
+  // saves the analysis; the spectrogram is recomputed from the source on read.
+  // Analyses with a corpus are not saved.
+  bool write(std::ostream& out) const {
+    if(cross()) return false;
+    archive::Writer writer(out, "graphplay");
+    writer.value<std::int64_t>(mWindowSize);
+    writer.value<std::int64_t>(mFFTSize);
+    writer.value<std::int64_t>(mHopSize);
+    writer.value<std::int64_t>(mSegmentSize);
+    mStages.write(writer);
+    writer.matrix(mMelSpectrogram);
+    if(banded()) writer.band(mBand);
+    else writer.distances(mDM);
+    return writer.ok();
+  }
+
+  bool read(std::istream& in, const AudioSource& source, std::string& error) {
     using namespace Eigen;
-    using namespace _impl;
-    using namespace std;
-    if(mThreshold != threshold){
-      mRP =  (mDM.array() < threshold).cast<double>();
-      mRP = mRP.array() * mForbidden.array();
-      mThreshold = threshold;
+    archive::Reader reader(in);
+    if (!reader.open("graphplay", error)) return false;
+    index windowSize = reader.value<std::int64_t>();
+    index fftSize = reader.value<std::int64_t>();
+    index hopSize = reader.value<std::int64_t>();
+    index segmentSize = reader.value<std::int64_t>();
+    reader.limitFrames(hopSize > 0 ? mUtils.numFrames(source.size(), hopSize)
+                                   : 0);
+    AnalysisStages stages;
+    stages.read(reader);
+    if (reader.ok() && !stages.matches(source)) {
+      error = "Analysis file was made from a different source";
+      return false;
+    }
+    RealMatrix   mel = reader.matrix();
+    const auto&  distances = stages.key(AnalysisStages::kDistances);
+    index        maxJump = distances.size() > 4 ? index(distances[4]) : 0;
+    bool         isBanded = DistanceBand::useful(maxJump, mel.rows());
+    MatrixXd     dm;
+    DistanceBand band;
+    if (isBanded) band = reader.band();
+    else dm = reader.distances();
+    if (!reader.ok() || windowSize <= 0 || hopSize <= 0 || fftSize <= 0) {
+      error = "Analysis file is truncated or corrupt";
+      return false;
+    }
+    auto spectrogram =
+        mUtils.arenaSpectrogram(source, windowSize, fftSize, hopSize);
+    index rows = isBanded ? band.rows() : dm.rows();
+    if (rows != spectrogram.rows() || mel.rows() != spectrogram.rows()) {
+      error = "Analysis file does not match the source length";
+      return false;
+    }
+    mWindowSize = windowSize;
+    mFFTSize = fftSize;
+    mHopSize = hopSize;
+    mFrameSize = (mFFTSize / 2) + 1;
+    mSegmentSize = std::max(segmentSize, index(1));
+    mSpectrogram = spectrogram;
+    mLength = mSpectrogram.rows();
+    mMelSpectrogram = mel;
+    mDM = dm;
+    mBand = band;
+    mCross = CrossNeighbours();
+    mCorpusSpectrogram = ArenaMatrix<std::complex<double>>();
+    mCorpusLength = 0;
+    mStages = stages;
+    const auto& graphKey = mStages.key(AnalysisStages::kGraph);
+    mMaxLinks = graphKey.empty() ? 0 : static_cast<index>(graphKey[0]);
+    buildGraph();
+    mPlayback.init(mWindowSize, mFFTSize, mHopSize);
+    resetPlayback();
+    return true;
+  }
+
+
+  // allocates playback at resolutions up to maxFFTSize, off the audio
+  // thread; assignments keep it
+  void preparePlayback(index maxFFTSize) { mPlayback.prepare(maxFFTSize); }
+
+  // playback STFT settings for the following frames; when they differ from
+  // the analysis, frames are cut from source and corpus, which have to
+  // outlive them
+  void setPlayback(index windowSize, index fftSize, index hopSize,
+                   const AudioSource* source,
+                   const AudioSource* corpus = nullptr) {
+    mPlayback.setResolution(windowSize, fftSize, hopSize, source, corpus);
+  }
+
+  // walk steps due for the next playback frame: 1 at the analysis
+  // resolution, otherwise as many analysis hops as the playback hop covers
+  index hopsDue() { return mPlayback.advance(); }
+
+  template <typename Policy = UniformPolicy>
+  void processFrame(ComplexVectorView out, double start, double threshold,
+    index minLength, index minDist, index forget, double randomness,
+    double temperature, bool segmentJumps, RealVectorView output) {
+    GraphStats::HopTimer hopTimer(mStats);
+    for(index hops = hopsDue(); hops > 0; hops--)
+      step<Policy>(start, threshold, minLength, minDist, forget, randomness,
+                   temperature, segmentJumps);
+    render(out, current(), output);
+  }
+
+  // plays a frame chosen by step on a planner thread; frame < 0 when the
+  // planner fell behind, and playback carries on from the last frame
+  void playFrame(ComplexVectorView out, index frame, RealVectorView output) {
+    GraphStats::HopTimer hopTimer(mStats);
+    if(frame < 0){
+      mStats.count(GraphStats::kPlannerUnderruns);
+      frame = following(mPlayed);
     }
-    mVisited = (mVisited.array() - 1).cwiseMax(0);
+    render(out, frame, output);
+  }
+
+  // the frame played last
+  index playing() const { return mPlayed; }
+
+  // advances the walk by one hop and returns the frame to play
+  template <typename Policy = UniformPolicy>
+  index step(double start, double threshold, index minLength, index minDist,
+             index forget, double randomness, double temperature,
+             bool segmentJumps) {
+    using namespace std;
+    mWalk.threshold = threshold;
+    mWalk.visited.advance();
     index startFrame = lrint(start * (mSpectrogram.rows() - 1));
-    if(startFrame != mStartFrame ){
-      mStartFrame = startFrame;
-      mPos = mStartFrame;
-      index nNeighbors = mRP.col(mPos).sum();
-      while(nNeighbors == 0){
-        nNeighbors = mRP.col(mPos).sum();
-        mPos = (mPos + 1) % mSpectrogram.rows();
-      }
-      mCount = 0;
+    if(cross())
+      return crossStep<Policy>(startFrame, minLength, forget, randomness,
+                               temperature);
+    if(startFrame != mWalk.startFrame ){
+      mStats.count(GraphStats::kSeeks);
+      mWalk.startFrame = startFrame;
+      // from the first frame on with somewhere to jump to, if any
+      index linked = mSuccessors.nextLinked(mWalk.startFrame, mWalk.threshold);
+      if(linked != mWalk.startFrame) mStats.count(GraphStats::kNoNeighbours);
+      mWalk.pos = linked >= 0 ? linked : mWalk.startFrame;
+      mWalk.count = 0;
     }
-    else if (mCount < minLength){
-      mPos = (mPos + 1) % mSpectrogram.rows();
-      mCount++;
+    else if (mWalk.count < minLength ||
+             (segmentJumps && (mWalk.pos + 1) % mSegmentSize != 0)){
+      mWalk.pos = (mWalk.pos + 1) % mSpectrogram.rows();
+      mWalk.count++;
     }
     else{
-        index nNeighbors = mRP.col(mPos).sum();
-        index nForbidden = mForbidden.col(mPos).sum();
-        index prevPos = mPos;
-        if(nNeighbors > 0){
-          std::vector<index> candidates(nNeighbors);
-          index nCandidates = 0;
-          for(index i = 0; i < mRP.rows(); i++)
-            if(abs(i - mPos) > minDist && mRP(mPos, i) > 0 && mVisited(mPos, i) <= 0){
-              candidates[nCandidates++] = i;
-            }
-            index next = mUtils.randInt(nCandidates);
-            mPos = candidates[next];
-            mCount = 0;
+        index prevPos = mWalk.pos;
+        WalkContext context = mWalk.context(mTable, mWalk.pos, minDist,
+                                            randomness, temperature);
+        index selected = Policy::select(context);
+        if(selected >= 0){
+          mWalk.pos = segmentJumps ? selected - selected % mSegmentSize : selected;
+          mWalk.count = 0;
+          mStats.count(GraphStats::kJumps);
         }
-        if (mPos == prevPos){
-          mPos = (mPos + 1) % mSpectrogram.rows();
+        else{
+          mStats.count(GraphStats::kNoNeighbours);
+          mWalk.pos = (mWalk.pos + 1) % mSpectrogram.rows();
         }
-        mVisited(prevPos, mPos) = forget;
+        mWalk.visited.mark(prevPos, mWalk.pos, forget);
     }
-    out = mSpectrogram.row(mPos);
-    output(0)  = mPos;
+    return mWalk.pos;
+  }
+
+  // the walk continues from frame at the next step; from a corpus frame,
+  // the source carries on where it was
+  void moveTo(index frame) {
+    if(cross() && frame >= mLength) mWalk.corpusPos = frame - mLength;
+    else{
+      mWalk.pos = frame;
+      mWalk.corpusPos = -1;
+    }
+  }
+
+  // nearest frame linked from frame, -1 without links under threshold or
+  // with a corpus, whose links lead out of the source
+  index nearest(index frame, double threshold) const {
+    if(cross()) return -1;
+    return mTable.degree(frame, threshold) > 0 ? mTable.neighbour(frame, 0)
+                                               : -1;
   }
 
+  void seed(index seed) { mWalk.utils.seed(seed); }
+
+  index numFrames() { return mLength; }
+
   bool initialized(){
     return mInitialized;
   }
 
+  // whether the analysis links the source to a corpus instead of itself
+  bool cross() const { return mCorpusLength > 0; }
+
+  const GraphStats& stats() const { return mStats; }
+
+  // link statistics of the distance matrix at out.cols() thresholds, see
+  // ThresholdSweep; there is none with a corpus
+  void sweep(RealMatrixView out) const {
+    if(cross()) return;
+    ThresholdSweep sweep;
+    if(banded()) sweep.process(mBand, out);
+    else sweep.process(mDM, out);
+  }
+
   index num{0};
 
   index mWindowSize;
@@ -121,21 +409,140 @@ public:
   index mFFTSize;
 
 private:
+  // distances are kept for frames at most maxJump apart only
+  bool banded() const { return mBand.rows() > 0; }
+
+  // the source's frames and their nearest corpus frames; the source's own
+  // distances and graph are not computed, and the stages after the features
+  // are done again by the next analysis without a corpus
+  void initCross(const AudioSource& corpus, index sampleRate,
+                 index numBands, index distance, index maxLinks) {
+    {
+      GraphStats::ScopedTimer timer(mStats, GraphStats::kSTFT);
+      mCorpusSpectrogram = mUtils.arenaSpectrogram(corpus, mWindowSize,
+                                                   mFFTSize, mHopSize);
+      mCorpusLength = mCorpusSpectrogram.rows();
+    }
+    RealMatrix corpusMel;
+    {
+      GraphStats::ScopedTimer timer(mStats, GraphStats::kMel);
+      corpusMel = mUtils.melSpectrogram(mCorpusSpectrogram.view(), numBands,
+                                        sampleRate, mWindowSize, mFFTSize);
+    }
+    {
+      GraphStats::ScopedTimer timer(mStats, GraphStats::kDistance);
+      mCross = mUtils.crossNeighbours(mMelSpectrogram, corpusMel, distance,
+                                      CrossNeighbours::neighbours(maxLinks));
+    }
+    mStages.invalidate(AnalysisStages::kDistances);
+    mStages.invalidate(AnalysisStages::kGraph);
+    mDM = MatrixXd();
+    mBand = DistanceBand();
+    mMaxLinks = maxLinks;
+    buildGraph();
+  }
+
+  // the source plays on; after minLength frames, the walk jumps to a corpus
+  // frame linked from the source frame, or stays in the source without
+  // one, and plays on from there for minLength frames
+  template <typename Policy>
+  index crossStep(index startFrame, index minLength, index forget,
+                  double randomness, double temperature) {
+    if(startFrame != mWalk.startFrame){
+      mStats.count(GraphStats::kSeeks);
+      mWalk.startFrame = startFrame;
+      mWalk.pos = startFrame;
+      mWalk.corpusPos = -1;
+      mWalk.count = 0;
+      return current();
+    }
+    mWalk.pos = (mWalk.pos + 1) % mLength;
+    if(mWalk.count < minLength){
+      if(mWalk.corpusPos >= 0)
+        mWalk.corpusPos = (mWalk.corpusPos + 1) % mCorpusLength;
+      mWalk.count++;
+      return current();
+    }
+    // corpus frames are never close in time to the source frame
+    WalkContext context = mWalk.context(mTable, mWalk.pos, -1, randomness,
+                                        temperature);
+    mWalk.corpusPos = Policy::select(context);
+    mWalk.count = 0;
+    if(mWalk.corpusPos >= 0){
+      mStats.count(GraphStats::kJumps);
+      mWalk.visited.mark(mWalk.pos, mWalk.corpusPos, forget);
+    }
+    else mStats.count(GraphStats::kNoNeighbours);
+    return current();
+  }
+
+  // the frame the walk is at, corpus frames after the source's
+  index current() const {
+    return mWalk.corpusPos >= 0 ? mLength + mWalk.corpusPos : mWalk.pos;
+  }
+
+  // the frame after frame in its own source
+  index following(index frame) const {
+    if(frame >= mLength)
+      return mLength + (frame - mLength + 1) % mCorpusLength;
+    return (frame + 1) % mLength;
+  }
+
+  void buildGraph() {
+    if(cross()){
+      mTable.init(mCross);
+      return;
+    }
+    // every link may be followed
+    auto any = [](index, index){ return 1; };
+    if(banded()) mTable.init(mBand, any, mMaxLinks);
+    else mTable.init(mDM, any, mMaxLinks);
+    mSuccessors.init(mTable);
+  }
+
+  void render(ComplexVectorView out, index frame, RealVectorView output) {
+    index corpusFrame = frame - mLength;
+    if(corpusFrame >= 0){
+      if(!mPlayback.render(corpusFrame, out, true))
+        out = mCorpusSpectrogram.row(corpusFrame);
+    }
+    else if(!mPlayback.render(frame, out)) out = mSpectrogram.row(frame);
+    output(0)  = frame;
+    mPlayed = frame;
+  }
+
+  void resetPlayback() {
+    if(cross()) mWalk.visited.initSparse(mLength);
+    else mWalk.visited.init(mLength, mBand.width());
+    mWalk.restart();
+    mPlayed = 0;
+    mWalk.candidates.resize(std::max(mLength, mCross.size()));
+    mInitialized = true;
+  }
+
   GraphPlayUtils mUtils;
   index mFrameSize;
-  ComplexMatrix mSpectrogram;
+  ArenaMatrix<std::complex<double>> mSpectrogram;
+  ArenaMatrix<std::complex<double>> mCorpusSpectrogram;
+  RealMatrix mMelSpectrogram;
   MatrixXd mDM;
-  MatrixXd mRP;
-  MatrixXd mForbidden;
-  MatrixXd mVisited;
+  DistanceBand mBand;
+  CrossNeighbours mCross;
   VectorXd mDeg;
   bool mInitialized{false};
-  int mPos{0};
   index mLength;
-  index mStartFrame{-1};
+  index mCorpusLength{0};
   index mEndFrame;
-  double mThreshold;
-  index mCount{0};
+  index mSegmentSize{1};
+  index mMaxLinks{0};
+  TransitionTable mTable;
+  SuccessorTable mSuccessors;
+  // step and moveTo own the walk, playFrame and hopsDue the playback
+  WalkState mWalk;
+  GraphPlayback mPlayback;
+  index mPlayed{0};
+  AnalysisStages mStages;
+  GraphStats mStats;
 };
 } // namespace algorithm
 } // namespace fluid
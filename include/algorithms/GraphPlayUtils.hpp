@@ -1,11 +1,18 @@
 #pragma once
 
+#include "algorithms/AudioSource.hpp"
+#include "algorithms/BitMatrix.hpp"
+#include "algorithms/CrossNeighbours.hpp"
+#include "algorithms/DistanceBand.hpp"
+#include "algorithms/ModelArena.hpp"
+#include "algorithms/QuantizedFeatures.hpp"
 #include "algorithms/util/PeakDetection.hpp"
 #include "algorithms/public/DataSetIdSequence.hpp"
 #include "algorithms/util/DistanceFuncs.hpp"
 #include "algorithms/public/KDTree.hpp"
 #include "algorithms/public/KMeans.hpp"
 #include "algorithms/public/MelBands.hpp"
+#include "algorithms/public/STFT.hpp"
 #include "algorithms/util/AlgorithmUtils.hpp"
 #include "algorithms/util/FluidEigenMappings.hpp"
 #include "algorithms/util/MedianFilter.hpp"
@@ -14,6 +21,10 @@
 #include "data/FluidDataSet.hpp"
 #include <Eigen/Core>
 #include <Eigen/Dense>
+#include <Eigen/Sparse>
+#include <algorithm>
+#include <numeric>
+#include <utility>
 #include <vector>
 #include <fstream>
 #include <random>
@@ -27,6 +38,8 @@ public:
   using  MatrixXd = Eigen::MatrixXd;
   using  VectorXd = Eigen::VectorXd;
   using DataSet = FluidDataSet<std::string, double, 1>;
+  // segments lo <= hi
+  using SegmentPair = std::pair<index, index>;
 
   GraphPlayUtils(){
     using namespace std;
@@ -36,6 +49,11 @@ public:
     mFilter.init(5);
   }
 
+  void seed(index seed){
+    if(seed < 0) mGen.seed(std::random_device()());
+    else mGen.seed(static_cast<std::mt19937::result_type>(seed));
+  }
+
   index randInt(index N){
     return static_cast<index>(mDis(mGen) * N);
   }
@@ -44,35 +62,377 @@ public:
     return mDis(mGen);
   }
 
-  Eigen::ArrayXXd computeDM(RealMatrixView mag, index numBands,
-    double sampleRate, index windowSize, index fftSize, index dist){
-    using namespace Eigen;
-    using namespace _impl;
+  static index numFrames(index numSamples, index hopSize){
+    return (numSamples + hopSize) / hopSize;
+  }
+
+  // STFT of the source read in chunks of kChunkFrames hops, with the same
+  // framing as STFT::process (frames centred on multiples of hopSize)
+  ComplexMatrix spectrogram(const AudioSource& source, index windowSize,
+    index fftSize, index hopSize){
+    ComplexMatrix spec(numFrames(source.size(), hopSize), fftSize / 2 + 1);
+    spectrogram(source, windowSize, fftSize, hopSize, spec);
+    return spec;
+  }
+
+  // the same into spec, of fftSize / 2 + 1 columns, whose rows are the
+  // frames from firstFrame on
+  void spectrogram(const AudioSource& source, index windowSize,
+    index fftSize, index hopSize, ComplexMatrixView spec,
+    index firstFrame = 0){
+    STFT stft(windowSize, fftSize, hopSize);
+    index nFrames = spec.rows();
+    RealVector chunk((kChunkFrames - 1) * hopSize + windowSize);
+    for(index first = 0; first < nFrames; first += kChunkFrames){
+      index n = std::min(index(kChunkFrames), nFrames - first);
+      index length = (n - 1) * hopSize + windowSize;
+      source.read((firstFrame + first) * hopSize - windowSize / 2,
+                  chunk(Slice(0, length)));
+      for(index k = 0; k < n; k++)
+        stft.processFrame(chunk(Slice(k * hopSize, windowSize)),
+                          spec.row(first + k));
+    }
+  }
+
+  // the spectrogram in a new arena, with extraBytes left in it for other
+  // arrays of the model
+  ArenaMatrix<std::complex<double>> arenaSpectrogram(const AudioSource& source,
+    index windowSize, index fftSize, index hopSize, index extraBytes = 0){
+    index rows = numFrames(source.size(), hopSize);
+    index cols = fftSize / 2 + 1;
+    auto arena = std::make_shared<ModelArena>(
+        ArenaMatrix<std::complex<double>>::bytes(rows, cols) + extraBytes);
+    ArenaMatrix<std::complex<double>> spec(arena, rows, cols);
+    spectrogram(source, windowSize, fftSize, hopSize, spec.view());
+    return spec;
+  }
+
+  // frames of numFrames whose windows overlap samples [start, start + count),
+  // as the first and the number of them
+  static std::pair<index, index> framesOver(index start, index count,
+    index windowSize, index hopSize, index numFrames){
+    // frame f reads samples [f * hopSize - windowSize / 2, ...+ windowSize)
+    index from = start + windowSize / 2 - windowSize + 1;
+    index first = from > 0 ? (from + hopSize - 1) / hopSize : 0;
+    index last = std::min((start + count + windowSize / 2 - 1) / hopSize,
+                          numFrames - 1);
+    return {first, std::max(last - first + 1, index(0))};
+  }
+
+  // a copy of spec in a new arena, with extraBytes left in it, where frames
+  // [first, first + count) are recomputed from source; copies of the model
+  // made before keep reading the old arena
+  ArenaMatrix<std::complex<double>> updateSpectrogram(
+    const ArenaMatrix<std::complex<double>>& spec, const AudioSource& source,
+    index windowSize, index fftSize, index hopSize, index first, index count,
+    index extraBytes = 0){
+    auto arena = std::make_shared<ModelArena>(
+        ArenaMatrix<std::complex<double>>::bytes(spec.rows(), spec.cols()) +
+        extraBytes);
+    ArenaMatrix<std::complex<double>> updated(arena, spec.rows(), spec.cols());
+    for(index i = 0; i < spec.rows(); i++)
+      if(i < first || i >= first + count) updated.row(i) = spec.row(i);
+    spectrogram(source, windowSize, fftSize, hopSize,
+                updated.view()(Slice(first, count), Slice(0)), first);
+    return updated;
+  }
+
+  // mel bands straight from the complex spectrogram, one frame at a time
+  RealMatrix melSpectrogram(ComplexMatrixView spec, index numBands,
+    double sampleRate, index windowSize, index fftSize){
+    MelBands melBands = MelBands(numBands, fftSize);
+    melBands.init(20, 5000, numBands, spec.cols(), sampleRate, windowSize);
+    RealMatrix melSpec = RealMatrix(spec.rows(), numBands);
+    RealVector mag(spec.cols());
+    for(index i = 0; i < spec.rows(); i++){
+      for(index j = 0; j < spec.cols(); j++) mag(j) = std::abs(spec(i, j));
+      melBands.processFrame(mag, melSpec.row(i), true, false, false);
+    }
+    return melSpec;
+  }
+
+  RealMatrix melSpectrogram(RealMatrixView mag, index numBands,
+    double sampleRate, index windowSize, index fftSize){
     MelBands melBands = MelBands(numBands, fftSize);
     melBands.init(20, 5000, numBands, mag.cols(), sampleRate, windowSize);
     RealMatrix melSpec = RealMatrix(mag.rows(), numBands);
     for(index i = 0; i < mag.rows(); i++){
       melBands.processFrame(mag.row(i), melSpec.row(i), true, false, false);
     }
-    MatrixXd tmp = asEigen<Matrix>(melSpec);
+    return melSpec;
+  }
+
+  Eigen::ArrayXXd distanceMatrix(RealMatrixView features, index dist){
+    using namespace Eigen;
+    using namespace _impl;
+    MatrixXd tmp = asEigen<Matrix>(features);
     return DistanceMatrix(tmp, dist);
   }
 
-  void onsetDetection(Eigen::Ref<Eigen::ArrayXd> odf,
-                      Eigen::Ref<Eigen::ArrayXXd> transitions, index offset = 2){
+  // Mean of the features over consecutive segments of segmentSize frames
+  Eigen::MatrixXd poolSegments(const Eigen::MatrixXd& features,
+    index segmentSize){
+    index numSegments = (features.rows() + segmentSize - 1) / segmentSize;
+    Eigen::MatrixXd pooled(numSegments, features.cols());
+    for(index s = 0; s < numSegments; s++){
+      index start = s * segmentSize;
+      index size = std::min(segmentSize, features.rows() - start);
+      pooled.row(s) = features.middleRows(start, size).colwise().mean();
+    }
+    return pooled;
+  }
+
+  // Coarse-to-fine distance matrix: segments of segmentSize frames are
+  // compared on their pooled features first, and frame distances are only
+  // computed between each segment, its temporal neighbours and its
+  // numNeighbours closest segments. Pairs that are never refined get
+  // distance 1, so they are never linked. segmentSize <= 1 is the full
+  // resolution matrix. With compressed, the closest segments are searched
+  // on byte codes of the pooled features instead of a full segment distance
+  // matrix, and kOversample times as many candidates are re-ranked exactly.
+  Eigen::ArrayXXd distanceMatrix(RealMatrixView features, index dist,
+    index segmentSize, index numNeighbours, bool compressed = false){
+    using namespace Eigen;
+    using namespace _impl;
+    if(segmentSize <= 1) return distanceMatrix(features, dist);
+    MatrixXd frames = asEigen<Matrix>(features);
+    index nFrames = frames.rows();
+    ArrayXXd dm = ArrayXXd::Ones(nFrames, nFrames);
+    for(auto& pair : refinedSegments(poolSegments(frames, segmentSize), dist,
+                                     numNeighbours, compressed))
+      refineSegments(frames, dist, segmentSize, pair.first, pair.second, dm);
+    return dm;
+  }
+
+  // Brings rows and columns [first, first + count) of dm, a matrix made by
+  // distanceMatrix from oldFeatures, up to date with features, which differ
+  // from them in those frames only. At full resolution that is count rows
+  // of distances. Otherwise the closest segments are searched again on the
+  // old and the new pooled features, and only the segment pairs that are
+  // refined now but were not, or that hold a changed frame, are computed;
+  // pairs no longer refined go back to 1.
+  void updateDistances(RealMatrixView oldFeatures, RealMatrixView features,
+    index dist, index segmentSize, index numNeighbours, bool compressed,
+    index first, index count, Eigen::MatrixXd& dm){
+    using namespace Eigen;
+    using namespace _impl;
+    if(count <= 0) return;
+    MatrixXd frames = asEigen<Matrix>(features);
+    index nFrames = frames.rows();
+    if(segmentSize <= 1){
+      // against blocks of the other frames as large as the changed span
+      index block = std::max(count, index(kChunkFrames));
+      for(index start = 0; start < nFrames; start += block)
+        refineBlock(frames, dist, first, count, start,
+                    std::min(block, nFrames - start), dm);
+      return;
+    }
+    MatrixXd oldFrames = asEigen<Matrix>(oldFeatures);
+    std::vector<SegmentPair> was = refinedSegments(
+      poolSegments(oldFrames, segmentSize), dist, numNeighbours, compressed);
+    std::vector<SegmentPair> is = refinedSegments(
+      poolSegments(frames, segmentSize), dist, numNeighbours, compressed);
+    index firstSegment = first / segmentSize;
+    index lastSegment = (first + count - 1) / segmentSize;
+    auto changed = [&](index s){
+      return s >= firstSegment && s <= lastSegment;
+    };
+    auto in = [](const std::vector<SegmentPair>& pairs, const SegmentPair& p){
+      return std::binary_search(pairs.begin(), pairs.end(), p);
+    };
+    for(auto& pair : is)
+      if(changed(pair.first) || changed(pair.second) || !in(was, pair))
+        refineSegments(frames, dist, segmentSize, pair.first, pair.second,
+                       dm);
+    for(auto& pair : was)
+      if(!in(is, pair)){
+        index loStart = pair.first * segmentSize;
+        index hiStart = pair.second * segmentSize;
+        index loSize = std::min(segmentSize, nFrames - loStart);
+        index hiSize = std::min(segmentSize, nFrames - hiStart);
+        dm.block(loStart, hiStart, loSize, hiSize).setOnes();
+        dm.block(hiStart, loStart, hiSize, loSize).setOnes();
+      }
+  }
+
+  // distances between frames at most width apart
+  DistanceBand bandDistances(RealMatrixView features, index dist,
+    index width){
+    using namespace Eigen;
+    using namespace _impl;
+    MatrixXd frames = asEigen<Matrix>(features);
+    DistanceBand band(frames.rows(), width);
+    fillBand(frames, dist, 0, frames.rows(), band);
+    return band;
+  }
+
+  // rows and columns [first, first + count) of band brought up to date with
+  // features, which changed in those frames only
+  void updateBand(RealMatrixView features, index dist, index first,
+    index count, DistanceBand& band){
+    using namespace Eigen;
+    using namespace _impl;
+    MatrixXd frames = asEigen<Matrix>(features);
+    fillBand(frames, dist, first, count, band);
+  }
+
+  // the k nearest corpus frames to each target frame, from a tree over the
+  // corpus instead of target x corpus distances
+  CrossNeighbours crossNeighbours(RealMatrixView target,
+    RealMatrixView corpus, index dist, index k){
+    using namespace Eigen;
+    using namespace _impl;
+    CrossNeighbours cross;
+    cross.init(asEigen<Matrix>(target), asEigen<Matrix>(corpus), dist, k);
+    return cross;
+  }
+
+  // target frames [first, first + count) of cross looked up again in the
+  // corpus after they changed
+  void updateCross(RealMatrixView target, index first, index count,
+    CrossNeighbours& cross){
+    using namespace Eigen;
+    using namespace _impl;
+    cross.update(asEigen<Matrix>(target), first, count);
+  }
+
+  // the pairs of segments lo <= hi whose frame distances the coarse-to-fine
+  // matrix computes, sorted: about numNeighbours + 3 per segment instead of
+  // a flag for every pair
+  std::vector<SegmentPair> refinedSegments(const Eigen::MatrixXd& pooled,
+    index dist, index numNeighbours, bool compressed){
+    using namespace Eigen;
+    using namespace _impl;
+    index numSegments = pooled.rows();
+    ArrayXXd coarse;
+    QuantizedFeatures codes;
+    if(compressed) codes.init(pooled);
+    else coarse = DistanceMatrix(pooled, dist);
+    std::vector<SegmentPair> refined;
+    refined.reserve(asUnsigned(
+        numSegments * (std::min(numNeighbours, numSegments) + 3)));
+    std::vector<index> order(numSegments);
+    for(index a = 0; a < numSegments; a++){
+      index k = std::min(numNeighbours, numSegments);
+      if(compressed) nearestSegments(codes, pooled, a, k, dist, order);
+      else{
+        std::iota(order.begin(), order.end(), 0);
+        std::partial_sort(order.begin(), order.begin() + k, order.end(),
+          [&](index x, index y){ return coarse(a, x) < coarse(a, y); });
+        order.resize(k);
+      }
+      if(a > 0) order.push_back(a - 1);
+      order.push_back(a);
+      if(a + 1 < numSegments) order.push_back(a + 1);
+      for(index b : order)
+        refined.emplace_back(std::min(a, b), std::max(a, b));
+      order.resize(numSegments);
+    }
+    std::sort(refined.begin(), refined.end());
+    refined.erase(std::unique(refined.begin(), refined.end()), refined.end());
+    return refined;
+  }
+
+  // frame distances between segments lo and hi, into dm both ways
+  template <typename Distances>
+  void refineSegments(const Eigen::MatrixXd& frames, index dist,
+    index segmentSize, index lo, index hi, Distances& dm){
+    index loStart = lo * segmentSize, hiStart = hi * segmentSize;
+    refineBlock(frames, dist, loStart,
+                std::min(segmentSize, frames.rows() - loStart), hiStart,
+                std::min(segmentSize, frames.rows() - hiStart), dm);
+  }
+
+  // distances between frames [a, a + aSize) and [b, b + bSize), into dm
+  // both ways
+  template <typename Distances>
+  void refineBlock(const Eigen::MatrixXd& frames, index dist, index a,
+    index aSize, index b, index bSize, Distances& dm){
+    using namespace Eigen;
+    if(a == b && aSize == bSize){
+      MatrixXd segment = frames.middleRows(a, aSize);
+      ArrayXXd block = DistanceMatrix(segment, dist);
+      dm.block(a, a, aSize, aSize).array() = block;
+      return;
+    }
+    MatrixXd pair(aSize + bSize, frames.cols());
+    pair.topRows(aSize) = frames.middleRows(a, aSize);
+    pair.bottomRows(bSize) = frames.middleRows(b, bSize);
+    ArrayXXd block = DistanceMatrix(pair, dist);
+    dm.block(a, b, aSize, bSize).array() = block.block(0, aSize, aSize, bSize);
+    dm.block(b, a, bSize, aSize).array() = block.block(aSize, 0, bSize, aSize);
+  }
+
+  // the k segments closest to a: candidates from the codes, re-ranked on
+  // the exact distance
+  void nearestSegments(QuantizedFeatures& codes, const Eigen::MatrixXd& pooled,
+    index a, index k, index dist, std::vector<index>& order){
+    using namespace Eigen;
+    codes.nearest(a, k * kOversample, order);
+    // only a's own distances, one candidate at a time
+    MatrixXd pair(2, pooled.cols());
+    pair.row(0) = pooled.row(a);
+    std::vector<double> exact(order.size());
+    for(index i = 0; i < asSigned(order.size()); i++){
+      pair.row(1) = pooled.row(order[i]);
+      exact[i] = DistanceMatrix(pair, dist)(0, 1);
+    }
+    std::vector<index> rank(order.size());
+    std::iota(rank.begin(), rank.end(), 0);
+    k = std::min(k, asSigned(order.size()));
+    std::partial_sort(rank.begin(), rank.begin() + k, rank.end(),
+      [&](index x, index y){ return exact[x] < exact[y]; });
+    std::vector<index> nearest(k);
+    for(index i = 0; i < k; i++) nearest[i] = order[rank[i]];
+    order = nearest;
+  }
+
+  Eigen::ArrayXXd computeDM(RealMatrixView mag, index numBands,
+    double sampleRate, index windowSize, index fftSize, index dist){
+    RealMatrix melSpec = melSpectrogram(mag, numBands, sampleRate,
+                                        windowSize, fftSize);
+    return distanceMatrix(melSpec, dist);
+  }
+
+  std::vector<index> onsets(Eigen::Ref<Eigen::ArrayXd> odf){
+    mFilter.init(5);
     for(index i = 0; i < odf.size(); i++){
       odf(i) = odf(i) - mFilter.processSample(odf(i));
     }
-    auto onsets = mPD.process(odf, 0, 0.1, false, false);
-    for(index i = 0; i < onsets.size(); i++){
-      index pos = onsets[i].first;
+    auto peaks = mPD.process(odf, 0, 0.1, false, false);
+    std::vector<index> positions(peaks.size());
+    for(index i = 0; i < asSigned(peaks.size()); i++)
+      positions[i] = peaks[i].first;
+    return positions;
+  }
+
+  // frames whose links forbidOnsets removes, both ways
+  std::vector<bool> onsetMask(const std::vector<index>& onsets,
+                              index numFrames, index offset = 2){
+    std::vector<bool> mask(numFrames, false);
+    for(index pos : onsets){
+      index start = std::max(index(0), pos - offset);
+      index end = std::min(numFrames - 1, pos + offset + 1);
+      for(index i = start; i < end; i++) mask[i] = true;
+    }
+    return mask;
+  }
+
+  void forbidOnsets(const std::vector<index>& onsets,
+                    BitMatrix& transitions, index offset = 2){
+    for(index pos : onsets){
       index start = std::max(index(0), pos - offset);
       index end = std::min(transitions.rows() - 1, pos + offset + 1);
-      transitions.block(start, 0, end - start, transitions.cols()).setZero();
-      transitions.block(0, start, transitions.rows(), end - start).setZero();
+      for(index i = start; i < end; i++) transitions.resetRow(i);
+      transitions.resetColumns(start, end);
     }
   }
 
+  void onsetDetection(Eigen::Ref<Eigen::ArrayXd> odf,
+                      BitMatrix& transitions, index offset = 2){
+    forbidOnsets(onsets(odf), transitions, offset);
+  }
+
   FluidTensor<index, 1> kmeans(RealMatrixView data, index nClusters){
       algorithm::DataSetIdSequence seq("", 0, 0);
       index minClusterSize = 10;
@@ -109,12 +469,32 @@ public:
 
   FluidTensor<index, 1>  spectralClustering(Eigen::Ref<Eigen::ArrayXXd> dm, index numClusters = 0){
     using namespace Eigen;
-    index maxClusters = numClusters > 0? numClusters : std::min(index(50), dm.rows());
-    index nPoints = dm.rows();
     MatrixXd tmpRp = (dm.array() < 0.25).cast<double>();
     MatrixXd weightedGraph = (1 - dm) * tmpRp.array();
+    return spectralClustering(SparseMatrix<double>(weightedGraph.sparseView()),
+                              numClusters);
+  }
+
+  // the same on a band, whose pairs further apart are never similar
+  FluidTensor<index, 1> spectralClustering(const DistanceBand& dm,
+                                           index numClusters = 0){
+    std::vector<Eigen::Triplet<double>> weights;
+    for(index i = 0; i < dm.rows(); i++)
+      for(index j = dm.first(i); j < dm.last(i); j++)
+        if(dm(i, j) < 0.25) weights.emplace_back(i, j, 1 - dm(i, j));
+    Eigen::SparseMatrix<double> weightedGraph(dm.rows(), dm.cols());
+    weightedGraph.setFromTriplets(weights.begin(), weights.end());
+    return spectralClustering(weightedGraph, numClusters);
+  }
+
+  // clusters of the spectral embedding of a graph of similarity weights
+  FluidTensor<index, 1> spectralClustering(
+    const Eigen::SparseMatrix<double>& weightedGraph, index numClusters){
+    using namespace Eigen;
+    index maxClusters = numClusters > 0? numClusters : std::min(index(50), weightedGraph.rows());
+    index nPoints = weightedGraph.rows();
     SpectralEmbedding spectralEmbedding;
-    spectralEmbedding.train(weightedGraph.sparseView(), maxClusters);
+    spectralEmbedding.train(weightedGraph, maxClusters);
     if(numClusters == 0 ){
       VectorXd eigenValues  =  spectralEmbedding.eigenValues();
       ArrayXd diff = (
@@ -131,6 +511,30 @@ public:
 
 
 private:
+  // rows and columns [first, first + count) of band, in blocks of at least
+  // width rows, each against the frames within width of it
+  void fillBand(const Eigen::MatrixXd& frames, index dist, index first,
+    index count, DistanceBand& band){
+    using namespace Eigen;
+    index width = band.width();
+    index block = std::max(width, index(kChunkFrames));
+    for(index start = first; start < first + count; start += block){
+      index size = std::min(block, first + count - start);
+      index lo = std::max(start - width, index(0));
+      index hi = std::min(start + size + width, frames.rows());
+      MatrixXd window = frames.middleRows(lo, hi - lo);
+      ArrayXXd d = DistanceMatrix(window, dist);
+      for(index i = start; i < start + size; i++)
+        for(index j = band.first(i); j < band.last(i); j++){
+          band.at(i, j) = d(i - lo, j - lo);
+          band.at(j, i) = d(j - lo, i - lo);
+        }
+    }
+  }
+
+  static constexpr index kChunkFrames = 64;
+  static constexpr index kOversample = 4;
+
   MedianFilter mFilter;
   PeakDetection mPD;
   KMeans mKMeans;
@@ -0,0 +1,177 @@
+/*
+Part of the Fluid Corpus Manipulation Project (http://www.flucoma.org/)
+Copyright 2017-2019 University of Huddersfield.
+Licensed under the BSD-3 License.
+See license.md file in the project root for full license information.
+This project has received funding from the European Research Council (ERC)
+under the European Union’s Horizon 2020 research and innovation programme
+(grant agreement No 725899).
+*/
+#pragma once
+
+#include "algorithms/AudioSource.hpp"
+#include "algorithms/public/STFT.hpp"
+#include "data/FluidIndex.hpp"
+#include "data/TensorTypes.hpp"
+#include <algorithm>
+#include <memory>
+
+namespace fluid {
+namespace algorithm {
+
+// Maps the walk, which moves in analysis frames, onto a playback STFT of
+// any resolution. At the analysis resolution every playback hop is one
+// analysis hop and frames come from the stored spectrogram. Otherwise the
+// playback position advances by the playback hop, the walk by as many
+// analysis hops as that covers, and each frame is cut from the source around
+// frame * analysis hop + offset, so changing the playback window or hop
+// needs no new analysis. Frames of a corpus, the second source of a cross
+// analysis, are cut from it the same way. The playback STFT and frame are
+// allocated once by prepare() at the largest size, off the audio thread,
+// and setResolution only resizes them. Assigning another playback takes its
+// analysis settings and keeps this one's STFT, so swapping in a new analysis
+// allocates nothing either.
+class GraphPlayback {
+
+public:
+  GraphPlayback() = default;
+  GraphPlayback(const GraphPlayback& other) {
+    prepare(other.mMaxSize);
+    *this = other;
+  }
+  GraphPlayback(GraphPlayback&&) = default;
+  GraphPlayback& operator=(GraphPlayback&&) = default;
+
+  GraphPlayback& operator=(const GraphPlayback& other) {
+    mAnalysisWindow = other.mAnalysisWindow;
+    mAnalysisFFT = other.mAnalysisFFT;
+    mAnalysisHop = other.mAnalysisHop;
+    reset();
+    return *this;
+  }
+
+  // allocates for playback windows and FFTs up to maxFFTSize; without it
+  // only the analysis resolution plays
+  void prepare(index maxFFTSize) {
+    if (maxFFTSize == mMaxSize) return;
+    mMaxSize = maxFFTSize;
+    if (mMaxSize > 0) {
+      mSTFT = std::make_unique<STFT>(mMaxSize, mMaxSize, mMaxSize / 2);
+      mFrame = RealVector(mMaxSize);
+    } else {
+      mSTFT.reset();
+      mFrame = RealVector();
+    }
+    reset();
+  }
+
+  // analysis settings of the graph
+  void init(index windowSize, index fftSize, index hopSize) {
+    mAnalysisWindow = windowSize;
+    mAnalysisFFT = fftSize;
+    mAnalysisHop = hopSize;
+    reset();
+  }
+
+  void reset() {
+    mWindowSize = mAnalysisWindow;
+    mFFTSize = mAnalysisFFT;
+    mHopSize = mAnalysisHop;
+    mOffset = 0;
+    mSource = nullptr;
+    mCorpus = nullptr;
+  }
+
+  // playback settings and the sources to cut frames from, for the frames
+  // that follow; they have to stay valid until then. Runs on the audio
+  // thread: a new resolution resizes the prepared STFT in place.
+  void setResolution(index windowSize, index fftSize, index hopSize,
+                     const AudioSource* source,
+                     const AudioSource* corpus = nullptr) {
+    if (mAnalysisWindow <= 0) return; // no analysis yet
+    mSource = source;
+    mCorpus = corpus;
+    if (windowSize == mWindowSize && fftSize == mFFTSize &&
+        hopSize == mHopSize)
+      return;
+    mWindowSize = windowSize;
+    mFFTSize = fftSize;
+    mHopSize = hopSize;
+    mOffset = 0;
+    if (!native() && prepared())
+      mSTFT->resize(mWindowSize, mFFTSize, mHopSize);
+  }
+
+  // whether the prepared STFT covers the playback resolution
+  bool prepared() const {
+    return mSTFT && mWindowSize <= mMaxSize && mFFTSize <= mMaxSize;
+  }
+
+  bool native() const {
+    return mWindowSize == mAnalysisWindow && mFFTSize == mAnalysisFFT &&
+           mHopSize == mAnalysisHop;
+  }
+
+  // analysis hops the walk has to take for the next playback hop
+  index advance() {
+    if (native()) return 1;
+    mOffset += mHopSize;
+    index hops = mOffset / mAnalysisHop;
+    mOffset %= mAnalysisHop;
+    return hops;
+  }
+
+  // playback frame at offset samples into analysis frame, of the corpus
+  // with fromCorpus; false at the analysis resolution, where the caller
+  // plays the stored frame, and silence without a source or larger than
+  // prepared for
+  bool render(index frame, ComplexVectorView out, bool fromCorpus = false) {
+    if (native()) return false;
+    const AudioSource* source = fromCorpus ? mCorpus : mSource;
+    if (!source || !prepared()) {
+      std::fill(out.begin(), out.end(), 0);
+      return true;
+    }
+    index centre = frame * mAnalysisHop + mOffset;
+    RealVectorView window = mFrame(Slice(0, mWindowSize));
+    source->read(centre - mWindowSize / 2, window);
+    mSTFT->processFrame(window, out);
+    return true;
+  }
+
+private:
+  index                 mAnalysisWindow{0};
+  index                 mAnalysisFFT{0};
+  index                 mAnalysisHop{1};
+  index                 mWindowSize{0};
+  index                 mFFTSize{0};
+  index                 mHopSize{1};
+  index                 mOffset{0};
+  index                 mMaxSize{0};
+  const AudioSource*    mSource{nullptr};
+  const AudioSource*    mCorpus{nullptr};
+  std::unique_ptr<STFT> mSTFT;
+  RealVector            mFrame;
+};
+
+struct PlaybackResolution {
+  index windowSize;
+  index fftSize;
+  index hopSize;
+};
+
+// Low-latency playback with a synthesis window shorter than the analysis
+// window: the hop keeps the analysis overlap and the FFT is the next power
+// of two. Output latency is then that of the synthesis window.
+inline PlaybackResolution lowLatencyResolution(index synthesisWindow,
+                                               index windowSize,
+                                               index hopSize) {
+  index overlap = std::max(windowSize / std::max(hopSize, index(1)), index(1));
+  index fftSize = 1;
+  while (fftSize < synthesisWindow) fftSize *= 2;
+  return {synthesisWindow, fftSize,
+          std::max(synthesisWindow / overlap, index(1))};
+}
+
+} // namespace algorithm
+} // namespace fluid
@@ -0,0 +1,105 @@
+/*
+Part of the Fluid Corpus Manipulation Project (http://www.flucoma.org/)
+Copyright 2017-2019 University of Huddersfield.
+Licensed under the BSD-3 License.
+See license.md file in the project root for full license information.
+This project has received funding from the European Research Council (ERC)
+under the European Union’s Horizon 2020 research and innovation programme
+(grant agreement No 725899).
+*/
+#pragma once
+
+#include "algorithms/public/STFT.hpp"
+#include "algorithms/util/AlgorithmUtils.hpp"
+#include "data/TensorTypes.hpp"
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <vector>
+
+namespace fluid {
+namespace algorithm {
+
+// Offline rendering of graph walks: runs processFrame for a whole
+// output duration into a spectrogram, then overlap-adds it in one block.
+// Each variation walks its own copy of an analysed model, so variations
+// can be spread over several threads.
+class GraphRender {
+
+public:
+  // hop(algorithm, ComplexVectorView out, RealVectorView info) is called
+  // once per frame; info(0) (the playback frame) is written to the path.
+  template <typename Algorithm, typename HopFunc>
+  void process(const Algorithm& model, index seed, index maxThreads,
+               HopFunc hop, RealMatrixView audio, RealMatrixView path) {
+    index numVariations = audio.rows();
+    index numThreads =
+        std::max(index(1), std::min(numVariations, maxThreads));
+    if (numThreads == 1) {
+      for (index v = 0; v < numVariations; v++)
+        renderOne(model, variationSeed(seed, v), hop, audio.row(v),
+                  path.row(v));
+      return;
+    }
+    std::vector<std::thread> workers;
+    for (index t = 0; t < numThreads; t++) {
+      workers.emplace_back([&, t]() {
+        for (index v = t; v < numVariations; v += numThreads)
+          renderOne(model, variationSeed(seed, v), hop, audio.row(v),
+                    path.row(v));
+      });
+    }
+    for (auto& w : workers) w.join();
+  }
+
+  static index numHops(index duration, index hopSize) {
+    return (duration + hopSize) / hopSize;
+  }
+
+private:
+  static index variationSeed(index seed, index variation) {
+    return seed < 0 ? seed : seed + variation;
+  }
+
+  template <typename Algorithm, typename HopFunc>
+  void renderOne(const Algorithm& model, index seed, HopFunc& hop,
+                 RealVectorView audio, RealVectorView path) {
+    using namespace std;
+    Algorithm algorithm = model;
+    algorithm.seed(seed);
+    index windowSize = algorithm.mWindowSize;
+    index hopSize = algorithm.mHopSize;
+    index nHops = path.size();
+    ComplexMatrix spectrogram(nHops, algorithm.mFFTSize / 2 + 1);
+    RealVector info(4);
+    for (index i = 0; i < nHops; i++) {
+      hop(algorithm, spectrogram.row(i), info);
+      path(i) = info(0);
+    }
+    // same normalisation as STFTBufferedProcess: divide by the overlapped
+    // product of analysis and synthesis (Hann) windows
+    ISTFT istft(windowSize, algorithm.mFFTSize, hopSize);
+    RealVector frame(windowSize);
+    RealVector window(windowSize);
+    for (index i = 0; i < windowSize; i++)
+      window(i) = 0.5 - 0.5 * cos((pi * 2 * i) / windowSize);
+    RealVector norm(audio.size());
+    norm.fill(0);
+    audio.fill(0);
+    index halfWindow = windowSize / 2;
+    for (index i = 0; i < nHops; i++) {
+      istft.processFrame(spectrogram.row(i), frame);
+      index offset = i * hopSize - halfWindow;
+      index first = max(index(0), -offset);
+      index last = min(windowSize, audio.size() - offset);
+      for (index j = first; j < last; j++) {
+        audio(offset + j) += frame(j);
+        norm(offset + j) += window(j) * window(j);
+      }
+    }
+    for (index i = 0; i < audio.size(); i++)
+      if (norm(i) > epsilon) audio(i) /= norm(i);
+  }
+};
+} // namespace algorithm
+} // namespace fluid
@@ -0,0 +1,203 @@
+/*
+Part of the Fluid Corpus Manipulation Project (http://www.flucoma.org/)
+Copyright 2017-2019 University of Huddersfield.
+Licensed under the BSD-3 License.
+See license.md file in the project root for full license information.
+This project has received funding from the European Research Council (ERC)
+under the European Union’s Horizon 2020 research and innovation programme
+(grant agreement No 725899).
+*/
+#pragma once
+
+#include "data/FluidIndex.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <sstream>
+#include <string>
+
+namespace fluid {
+namespace algorithm {
+
+// Lightweight instrumentation for the graph algorithms: accumulated time per
+// analysis stage, a per-hop processFrame latency histogram and fallback
+// counters. Writers (audio thread) and readers (stats message) only touch
+// relaxed atomics, so nothing here locks or allocates on the hot path.
+class GraphStats {
+
+public:
+  enum Stage {
+    kSTFT,
+    kMel,
+    kDistance,
+    kOnsets,
+    kClustering,
+    kBeatSpectrum,
+    kFit,
+    kRTPGHI,
+    kNumStages
+  };
+
+  enum Counter {
+    kSeeks,
+    kJumps,
+    kNoNeighbours,
+    kClusterFallback,
+    kLoopSearches,
+    kPlannerUnderruns,
+    kNumCounters
+  };
+
+  using Clock = std::chrono::steady_clock;
+
+  class ScopedTimer {
+  public:
+    ScopedTimer(GraphStats& stats, Stage stage)
+        : mStats(stats), mStage(stage), mStart(Clock::now()) {}
+    ~ScopedTimer() { mStats.addStageTime(mStage, elapsed(mStart)); }
+
+  private:
+    GraphStats& mStats;
+    Stage       mStage;
+    Clock::time_point mStart;
+  };
+
+  class HopTimer {
+  public:
+    HopTimer(GraphStats& stats) : mStats(stats), mStart(Clock::now()) {}
+    ~HopTimer() { mStats.addHopTime(elapsed(mStart)); }
+
+  private:
+    GraphStats& mStats;
+    Clock::time_point mStart;
+  };
+
+  GraphStats() { reset(); }
+
+  GraphStats(const GraphStats& other) { *this = other; }
+
+  GraphStats& operator=(const GraphStats& other) {
+    for (index i = 0; i < kNumStages; i++) {
+      mStageTime[i].store(other.mStageTime[i].load(relaxed), relaxed);
+      mStageCount[i].store(other.mStageCount[i].load(relaxed), relaxed);
+    }
+    for (index i = 0; i < kNumCounters; i++)
+      mCounters[i].store(other.mCounters[i].load(relaxed), relaxed);
+    for (index i = 0; i < kNumBuckets; i++)
+      mHistogram[i].store(other.mHistogram[i].load(relaxed), relaxed);
+    mMaxHop.store(other.mMaxHop.load(relaxed), relaxed);
+    return *this;
+  }
+
+  void reset() {
+    for (auto& t : mStageTime) t.store(0, relaxed);
+    for (auto& c : mStageCount) c.store(0, relaxed);
+    for (auto& c : mCounters) c.store(0, relaxed);
+    for (auto& h : mHistogram) h.store(0, relaxed);
+    mMaxHop.store(0, relaxed);
+  }
+
+  // times are in nanoseconds
+  void addStageTime(Stage stage, std::uint64_t ns) {
+    mStageTime[stage].fetch_add(ns, relaxed);
+    mStageCount[stage].fetch_add(1, relaxed);
+  }
+
+  void addHopTime(std::uint64_t ns) {
+    mHistogram[bucket(ns)].fetch_add(1, relaxed);
+    std::uint64_t prev = mMaxHop.load(relaxed);
+    while (ns > prev && !mMaxHop.compare_exchange_weak(prev, ns, relaxed)) {}
+  }
+
+  void count(Counter counter) { mCounters[counter].fetch_add(1, relaxed); }
+
+  double stageMs(Stage stage) const {
+    return mStageTime[stage].load(relaxed) / 1e6;
+  }
+
+  std::uint64_t counter(Counter counter) const {
+    return mCounters[counter].load(relaxed);
+  }
+
+  index numHops() const {
+    std::uint64_t total = 0;
+    for (auto& h : mHistogram) total += h.load(relaxed);
+    return static_cast<index>(total);
+  }
+
+  // upper bound (in microseconds) of the histogram bucket holding quantile q
+  double hopPercentile(double q) const {
+    std::array<std::uint64_t, kNumBuckets> counts;
+    std::uint64_t total = 0;
+    for (index i = 0; i < kNumBuckets; i++)
+      total += counts[i] = mHistogram[i].load(relaxed);
+    if (total == 0) return 0;
+    std::uint64_t target = static_cast<std::uint64_t>(std::ceil(q * total));
+    std::uint64_t acc = 0;
+    for (index i = 0; i < kNumBuckets; i++) {
+      acc += counts[i];
+      if (acc >= std::max<std::uint64_t>(target, 1))
+        return std::min(
+            std::pow(2.0, static_cast<double>(i) / kBucketsPerOctave),
+            maxHopUs());
+    }
+    return maxHopUs();
+  }
+
+  double maxHopUs() const { return mMaxHop.load(relaxed) / 1e3; }
+
+  std::string report() const {
+    static const char* stageNames[] = {
+        "stft",         "mel", "distance", "onsets", "clustering",
+        "beatSpectrum", "fit", "rtpghi"};
+    static const char* counterNames[] = {"seeks", "jumps", "noNeighbours",
+                                         "clusterFallback", "loopSearches",
+                                         "plannerUnderruns"};
+    std::ostringstream out;
+    out << "stages (ms):";
+    for (index i = 0; i < kNumStages; i++) {
+      if (mStageCount[i].load(relaxed) == 0) continue;
+      out << " " << stageNames[i] << "=" << stageMs(static_cast<Stage>(i));
+      if (mStageCount[i].load(relaxed) > 1)
+        out << "/" << mStageCount[i].load(relaxed);
+    }
+    out << "\nhops: " << numHops() << " p50<=" << hopPercentile(0.5)
+        << "us p99<=" << hopPercentile(0.99) << "us max=" << maxHopUs()
+        << "us\ncounters:";
+    for (index i = 0; i < kNumCounters; i++)
+      out << " " << counterNames[i] << "="
+          << mCounters[i].load(relaxed);
+    return out.str();
+  }
+
+private:
+  static constexpr std::memory_order relaxed = std::memory_order_relaxed;
+  static constexpr index kBucketsPerOctave = 4;
+  static constexpr index kNumBuckets = 96; // up to 2^24 us
+
+  static std::uint64_t elapsed(Clock::time_point start) {
+    return static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() -
+                                                             start)
+            .count());
+  }
+
+  static index bucket(std::uint64_t ns) {
+    double us = ns / 1e3;
+    if (us <= 1) return 0;
+    index b = static_cast<index>(std::ceil(std::log2(us) * kBucketsPerOctave));
+    return std::min(b, kNumBuckets - 1);
+  }
+
+  std::array<std::atomic<std::uint64_t>, kNumStages>   mStageTime;
+  std::array<std::atomic<std::uint64_t>, kNumStages>   mStageCount;
+  std::array<std::atomic<std::uint64_t>, kNumCounters> mCounters;
+  std::array<std::atomic<std::uint64_t>, kNumBuckets>  mHistogram;
+  std::atomic<std::uint64_t>                           mMaxHop;
+};
+
+} // namespace algorithm
+} // namespace fluid
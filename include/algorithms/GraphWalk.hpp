@@ -0,0 +1,173 @@
+/*
+Part of the Fluid Corpus Manipulation Project (http://www.flucoma.org/)
+Copyright 2017-2019 University of Huddersfield.
+Licensed under the BSD-3 License.
+See license.md file in the project root for full license information.
+This project has received funding from the European Research Council (ERC)
+under the European Union’s Horizon 2020 research and innovation programme
+(grant agreement No 725899).
+*/
+#pragma once
+
+#include "algorithms/BitMatrix.hpp"
+#include "algorithms/GraphPlayUtils.hpp"
+#include "algorithms/TransitionTable.hpp"
+#include "data/FluidIndex.hpp"
+#include <Eigen/Core>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace fluid {
+namespace algorithm {
+
+// Frame selection policies shared by GraphGrain and GraphPlay. The policy is
+// a template parameter of processFrame, so each instantiation inlines its
+// own candidate loop; clients pick the instantiation once per block.
+// Candidates come from the TransitionTable rows, which are sorted by
+// distance and cut at the threshold, so no policy scans all frames.
+
+enum WalkPolicyIndex { kNearest, kRankRandom, kProbability, kUniform };
+
+// Everything a policy may look at when choosing the next frame from `pos`.
+struct WalkContext {
+  const TransitionTable& table;
+  const VisitedLinks&    visited;
+  index                  pos;
+  index                  degree;     // links from pos under the threshold
+  index                  minDist;    // only frames further than this
+  double                 randomness; // fraction of ranked candidates
+  double                 temperature; // of the transition weights
+  GraphPlayUtils&        utils;
+  std::vector<index>&    candidates; // scratch, at least one row long
+
+  bool eligible(index i) const {
+    return std::abs(i - pos) > minDist && !visited.test(pos, i);
+  }
+
+  // linked, not recently visited frames further than minDist, nearest first
+  template <typename Func>
+  void forEachCandidate(Func&& f) const {
+    for (index k = 0; k < degree; k++) {
+      index i = table.neighbour(pos, k);
+      if (eligible(i)) f(i, k);
+    }
+  }
+
+  index gatherCandidates() {
+    index n = 0;
+    forEachCandidate([&](index i, index) { candidates[n++] = i; });
+    return n;
+  }
+};
+
+// Where a walk is and what it has visited. Only step and moveTo write it,
+// and with a planner they run on its thread alone: the audio thread keeps to
+// the playback state, and the analysis and TransitionTable between the two
+// are not written once init returns.
+struct WalkState {
+  VisitedLinks       visited;
+  std::vector<index> candidates; // scratch for the policies
+  index              pos{0};
+  index              corpusPos{-1}; // -1 while in the source
+  index              startFrame{-1};
+  index              count{0}; // frames since the last jump
+  double             threshold{0};
+  GraphPlayUtils     utils; // its generator draws the jumps
+
+  // back to the start, keeping the visited links' layout
+  void restart() {
+    pos = 0;
+    corpusPos = -1;
+    startFrame = -1;
+    count = 0;
+  }
+
+  // what the policies see of the walk at frame from
+  WalkContext context(const TransitionTable& table, index from, index minDist,
+                      double randomness, double temperature) {
+    return {table,      visited,     from, table.degree(from, threshold),
+            minDist,    randomness,  temperature, utils, candidates};
+  }
+};
+
+// All policies return -1 when there is no eligible neighbour, and the
+// algorithm applies its own fallback. Random policies first try a few
+// draws over the whole row and only scan it when those hit visited or too
+// close frames; rejection keeps the distribution over eligible frames exact.
+constexpr index kMaxDraws = 8;
+
+struct NearestPolicy {
+  static index select(WalkContext& c) {
+    for (index k = 0; k < c.degree; k++) {
+      index i = c.table.neighbour(c.pos, k);
+      if (c.eligible(i)) return i;
+    }
+    return -1;
+  }
+};
+
+// uniform choice among the `randomness` fraction of nearest candidates
+struct RankRandomPolicy {
+  static index select(WalkContext& c) {
+    index n = c.gatherCandidates();
+    if (n == 0) return -1;
+    index k = std::max(index(1), static_cast<index>(lrint(c.randomness * n)));
+    return c.candidates[c.utils.randInt(k)];
+  }
+};
+
+// choice weighted by the table's transition weights
+struct ProbabilityPolicy {
+  static index select(WalkContext& c) {
+    if (c.degree == 0) return -1;
+    for (index draw = 0; draw < kMaxDraws; draw++) {
+      index k = c.table.sample(c.pos, c.degree, c.temperature,
+                                [&]() { return c.utils.rand(); });
+      index i = c.table.neighbour(c.pos, k);
+      if (c.eligible(i)) return i;
+    }
+    double total = 0;
+    c.forEachCandidate(
+        [&](index, index k) {
+          total += c.table.weight(c.pos, k, c.temperature);
+        });
+    if (total <= 0) return -1;
+    double rnd = total * c.utils.rand();
+    index  selected = -1;
+    double acc = 0;
+    c.forEachCandidate([&](index i, index k) {
+      acc += c.table.weight(c.pos, k, c.temperature);
+      if (selected < 0 && acc >= rnd) selected = i;
+    });
+    return selected;
+  }
+};
+
+struct UniformPolicy {
+  static index select(WalkContext& c) {
+    if (c.degree == 0) return -1;
+    for (index draw = 0; draw < kMaxDraws; draw++) {
+      index i = c.table.neighbour(c.pos, c.utils.randInt(c.degree));
+      if (c.eligible(i)) return i;
+    }
+    index n = c.gatherCandidates();
+    if (n == 0) return -1;
+    return c.candidates[c.utils.randInt(n)];
+  }
+};
+
+// Calls f with a default-constructed policy object for the given index, e.g.
+// dispatchWalkPolicy(p, [&](auto policy){ using P = decltype(policy); ... })
+template <typename Func>
+void dispatchWalkPolicy(index policy, Func&& f) {
+  switch (policy) {
+  case kNearest: f(NearestPolicy{}); break;
+  case kProbability: f(ProbabilityPolicy{}); break;
+  case kUniform: f(UniformPolicy{}); break;
+  default: f(RankRandomPolicy{});
+  }
+}
+
+} // namespace algorithm
+} // namespace fluid
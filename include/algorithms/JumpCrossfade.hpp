@@ -0,0 +1,127 @@
+/*
+Part of the Fluid Corpus Manipulation Project (http://www.flucoma.org/)
+Copyright 2017-2019 University of Huddersfield.
+Licensed under the BSD-3 License.
+See license.md file in the project root for full license information.
+This project has received funding from the European Research Council (ERC)
+under the European Union’s Horizon 2020 research and innovation programme
+(grant agreement No 725899).
+*/
+#pragma once
+
+#include "algorithms/AudioSource.hpp"
+#include "data/FluidIndex.hpp"
+#include "data/TensorTypes.hpp"
+#include <algorithm>
+#include <type_traits>
+
+namespace fluid {
+namespace algorithm {
+
+// Sample-accurate jumps on top of the STFT output, which lags the walk by
+// about a window. At a trigger the output fades linearly over fade samples
+// from the STFT stream to the source read straight from the jump target, the
+// source plays for hold samples while the STFT stream catches up with the
+// new position, and then fades back. A trigger during a jump fades the
+// current source voice out while the new one fades in.
+class JumpCrossfade {
+
+public:
+  void setLengths(index fade, index hold) {
+    mFade = std::max(fade, index(1));
+    mHold = std::max(hold, index(0));
+  }
+
+  void reset() {
+    mCurrent.active = false;
+    mPrevious.active = false;
+    mLastTrigger = 0;
+  }
+
+  bool active() const { return mCurrent.active; }
+
+  // source sample the jump is playing
+  index position() const { return mCurrent.start + mCurrent.elapsed; }
+
+  // mixes the jumps into out; onTrigger() is called at each rising edge of
+  // trigger and returns the source sample to jump to, or -1 to ignore it
+  template <typename In, typename Out, typename OnTrigger>
+  void process(const In& trigger, Out&& out, const AudioSource& source,
+               OnTrigger onTrigger) {
+    for (index i = 0; i < out.size(); i++) {
+      double t = trigger(i);
+      if (t > 0 && mLastTrigger <= 0) start(onTrigger());
+      mLastTrigger = t;
+      if (!mCurrent.active && !mPrevious.active) continue;
+      double current = gain(mCurrent);
+      double previous = mPrevious.active
+                            ? mPrevious.level *
+                                  (1 - double(mPrevious.elapsed) / mFade)
+                            : 0;
+      double mix = out(i) * (1 - current - previous);
+      if (mCurrent.active) mix += current * next(mCurrent, source);
+      if (mPrevious.active) {
+        mix += previous * next(mPrevious, source);
+        if (mPrevious.elapsed >= mFade) mPrevious.active = false;
+      }
+      if (mCurrent.elapsed >= 2 * mFade + mHold) mCurrent.active = false;
+      out(i) = static_cast<typename std::decay_t<decltype(out(i))>>(mix);
+    }
+  }
+
+private:
+  static constexpr index kChunkSize = 64;
+
+  struct Voice {
+    bool       active{false};
+    index      start{0};
+    index      elapsed{0};
+    double     level{0};
+    index      cacheStart{0};
+    RealVector cache = RealVector(index(kChunkSize));
+  };
+
+  void start(index position) {
+    if (position < 0) return;
+    if (mCurrent.active) {
+      // the previous voice starts its fade with the elapsed count reset
+      std::swap(mCurrent, mPrevious);
+      mPrevious.level = gain(mPrevious);
+      mPrevious.start += mPrevious.elapsed;
+      mPrevious.cacheStart -= mPrevious.elapsed;
+      mPrevious.elapsed = 0;
+    }
+    mCurrent.active = true;
+    mCurrent.start = position;
+    mCurrent.elapsed = 0;
+    mCurrent.cacheStart = -kChunkSize - 1;
+  }
+
+  double gain(const Voice& v) const {
+    if (!v.active) return 0;
+    if (v.elapsed < mFade) return double(v.elapsed) / mFade;
+    if (v.elapsed < mFade + mHold) return 1;
+    return std::max(0.0, 1 - double(v.elapsed - mFade - mHold) / mFade);
+  }
+
+  // next source sample of v, read a chunk at a time
+  double next(Voice& v, const AudioSource& source) {
+    index offset = v.elapsed - v.cacheStart;
+    if (offset < 0 || offset >= kChunkSize) {
+      v.cacheStart = v.elapsed;
+      source.read(v.start + v.elapsed, v.cache);
+      offset = 0;
+    }
+    v.elapsed++;
+    return v.cache(offset);
+  }
+
+  Voice  mCurrent;
+  Voice  mPrevious;
+  index  mFade{64};
+  index  mHold{0};
+  double mLastTrigger{0};
+};
+
+} // namespace algorithm
+} // namespace fluid
@@ -0,0 +1,107 @@
+/*
+Part of the Fluid Corpus Manipulation Project (http://www.flucoma.org/)
+Copyright 2017-2019 University of Huddersfield.
+Licensed under the BSD-3 License.
+See license.md file in the project root for full license information.
+This project has received funding from the European Research Council (ERC)
+under the European Union’s Horizon 2020 research and innovation programme
+(grant agreement No 725899).
+*/
+#pragma once
+
+#include "data/FluidIndex.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+namespace fluid {
+namespace algorithm {
+
+// Loops precomputed over a grid of start/end cells, so that playback looks
+// one up in constant time without searching or allocating. Each cell keeps
+// up to kAlternatives links: rank 0 is the link nearest the cell centre, as
+// a search would find, and the rest are the next nearest ordered by their
+// score, the similarity of the loop's two ends.
+class LoopCatalogue {
+
+public:
+  static constexpr index kAlternatives = 4;
+  static constexpr index kMaxCells = 256;
+
+  struct Loop {
+    std::int32_t start;
+    std::int32_t end;
+    float        score;
+  };
+
+  // nearest(start, end, k, loops) fills loops with the k links nearest to
+  // (start, end), nearest first; score(start, end) rates a link
+  template <typename Nearest, typename Score>
+  void build(index numFrames, Nearest nearest, Score score) {
+    mNumFrames = numFrames;
+    mCells = std::max(std::min(numFrames, index(kMaxCells)), index(1));
+    mLoops.assign(mCells * mCells * kAlternatives, {-1, -1, 0});
+    mCounts.assign(mCells * mCells, 0);
+    std::vector<Loop> found;
+    for (index i = 0; i < mCells; i++) {
+      for (index j = 0; j < mCells; j++) {
+        found.clear();
+        nearest(centre(i), centre(j), kAlternatives, found);
+        for (auto& loop : found) loop.score = score(loop.start, loop.end);
+        if (found.size() > 2)
+          std::sort(found.begin() + 1, found.end(),
+                    [](const Loop& a, const Loop& b) {
+                      return a.score > b.score;
+                    });
+        index count = std::min(static_cast<index>(found.size()),
+                               index(kAlternatives));
+        std::copy_n(found.begin(), count, mLoops.begin() + cell(i, j));
+        mCounts[asUnsigned(i * mCells + j)] = static_cast<std::uint8_t>(count);
+      }
+    }
+  }
+
+  // the cell holding frames startFrame and endFrame
+  index cellOf(index startFrame, index endFrame) const {
+    return gridIndex(startFrame) * mCells + gridIndex(endFrame);
+  }
+
+  // loop of the given rank in a cell, or the last one it has; nullptr if
+  // no link falls near it
+  const Loop* find(index cellIndex, index rank) const {
+    if (cellIndex < 0 || cellIndex >= asSigned(mCounts.size())) return nullptr;
+    index count = mCounts[asUnsigned(cellIndex)];
+    if (count == 0) return nullptr;
+    rank = std::max(std::min(rank, count - 1), index(0));
+    return &mLoops[asUnsigned(cellIndex * kAlternatives + rank)];
+  }
+
+  // size of the catalogue for numFrames frames
+  static double bytes(index numFrames) {
+    double cells = std::max(std::min(numFrames, index(kMaxCells)), index(1));
+    return cells * cells * (kAlternatives * sizeof(Loop) + 1);
+  }
+
+private:
+  static size_t asUnsigned(index x) { return static_cast<size_t>(x); }
+  static index  asSigned(size_t x) { return static_cast<index>(x); }
+
+  double centre(index cellIndex) const {
+    return (cellIndex + 0.5) * mNumFrames / mCells;
+  }
+
+  index gridIndex(index frame) const {
+    index i = mNumFrames > 0 ? frame * mCells / mNumFrames : 0;
+    return std::max(std::min(i, mCells - 1), index(0));
+  }
+
+  index cell(index i, index j) const { return (i * mCells + j) * kAlternatives; }
+
+  index                     mNumFrames{0};
+  index                     mCells{1};
+  std::vector<Loop>         mLoops;
+  std::vector<std::uint8_t> mCounts;
+};
+
+} // namespace algorithm
+} // namespace fluid
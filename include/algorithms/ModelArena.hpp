@@ -0,0 +1,162 @@
+/*
+Part of the Fluid Corpus Manipulation Project (http://www.flucoma.org/)
+Copyright 2017-2019 University of Huddersfield.
+Licensed under the BSD-3 License.
+See license.md file in the project root for full license information.
+This project has received funding from the European Research Council (ERC)
+under the European Union’s Horizon 2020 research and innovation programme
+(grant agreement No 725899).
+*/
+#pragma once
+
+#include "data/FluidIndex.hpp"
+#include "data/FluidTensor.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#if defined(__linux__) || defined(__APPLE__)
+#include <sys/mman.h>
+#endif
+
+namespace fluid {
+namespace algorithm {
+
+// One block of memory for the large arrays a model reads while playing,
+// sized up front and handed out in 64-byte aligned pieces. Where the system
+// has them, blocks of a few megabytes and more ask for huge pages, so that
+// jumps across a large model touch few TLB entries. Every page is written
+// once on construction, on the analysis thread, so that the audio thread
+// never takes a page fault on it. The block is freed in one call when the
+// last model sharing it goes.
+class ModelArena {
+
+public:
+  static constexpr index kAlignment = 64;
+
+  explicit ModelArena(index bytes, bool hugePages = true)
+      : mCapacity(std::max(bytes, index(kAlignment))) {
+    (void) hugePages;
+#if defined(__linux__) || defined(__APPLE__)
+    void* block = mmap(nullptr, static_cast<size_t>(mCapacity),
+                       PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1,
+                       0);
+    if (block != MAP_FAILED) {
+      mData = static_cast<char*>(block);
+      mMapped = true;
+#ifdef MADV_HUGEPAGE
+      if (hugePages && mCapacity >= kHugePageSize)
+        madvise(block, static_cast<size_t>(mCapacity), MADV_HUGEPAGE);
+#endif
+    }
+#endif
+    if (!mData) {
+      // page alignment is left to the allocator, the pieces are aligned here
+      mBlock = static_cast<char*>(std::malloc(
+          static_cast<size_t>(mCapacity + kAlignment)));
+      if (!mBlock) throw std::bad_alloc();
+      mData = alignUp(mBlock);
+    }
+    prefault();
+  }
+
+  ModelArena(const ModelArena&) = delete;
+  ModelArena& operator=(const ModelArena&) = delete;
+
+  ~ModelArena() {
+#if defined(__linux__) || defined(__APPLE__)
+    if (mMapped) munmap(mData, static_cast<size_t>(mCapacity));
+#endif
+    std::free(mBlock);
+  }
+
+  // room taken by count Ts
+  template <typename T>
+  static index bytes(index count) {
+    index size = count * static_cast<index>(sizeof(T));
+    return (size + kAlignment - 1) / kAlignment * kAlignment;
+  }
+
+  // count Ts, value-initialised by the prefault; throws std::bad_alloc past
+  // the size given on construction, whatever the build, as a miscounted
+  // total would otherwise hand out memory beyond the block
+  template <typename T>
+  T* allocate(index count) {
+    index size = bytes<T>(count);
+    if (count < 0 || size > mCapacity - mUsed) throw std::bad_alloc();
+    T* piece = reinterpret_cast<T*>(mData + mUsed);
+    mUsed += size;
+    return piece;
+  }
+
+  index capacity() const { return mCapacity; }
+
+private:
+  static constexpr index kHugePageSize = 2 * 1024 * 1024;
+  static constexpr index kPageSize = 4096;
+
+  static char* alignUp(char* p) {
+    auto address = reinterpret_cast<std::uintptr_t>(p);
+    auto mask = static_cast<std::uintptr_t>(kAlignment - 1);
+    return reinterpret_cast<char*>((address + mask) & ~mask);
+  }
+
+  // mapped pages come zeroed and only need a write each
+  void prefault() {
+    if (mMapped)
+      for (index i = 0; i < mCapacity; i += kPageSize) mData[i] = 0;
+    else
+      std::memset(mData, 0, static_cast<size_t>(mCapacity));
+  }
+
+  char* mData{nullptr};
+  char* mBlock{nullptr};
+  index mCapacity{0};
+  index mUsed{0};
+  bool  mMapped{false};
+};
+
+// Row-major matrix whose storage is a piece of a ModelArena. Copies share
+// the storage, which is read-only once filled, so copying a model does not
+// copy its arrays.
+template <typename T>
+class ArenaMatrix {
+
+public:
+  ArenaMatrix() = default;
+
+  ArenaMatrix(std::shared_ptr<ModelArena> arena, index rows, index cols)
+      : mArena(std::move(arena)),
+        mData(mArena->template allocate<T>(rows * cols)), mRows(rows),
+        mCols(cols) {}
+
+  static index bytes(index rows, index cols) {
+    return ModelArena::bytes<T>(rows * cols);
+  }
+
+  index rows() const { return mRows; }
+  index cols() const { return mCols; }
+
+  const std::shared_ptr<ModelArena>& arena() const { return mArena; }
+
+  FluidTensorView<T, 2> view() const {
+    return FluidTensorView<T, 2>(mData, 0, mRows, mCols);
+  }
+
+  FluidTensorView<T, 1> row(index i) const {
+    return FluidTensorView<T, 1>(mData + i * mCols, 0, mCols);
+  }
+
+  T& operator()(index i, index j) const { return mData[i * mCols + j]; }
+
+private:
+  std::shared_ptr<ModelArena> mArena;
+  T*                          mData{nullptr};
+  index                       mRows{0};
+  index                       mCols{0};
+};
+
+} // namespace algorithm
+} // namespace fluid
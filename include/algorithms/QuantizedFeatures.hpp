@@ -0,0 +1,81 @@
+/*
+Part of the Fluid Corpus Manipulation Project (http://www.flucoma.org/)
+Copyright 2017-2019 University of Huddersfield.
+Licensed under the BSD-3 License.
+See license.md file in the project root for full license information.
+This project has received funding from the European Research Council (ERC)
+under the European Union’s Horizon 2020 research and innovation programme
+(grant agreement No 725899).
+*/
+#pragma once
+
+#include "data/FluidIndex.hpp"
+#include <Eigen/Core>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace fluid {
+namespace algorithm {
+
+// Features scalar-quantised to a byte per band for candidate search: each
+// band is offset by its minimum and all share one scale, so that squared
+// differences of codes are proportional to squared Euclidean distances. A
+// scan touches an eighth of the memory of the double features and only sums
+// integers; the candidates it returns are meant to be re-ranked on the exact
+// features with the distance actually used.
+class QuantizedFeatures {
+
+public:
+  void init(const Eigen::MatrixXd& features) {
+    mRows = features.rows();
+    mCols = features.cols();
+    Eigen::RowVectorXd offset = features.colwise().minCoeff();
+    double range = mRows > 0 ? (features.rowwise() - offset).maxCoeff() : 0;
+    double scale = range > 0 ? 255 / range : 0;
+    mCodes.resize(static_cast<size_t>(mRows * mCols));
+    for (index i = 0; i < mRows; i++)
+      for (index j = 0; j < mCols; j++)
+        mCodes[static_cast<size_t>(i * mCols + j)] = static_cast<std::uint8_t>(
+            std::lrint((features(i, j) - offset(j)) * scale));
+  }
+
+  index rows() const { return mRows; }
+
+  // the k rows nearest to row on the codes, row itself included, nearest
+  // first
+  void nearest(index row, index k, std::vector<index>& out) {
+    k = std::min(k, mRows);
+    mDistances.resize(static_cast<size_t>(mRows));
+    const std::uint8_t* query = code(row);
+    for (index i = 0; i < mRows; i++) {
+      const std::uint8_t* other = code(i);
+      std::int32_t        sum = 0;
+      for (index j = 0; j < mCols; j++) {
+        std::int32_t d = std::int32_t(query[j]) - std::int32_t(other[j]);
+        sum += d * d;
+      }
+      mDistances[static_cast<size_t>(i)] = {sum, i};
+    }
+    std::partial_sort(mDistances.begin(), mDistances.begin() + k,
+                      mDistances.end());
+    out.resize(static_cast<size_t>(k));
+    for (index i = 0; i < k; i++)
+      out[static_cast<size_t>(i)] = mDistances[static_cast<size_t>(i)].second;
+  }
+
+private:
+  const std::uint8_t* code(index row) const {
+    return mCodes.data() + row * mCols;
+  }
+
+  index                                       mRows{0};
+  index                                       mCols{0};
+  std::vector<std::uint8_t>                   mCodes;
+  std::vector<std::pair<std::int32_t, index>> mDistances;
+};
+
+} // namespace algorithm
+} // namespace fluid
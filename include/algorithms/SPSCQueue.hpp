@@ -0,0 +1,67 @@
+/*
+Part of the Fluid Corpus Manipulation Project (http://www.flucoma.org/)
+Copyright 2017-2019 University of Huddersfield.
+Licensed under the BSD-3 License.
+See license.md file in the project root for full license information.
+This project has received funding from the European Research Council (ERC)
+under the European Union’s Horizon 2020 research and innovation programme
+(grant agreement No 725899).
+*/
+#pragma once
+
+#include "data/FluidIndex.hpp"
+#include <atomic>
+#include <vector>
+
+namespace fluid {
+namespace algorithm {
+
+// Bounded lock-free queue for exactly one producer and one consumer thread.
+// Storage is allocated by the constructor; push and pop never allocate or
+// block.
+template <typename T>
+class SPSCQueue {
+
+public:
+  explicit SPSCQueue(index capacity)
+      : mSlots(static_cast<size_t>(capacity + 1)) {}
+
+  SPSCQueue(const SPSCQueue&) = delete;
+  SPSCQueue& operator=(const SPSCQueue&) = delete;
+
+  // producer side; false when full
+  bool push(const T& value) {
+    size_t tail = mTail.load(std::memory_order_relaxed);
+    size_t next = increment(tail);
+    if (next == mHead.load(std::memory_order_acquire)) return false;
+    mSlots[tail] = value;
+    mTail.store(next, std::memory_order_release);
+    return true;
+  }
+
+  bool full() const {
+    return increment(mTail.load(std::memory_order_relaxed)) ==
+           mHead.load(std::memory_order_acquire);
+  }
+
+  // consumer side; false when empty
+  bool pop(T& value) {
+    size_t head = mHead.load(std::memory_order_relaxed);
+    if (head == mTail.load(std::memory_order_acquire)) return false;
+    value = mSlots[head];
+    mHead.store(increment(head), std::memory_order_release);
+    return true;
+  }
+
+private:
+  size_t increment(size_t i) const {
+    return i + 1 == mSlots.size() ? 0 : i + 1;
+  }
+
+  std::vector<T>                  mSlots;
+  alignas(64) std::atomic<size_t> mHead{0};
+  alignas(64) std::atomic<size_t> mTail{0};
+};
+
+} // namespace algorithm
+} // namespace fluid
@@ -0,0 +1,108 @@
+/*
+Part of the Fluid Corpus Manipulation Project (http://www.flucoma.org/)
+Copyright 2017-2019 University of Huddersfield.
+Licensed under the BSD-3 License.
+See license.md file in the project root for full license information.
+This project has received funding from the European Research Council (ERC)
+under the European Union’s Horizon 2020 research and innovation programme
+(grant agreement No 725899).
+*/
+#pragma once
+
+#include "algorithms/TransitionTable.hpp"
+#include "data/FluidIndex.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace fluid {
+namespace algorithm {
+
+// Where the walk goes when it can't jump, worked out at analysis so that the
+// audio thread never scans. The frames with links under a threshold are
+// those whose nearest link is under it; since the threshold is a playback
+// parameter, the nearest link distances are kept in a min-tree and the next
+// such frame is found in at most two descents of it. The next frame of the
+// same cluster is a plain table.
+class SuccessorTable {
+
+public:
+  void init(const TransitionTable& table) {
+    mLength = table.size();
+    mLeaves = 1;
+    while (mLeaves < mLength) mLeaves *= 2;
+    mTree.assign(2 * mLeaves, std::numeric_limits<float>::infinity());
+    for (index i = 0; i < mLength; i++)
+      if (table.degree(i, TransitionTable::kMaxDistance) > 0)
+        mTree[asUnsigned(mLeaves + i)] =
+            static_cast<float>(table.distance(i, 0));
+    for (index i = mLeaves - 1; i > 0; i--)
+      mTree[asUnsigned(i)] =
+          std::min(mTree[asUnsigned(2 * i)], mTree[asUnsigned(2 * i + 1)]);
+    mNextInCluster.clear();
+  }
+
+  // labels(i) is the cluster of frame i, from 0 to numClusters - 1
+  template <typename Labels>
+  void setClusters(const Labels& labels, index numClusters) {
+    mNextInCluster.assign(asUnsigned(mLength), 0);
+    std::vector<std::int32_t> next(asUnsigned(numClusters), -1);
+    // two passes backwards, so that the last frames see the first ones
+    for (index i = 2 * mLength - 1; i >= 0; i--) {
+      index  frame = i % mLength;
+      auto&  found = next[asUnsigned(labels(frame))];
+      if (i < mLength)
+        mNextInCluster[asUnsigned(frame)] =
+            found >= 0 && found != frame
+                ? found
+                : static_cast<std::int32_t>((frame + 1) % mLength);
+      found = static_cast<std::int32_t>(frame);
+    }
+  }
+
+  // first frame from frame on, wrapping around, with a link under
+  // threshold; -1 if there is none
+  index nextLinked(index frame, double threshold) const {
+    if (mLength == 0) return -1;
+    float limit = static_cast<float>(threshold);
+    index found = firstBelow(frame, limit);
+    return found >= 0 ? found : firstBelow(0, limit);
+  }
+
+  // next frame of frame's cluster, wrapping around; the next frame for a
+  // cluster of one
+  index nextInCluster(index frame) const {
+    if (mNextInCluster.empty()) return (frame + 1) % mLength;
+    return mNextInCluster[asUnsigned(frame)];
+  }
+
+private:
+  static size_t asUnsigned(index x) { return static_cast<size_t>(x); }
+
+  index firstBelow(index from, float limit) const {
+    index node = mLeaves + from;
+    if (mTree[asUnsigned(node)] < limit) return from;
+    // up until a right sibling holds a frame under the limit
+    while (node > 1) {
+      if (node % 2 == 0 && mTree[asUnsigned(node + 1)] < limit) {
+        node++;
+        break;
+      }
+      node /= 2;
+    }
+    if (node == 1) return -1;
+    // down to its first such frame
+    while (node < mLeaves)
+      node = mTree[asUnsigned(2 * node)] < limit ? 2 * node : 2 * node + 1;
+    return node - mLeaves;
+  }
+
+  index                     mLength{0};
+  index                     mLeaves{1};
+  std::vector<float>        mTree;
+  std::vector<std::int32_t> mNextInCluster;
+};
+
+} // namespace algorithm
+} // namespace fluid
@@ -0,0 +1,163 @@
+/*
+Part of the Fluid Corpus Manipulation Project (http://www.flucoma.org/)
+Copyright 2017-2019 University of Huddersfield.
+Licensed under the BSD-3 License.
+See license.md file in the project root for full license information.
+This project has received funding from the European Research Council (ERC)
+under the European Union’s Horizon 2020 research and innovation programme
+(grant agreement No 725899).
+*/
+#pragma once
+
+#include "algorithms/DistanceBand.hpp"
+#include "data/FluidIndex.hpp"
+#include "data/TensorTypes.hpp"
+#include <Eigen/Core>
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <queue>
+#include <utility>
+#include <vector>
+
+namespace fluid {
+namespace algorithm {
+
+// How the graph of a distance matrix changes with the threshold, at evenly
+// spaced thresholds from 0 to 1: links (pairs of frames closer than the
+// threshold), mean links per frame, the fraction of frames without any
+// (dead ends) and the number of connected components. One pass over the
+// matrix builds its minimum spanning tree (Prim): two frames are connected
+// under a threshold exactly when the tree path between them is, so the
+// components are the frames minus the tree edges under it, as union-find
+// over the sorted links would find, without storing the links. The same
+// pass buckets every pair and each frame's nearest distance by threshold.
+class ThresholdSweep {
+
+public:
+  enum Curve {
+    kThreshold,
+    kLinks,
+    kMeanDegree,
+    kDeadEnds,
+    kComponents,
+    kNumCurves
+  };
+
+  // out has kNumCurves rows and one column per threshold, at least two
+  void process(const Eigen::Ref<const Eigen::MatrixXd>& dm,
+               RealMatrixView out) {
+    index n = dm.rows();
+    index steps = out.cols();
+    reset(n, steps);
+    for (index added = 0; added < n; added++) {
+      // the frame closest to the tree joins it, by the edge it was found by
+      index u = -1;
+      for (index v = 0; v < n; v++)
+        if (!mInTree[asUnsigned(v)] && (u < 0 || mKey[asUnsigned(v)] <
+                                                     mKey[asUnsigned(u)]))
+          u = v;
+      join(dm, u, 0, n, added > 0, steps);
+    }
+    curves(n, out);
+  }
+
+  // the same on a band, whose pairs further apart are never linked: the
+  // frames waiting to join are kept in a heap, so the pass is O(N W log N)
+  void process(const DistanceBand& dm, RealMatrixView out) {
+    using Candidate = std::pair<double, index>;
+    index n = dm.rows();
+    index steps = out.cols();
+    reset(n, steps);
+    std::priority_queue<Candidate, std::vector<Candidate>,
+                        std::greater<Candidate>>
+          waiting;
+    index next = 0;
+    for (index added = 0; added < n; added++) {
+      index u = -1;
+      while (!waiting.empty() && u < 0) {
+        if (!mInTree[asUnsigned(waiting.top().second)])
+          u = waiting.top().second;
+        waiting.pop();
+      }
+      // none left within reach of the tree: a new one starts
+      while (u < 0 && mInTree[asUnsigned(next)]) next++;
+      if (u < 0) u = next;
+      join(dm, u, dm.first(u), dm.last(u), added > 0, steps);
+      for (index v = dm.first(u); v < dm.last(u); v++)
+        if (!mInTree[asUnsigned(v)] && dm(u, v) <= mKey[asUnsigned(v)])
+          waiting.emplace(dm(u, v), v);
+    }
+    curves(n, out);
+  }
+
+  static double threshold(index k, index steps) {
+    return static_cast<double>(k) / (steps - 1);
+  }
+
+private:
+  static size_t asUnsigned(index x) { return static_cast<size_t>(x); }
+
+  void reset(index n, index steps) {
+    mLinks.assign(asUnsigned(steps + 1), 0);
+    mLive.assign(asUnsigned(steps + 1), 0);
+    mJoins.assign(asUnsigned(steps + 1), 0);
+    mKey.assign(asUnsigned(n), std::numeric_limits<double>::infinity());
+    mInTree.assign(asUnsigned(n), false);
+  }
+
+  // adds u to the tree and buckets its pairs with the frames [lo, hi), the
+  // only ones it may be linked to
+  template <typename Distances>
+  void join(const Distances& dm, index u, index lo, index hi, bool joined,
+            index steps) {
+    mInTree[asUnsigned(u)] = true;
+    if (joined) mJoins[asUnsigned(first(mKey[asUnsigned(u)], steps))]++;
+    double nearest = std::numeric_limits<double>::infinity();
+    for (index v = lo; v < hi; v++) {
+      if (v == u) continue;
+      double d = dm(u, v);
+      nearest = std::min(nearest, d);
+      if (mInTree[asUnsigned(v)]) continue;
+      // each pair is seen here once, from whichever joins first
+      mLinks[asUnsigned(first(d, steps))]++;
+      mKey[asUnsigned(v)] = std::min(mKey[asUnsigned(v)], d);
+    }
+    mLive[asUnsigned(first(nearest, steps))]++;
+  }
+
+  void curves(index n, RealMatrixView out) {
+    index  steps = out.cols();
+    double links = 0, live = 0, joins = 0;
+    for (index k = 0; k < steps; k++) {
+      links += mLinks[asUnsigned(k)];
+      live += mLive[asUnsigned(k)];
+      joins += mJoins[asUnsigned(k)];
+      out(kThreshold, k) = threshold(k, steps);
+      out(kLinks, k) = links;
+      out(kMeanDegree, k) = n > 0 ? 2 * links / n : 0;
+      out(kDeadEnds, k) = n > 0 ? (n - live) / n : 0;
+      out(kComponents, k) = n - joins;
+    }
+  }
+
+  // first threshold that d is under; steps if none
+  static index first(double d, index steps) {
+    if (!(d < 1)) return steps;
+    index k = std::max(static_cast<index>(std::floor(d * (steps - 1))) + 1,
+                       index(0));
+    while (k > 0 && d < threshold(k - 1, steps)) k--;
+    while (k < steps && !(d < threshold(k, steps))) k++;
+    return k;
+  }
+
+  std::vector<double> mLinks;
+  std::vector<double> mLive;
+  std::vector<double> mJoins;
+  std::vector<double> mKey;
+  std::vector<bool>   mInTree;
+};
+
+} // namespace algorithm
+} // namespace fluid
@@ -0,0 +1,208 @@
+/*
+Part of the Fluid Corpus Manipulation Project (http://www.flucoma.org/)
+Copyright 2017-2019 University of Huddersfield.
+Licensed under the BSD-3 License.
+See license.md file in the project root for full license information.
+This project has received funding from the European Research Council (ERC)
+under the European Union’s Horizon 2020 research and innovation programme
+(grant agreement No 725899).
+*/
+#pragma once
+
+#include "algorithms/BitMatrix.hpp"
+#include "algorithms/CrossNeighbours.hpp"
+#include "algorithms/DistanceBand.hpp"
+#include "data/FluidIndex.hpp"
+#include <Eigen/Core>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <numeric>
+#include <vector>
+
+namespace fluid {
+namespace algorithm {
+
+// Per-frame neighbour lists sorted by distance, with the log of each link's
+// similarity packed alongside. Links under a given threshold are always a
+// prefix of the list, so changing the threshold costs a binary search per
+// lookup instead of a rebuild.
+// Weights are (1 - distance)^(1 / temperature): 1 gives the original
+// similarity weighting, lower values favour the nearest frames and higher
+// values flatten towards uniform. They are worked out from the logs when a
+// jump is drawn at the walk's temperature, so the table is not written once
+// built and a temperature change rebuilds nothing. maxLinks > 0 keeps only
+// that many nearest links per frame, for a compact graph.
+class TransitionTable {
+
+public:
+  static constexpr double kMaxDistance = 1.0;
+
+  // allowed(i, j) > 0 for links that may be followed
+  template <typename Distances, typename Allowed>
+  void init(const Distances& dm, const Allowed& allowed, index maxLinks = 0) {
+    build(dm.rows(), maxLinks, [&](index i, auto&& f) {
+      for (index j = 0; j < dm.rows(); j++)
+        if (j != i && allowed(i, j) > 0) f(j, dm(i, j));
+    });
+  }
+
+  // only the set entries of each row of allowed are visited
+  template <typename Distances>
+  void init(const Distances& dm, const BitMatrix& allowed,
+            index maxLinks = 0) {
+    build(dm.rows(), maxLinks, [&](index i, auto&& f) {
+      allowed.forEachSet(i, [&](index j) {
+        if (j != i) f(j, dm(i, j));
+      });
+    });
+  }
+
+  // only the frames within the band of each frame are visited
+  template <typename Allowed>
+  void init(const DistanceBand& dm, const Allowed& allowed,
+            index maxLinks = 0) {
+    build(dm.rows(), maxLinks, [&](index i, auto&& f) {
+      for (index j = dm.first(i); j < dm.last(i); j++)
+        if (j != i && allowed(i, j) > 0) f(j, dm(i, j));
+    });
+  }
+
+  // links from each target frame to its nearest corpus frames, numbered
+  // from 0 in the corpus
+  void init(const CrossNeighbours& cross, index maxLinks = 0) {
+    build(cross.rows(), maxLinks, [&](index i, auto&& f) {
+      for (index k = 0; k < cross.size(); k++)
+        f(cross.neighbour(i, k), cross.distance(i, k));
+    });
+  }
+
+  index size() const {
+    return mOffsets.empty() ? 0 : asSigned(mOffsets.size()) - 1;
+  }
+
+  // number of links from frame with distance below threshold
+  index degree(index frame, double threshold) const {
+    auto first = mDistances.begin() + mOffsets[frame];
+    auto last = mDistances.begin() + mOffsets[frame + 1];
+    return std::lower_bound(first, last, static_cast<float>(threshold)) -
+           first;
+  }
+
+  // k-th nearest linked frame
+  index neighbour(index frame, index k) const {
+    return mIds[mOffsets[frame] + k];
+  }
+
+  double distance(index frame, index k) const {
+    return mDistances[mOffsets[frame] + k];
+  }
+
+  // weight of the k-th link at temperature, relative to the nearest one
+  double weight(index frame, index k, double temperature) const {
+    return relativeWeight(mLogWeights.data() + mOffsets[frame],
+                          exponent(temperature), 0, k);
+  }
+
+  // position in the row (< degree) drawn from the weights, with uniform()
+  // giving draws in [0, 1). The prefix is split in blocks [0, 1), [1, 2),
+  // [2, 4), ... each bounded by the weight of its first link: a block is
+  // drawn from the bounds, a link within it, and the link kept with the
+  // ratio of its weight to the bound. Weights decrease along the row, so
+  // each bound is at most twice the weight of the block before and at
+  // least a third of the draws are kept, at O(log degree) per draw at any
+  // temperature. After kMaxRejections draws, at odds below 1e-11, the
+  // nearest link is taken.
+  template <typename Uniform>
+  index sample(index frame, index degree, double temperature,
+               Uniform&& uniform) const {
+    const float* logWeights = mLogWeights.data() + mOffsets[frame];
+    double       e = exponent(temperature);
+    double       bounds[kMaxBlocks];
+    index        blocks = 0;
+    double       total = 0;
+    for (index lo = 0; lo < degree; lo = blockEnd(lo, degree)) {
+      bounds[blocks] =
+          (blockEnd(lo, degree) - lo) * relativeWeight(logWeights, e, 0, lo);
+      total += bounds[blocks++];
+    }
+    for (index draw = 0; draw < kMaxRejections; draw++) {
+      double target = total * uniform();
+      index  lo = 0;
+      for (index b = 0; b < blocks - 1 && target >= bounds[b]; b++) {
+        target -= bounds[b];
+        lo = blockEnd(lo, degree);
+      }
+      index hi = blockEnd(lo, degree);
+      index k = std::min(lo + static_cast<index>(uniform() * (hi - lo)),
+                         hi - 1);
+      if (uniform() < relativeWeight(logWeights, e, lo, k)) return k;
+    }
+    return 0;
+  }
+
+private:
+  static constexpr index kMaxBlocks = 64;
+  static constexpr index kMaxRejections = 64;
+
+  static index asSigned(size_t x) { return static_cast<index>(x); }
+
+  static index blockEnd(index lo, index degree) {
+    return std::min(lo > 0 ? 2 * lo : index(1), degree);
+  }
+
+  static double exponent(double temperature) {
+    return 1.0 / std::max(temperature, 1e-3);
+  }
+
+  // weight of link k over that of link from, at most 1 for k >= from
+  static double relativeWeight(const float* logWeights, double exponent,
+                               index from, index k) {
+    return std::exp(exponent * (logWeights[k] - logWeights[from]));
+  }
+
+  // forEachLink(i, f) calls f(j, distance) for each link i -> j that may be
+  // followed; those at kMaxDistance or further are left out
+  template <typename RowFunc>
+  void build(index n, index maxLinks, RowFunc forEachLink) {
+    mOffsets.assign(n + 1, 0);
+    for (index i = 0; i < n; i++) {
+      index count = 0;
+      forEachLink(i, [&](index, double d) {
+        if (d < kMaxDistance) count++;
+      });
+      if (maxLinks > 0) count = std::min(count, maxLinks);
+      mOffsets[i + 1] = mOffsets[i] + count;
+    }
+    mIds.resize(mOffsets[n]);
+    mDistances.resize(mOffsets[n]);
+    mLogWeights.resize(mOffsets[n]);
+    std::vector<std::pair<float, std::int32_t>> row;
+    row.reserve(n);
+    for (index i = 0; i < n; i++) {
+      row.clear();
+      forEachLink(i, [&](index j, double d) {
+        if (d < kMaxDistance)
+          row.emplace_back(static_cast<float>(d),
+                           static_cast<std::int32_t>(j));
+      });
+      index count = mOffsets[i + 1] - mOffsets[i];
+      std::partial_sort(row.begin(), row.begin() + count, row.end());
+      for (index k = 0; k < count; k++) {
+        mDistances[mOffsets[i] + k] = row[k].first;
+        mIds[mOffsets[i] + k] = row[k].second;
+        // distances under kMaxDistance keep the log finite
+        mLogWeights[mOffsets[i] + k] =
+            static_cast<float>(std::log1p(-row[k].first));
+      }
+    }
+  }
+
+  std::vector<index>        mOffsets;
+  std::vector<std::int32_t> mIds;
+  std::vector<float>        mDistances;
+  std::vector<float>        mLogWeights;
+};
+
+} // namespace algorithm
+} // namespace fluid
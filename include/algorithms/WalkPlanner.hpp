@@ -0,0 +1,138 @@
+/*
+Part of the Fluid Corpus Manipulation Project (http://www.flucoma.org/)
+Copyright 2017-2019 University of Huddersfield.
+Licensed under the BSD-3 License.
+See license.md file in the project root for full license information.
+This project has received funding from the European Research Council (ERC)
+under the European Union’s Horizon 2020 research and innovation programme
+(grant agreement No 725899).
+*/
+#pragma once
+
+#include "algorithms/SPSCQueue.hpp"
+#include "data/FluidIndex.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <thread>
+
+namespace fluid {
+namespace algorithm {
+
+// Walks a graph ahead of playback on its own thread, which runs at normal
+// priority below the audio thread. The audio thread sends the walk
+// parameters with update() and takes planned frames with next(); an update
+// flushes the frames planned with older parameters and restarts the walk
+// from the frame being played. step and moveTo only run on the planner
+// thread, so the walk state they touch must not be used by the audio thread
+// while the planner is running; pause() parks the planner so that the walk
+// can be swapped.
+template <typename Params>
+class WalkPlanner {
+
+public:
+  using StepFunc = std::function<index(const Params&)>;
+  using MoveFunc = std::function<void(index)>;
+
+  WalkPlanner(index lookAhead, StepFunc step, MoveFunc moveTo)
+      : mStep(step), mMoveTo(moveTo), mFrames(lookAhead) {
+    mThread = std::thread([this]() { run(); });
+  }
+
+  WalkPlanner(const WalkPlanner&) = delete;
+  WalkPlanner& operator=(const WalkPlanner&) = delete;
+
+  ~WalkPlanner() {
+    mState.store(kStopped, std::memory_order_release);
+    mThread.join();
+  }
+
+  // audio thread: new parameters, playing from frame; false (and nothing
+  // changed) if the planner has not taken the previous updates yet
+  bool update(const Params& params, index from) {
+    if (!mUpdates.push({params, from, mGeneration + 1})) return false;
+    mGeneration++;
+    return true;
+  }
+
+  // audio thread: next planned frame, false if the planner fell behind
+  bool next(index& frame) {
+    Planned planned;
+    while (mFrames.pop(planned)) {
+      if (planned.generation == mGeneration) {
+        frame = planned.frame;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // audio thread: true once the planner is parked and the walk may change
+  bool pause() {
+    int running = kRunning;
+    mState.compare_exchange_strong(running, kPauseRequested,
+                                   std::memory_order_acq_rel);
+    return mState.load(std::memory_order_acquire) == kParked;
+  }
+
+  void resume() { mState.store(kRunning, std::memory_order_release); }
+
+private:
+  enum State { kRunning, kPauseRequested, kParked, kStopped };
+
+  struct Update {
+    Params        params;
+    index         from;
+    std::uint32_t generation;
+  };
+
+  struct Planned {
+    index         frame;
+    std::uint32_t generation;
+  };
+
+  void run() {
+    Update current{};
+    bool   active = false;
+    while (true) {
+      int state = mState.load(std::memory_order_acquire);
+      if (state == kStopped) return;
+      if (state == kPauseRequested) {
+        mState.compare_exchange_strong(state, kParked,
+                                       std::memory_order_acq_rel);
+        continue;
+      }
+      if (state == kParked) {
+        idle();
+        continue;
+      }
+      Update update;
+      while (mUpdates.pop(update)) {
+        current = update;
+        active = true;
+        mMoveTo(update.from);
+      }
+      if (!active || mFrames.full()) {
+        idle();
+        continue;
+      }
+      mFrames.push({mStep(current.params), current.generation});
+    }
+  }
+
+  static void idle() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  StepFunc               mStep;
+  MoveFunc               mMoveTo;
+  SPSCQueue<Update>      mUpdates{16};
+  SPSCQueue<Planned>     mFrames;
+  std::uint32_t          mGeneration{0}; // audio thread only
+  std::atomic<int>       mState{kRunning};
+  std::thread            mThread;
+};
+
+} // namespace algorithm
+} // namespace fluid
@@ -0,0 +1,139 @@
+/*
+Part of the Fluid Corpus Manipulation Project (http://www.flucoma.org/)
+Copyright 2017-2019 University of Huddersfield.
+Licensed under the BSD-3 License.
+See license.md file in the project root for full license information.
+This project has received funding from the European Research Council (ERC)
+under the European Union’s Horizon 2020 research and innovation programme
+(grant agreement No 725899).
+*/
+#pragma once
+
+#include "algorithms/GraphLoop.hpp"
+#include "algorithms/GraphRender.hpp"
+#include "clients/BufferSource.hpp"
+#include "clients/common/BufferAdaptor.hpp"
+#include "clients/common/FluidBaseClient.hpp"
+#include "clients/common/FluidNRTClientWrapper.hpp"
+#include "clients/common/ParameterConstraints.hpp"
+#include "clients/common/ParameterSet.hpp"
+#include "clients/common/ParameterTypes.hpp"
+#include "clients/nrt/NRTClient.hpp"
+#include <clients/common/Result.hpp>
+
+namespace fluid {
+namespace client {
+namespace bufgraphloop {
+
+enum BufGraphLoopParamIndex {
+  kSourceBuf,
+  kNumBands,
+  kMaxJump,
+  kThreshold,
+  kQuant,
+  kStart,
+  kEnd,
+  kRank,
+  kDuration,
+  kDestination,
+  kFramePath,
+  kFFT
+};
+
+constexpr auto BufGraphLoopParams = defineParameters(
+    InputBufferParam("source", "Source Buffer"),
+    LongParam("numBands", "Number of Mel bands", 64),
+    LongParam("maxJumpDistance", "Max jump distance (frames, 0: any)", 0,
+              Min(0)),
+    FloatParam("threshold", "Threshold", 0.3, Min(0), Max(1.0)),
+    EnumParam("quantize", "Quantize", 0, "No", "Yes"),
+    FloatParam("start", "start point", 0, Min(0), Max(1), UpperLimit<kEnd>()),
+    FloatParam("end", "end point", 1, Min(0), Max(1), LowerLimit<kStart>()),
+  LongParam("rank", "Loop alternative", 0, Min(0),
+            Max(algorithm::LoopCatalogue::kAlternatives - 1)),
+    LongParam("duration", "Output duration (samples)", -1),
+    BufferParam("destination", "Destination Buffer"),
+    BufferParam("framePath", "Frame path buffer"),
+    FFTParam("fftSettings", "FFT Settings", 1024, -1, -1));
+
+class BufGraphLoopClient : public FluidBaseClient,
+                           public OfflineIn,
+                           public OfflineOut {
+public:
+  using ParamDescType = decltype(BufGraphLoopParams);
+  using ParamSetViewType = ParameterSetView<ParamDescType>;
+  std::reference_wrapper<ParamSetViewType> mParams;
+
+  void setParams(ParamSetViewType& p) { mParams = p; }
+
+  template <size_t N> auto& get() const {
+    return mParams.get().template get<N>();
+  }
+
+  static constexpr auto& getParameterDescriptors() {
+    return BufGraphLoopParams;
+  }
+
+  BufGraphLoopClient(ParamSetViewType& p) : mParams{p} {}
+
+  template <typename T> Result process(FluidContext& c) {
+    using namespace algorithm;
+    auto source = BufferAdaptor::ReadAccess(get<kSourceBuf>().get());
+    if (!source.exists())
+      return {Result::Status::kError, "Source Buffer Supplied But Invalid"};
+    if (!get<kDestination>())
+      return {Result::Status::kError, "No destination buffer"};
+    index srcFrames = source.numFrames();
+    if (srcFrames <= 0)
+      return {Result::Status::kError, "Empty source buffer"};
+    double sampleRate = source.sampleRate();
+    BufferSource sourceAudio{source};
+
+    index duration = get<kDuration>() > 0 ? get<kDuration>() : srcFrames;
+    index numHops = GraphRender::numHops(duration, get<kFFT>().hopSize());
+
+    GraphLoop model;
+    RealVector outputData(4);
+    model.init(sourceAudio, sampleRate, get<kFFT>().winSize(),
+               get<kFFT>().fftSize(), get<kFFT>().hopSize(),
+               get<kNumBands>(), 7, get<kThreshold>(), get<kQuant>(),
+               outputData, get<kMaxJump>());
+    if (c.task() && c.task()->cancelled())
+      return {Result::Status::kCancelled, ""};
+
+    double start = get<kStart>();
+    double end = get<kEnd>();
+    index  rank = get<kRank>();
+    // the loop walk is deterministic, so only one variation is rendered
+    RealMatrix audio(1, duration);
+    RealMatrix path(1, numHops);
+    GraphRender render;
+    render.process(
+        model, -1, 1,
+        [=](GraphLoop& algorithm, ComplexVectorView out, RealVectorView info) {
+          algorithm.processFrame(out, start, end, rank, info);
+        },
+        audio, path);
+
+    auto dest = BufferAdaptor::Access(get<kDestination>().get());
+    Result resizeResult = dest.resize(duration, 1, sampleRate);
+    if (!resizeResult.ok()) return resizeResult;
+    dest.samps(0) = audio.row(0);
+
+    if (get<kFramePath>()) {
+      auto pathBuf = BufferAdaptor::Access(get<kFramePath>().get());
+      resizeResult =
+          pathBuf.resize(numHops, 1, sampleRate / get<kFFT>().hopSize());
+      if (!resizeResult.ok()) return resizeResult;
+      pathBuf.samps(0) = path.row(0);
+    }
+    return {Result::Status::kOk, ""};
+  }
+};
+} // namespace bufgraphloop
+
+using NRTThreadedBufGraphLoopClient =
+    NRTThreadingAdaptor<ClientWrapper<bufgraphloop::BufGraphLoopClient>>;
+
+} // namespace client
+} // namespace fluid
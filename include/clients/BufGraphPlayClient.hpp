@@ -0,0 +1,178 @@
+/*
+Part of the Fluid Corpus Manipulation Project (http://www.flucoma.org/)
+Copyright 2017-2019 University of Huddersfield.
+Licensed under the BSD-3 License.
+See license.md file in the project root for full license information.
+This project has received funding from the European Research Council (ERC)
+under the European Union’s Horizon 2020 research and innovation programme
+(grant agreement No 725899).
+*/
+#pragma once
+
+#include "algorithms/GraphPlay.hpp"
+#include "algorithms/GraphRender.hpp"
+#include "clients/BufferSource.hpp"
+#include "clients/common/BufferAdaptor.hpp"
+#include "clients/common/FluidBaseClient.hpp"
+#include "clients/common/FluidNRTClientWrapper.hpp"
+#include "clients/common/ParameterConstraints.hpp"
+#include "clients/common/ParameterSet.hpp"
+#include "clients/common/ParameterTypes.hpp"
+#include "clients/nrt/NRTClient.hpp"
+#include <clients/common/Result.hpp>
+#include <thread>
+
+namespace fluid {
+namespace client {
+namespace bufgraphplay {
+
+enum BufGraphPlayParamIndex {
+  kSourceBuf,
+  kCorpusBuf,
+  kNumBands,
+  kSegmentSize,
+  kCoarseNeighbours,
+  kSearch,
+  kMaxJump,
+  kThreshold,
+  kMinDur,
+  kMinDist,
+  kForget,
+  kRand,
+  kTemperature,
+  kPolicy,
+  kJumps,
+  kStart,
+  kDuration,
+  kSeed,
+  kNumVariations,
+  kDestination,
+  kFramePath,
+  kFFT
+};
+
+constexpr auto BufGraphPlayParams = defineParameters(
+    InputBufferParam("source", "Source Buffer"),
+    InputBufferParam("corpus", "Corpus Buffer"),
+    LongParam("numBands", "Number of Mel bands", 64),
+    LongParam("segmentSize", "Coarse segment size (frames)", 1, Min(1)),
+    LongParam("coarseNeighbours", "Segments refined per segment", 8, Min(1)),
+    EnumParam("search", "Segment search", 0, "Exact", "Compressed"),
+    LongParam("maxJumpDistance", "Max jump distance (frames, 0: any)", 0,
+              Min(0)),
+    FloatParam("threshold", "Threshold", 0.3, Min(0), Max(1.0)),
+    LongParam("minDur", "Min duration (frames)", 10, Min(1)),
+    LongParam("minDist", "Min distance (frames)", 10, Min(1)),
+    LongParam("forget", "Forget time (frames)", 1, Min(1)),
+    FloatParam("randomness", "Randomness", 0.1, Min(0), Max(1.0)),
+    FloatParam("temperature", "Temperature", 1, Min(0.01)),
+    EnumParam("policy", "Walk policy", 3, "Nearest", "Rank random",
+              "Probability", "Uniform"),
+    EnumParam("jumps", "Jump resolution", 0, "Frame", "Segment"),
+    FloatParam("start", "Start point", 0, Min(0), Max(1)),
+    LongParam("duration", "Output duration (samples)", -1),
+    LongParam("seed", "Random seed", -1),
+    LongParam("numVariations", "Number of variations", 1, Min(1)),
+    BufferParam("destination", "Destination Buffer"),
+    BufferParam("framePath", "Frame path buffer"),
+    FFTParam("fftSettings", "FFT Settings", 2048, 512, -1));
+
+class BufGraphPlayClient : public FluidBaseClient,
+                           public OfflineIn,
+                           public OfflineOut {
+public:
+  using ParamDescType = decltype(BufGraphPlayParams);
+  using ParamSetViewType = ParameterSetView<ParamDescType>;
+  std::reference_wrapper<ParamSetViewType> mParams;
+
+  void setParams(ParamSetViewType& p) { mParams = p; }
+
+  template <size_t N> auto& get() const {
+    return mParams.get().template get<N>();
+  }
+
+  static constexpr auto& getParameterDescriptors() {
+    return BufGraphPlayParams;
+  }
+
+  BufGraphPlayClient(ParamSetViewType& p) : mParams{p} {}
+
+  template <typename T> Result process(FluidContext& c) {
+    using namespace algorithm;
+    auto source = BufferAdaptor::ReadAccess(get<kSourceBuf>().get());
+    if (!source.exists())
+      return {Result::Status::kError, "Source Buffer Supplied But Invalid"};
+    if (!get<kDestination>())
+      return {Result::Status::kError, "No destination buffer"};
+    index srcFrames = source.numFrames();
+    if (srcFrames <= 0)
+      return {Result::Status::kError, "Empty source buffer"};
+    double sampleRate = source.sampleRate();
+    BufferSource sourceAudio{source};
+    // with a corpus, the source is linked to it instead of to itself
+    auto corpus = BufferAdaptor::ReadAccess(get<kCorpusBuf>().get());
+    if (corpus.exists() && corpus.numFrames() <= 0)
+      return {Result::Status::kError, "Empty corpus buffer"};
+    BufferSource corpusAudio{corpus};
+
+    index duration = get<kDuration>() > 0 ? get<kDuration>() : srcFrames;
+    index numVariations = get<kNumVariations>();
+    index numHops = GraphRender::numHops(duration, get<kFFT>().hopSize());
+
+    GraphPlay model;
+    RealVector outputData(1);
+    model.init(sourceAudio, sampleRate, get<kFFT>().winSize(),
+               get<kFFT>().fftSize(), get<kFFT>().hopSize(),
+               get<kNumBands>(), 7, get<kThreshold>(), get<kSegmentSize>(),
+               get<kCoarseNeighbours>(), outputData, 0, get<kSearch>() == 1,
+               get<kMaxJump>(), corpus.exists() ? &corpusAudio : nullptr);
+    if (c.task() && c.task()->cancelled())
+      return {Result::Status::kCancelled, ""};
+
+    double start = get<kStart>();
+    double threshold = get<kThreshold>();
+    index minDur = get<kMinDur>();
+    index minDist = get<kMinDist>();
+    index forget = get<kForget>();
+    double rand = get<kRand>();
+    double temperature = get<kTemperature>();
+    bool segmentJumps = get<kJumps>() == 1;
+    RealMatrix audio(numVariations, duration);
+    RealMatrix path(numVariations, numHops);
+    GraphRender render;
+    dispatchWalkPolicy(get<kPolicy>(), [&](auto policy) {
+      using Policy = decltype(policy);
+      render.process(
+          model, get<kSeed>(), std::thread::hardware_concurrency(),
+          [=](GraphPlay& algorithm, ComplexVectorView out,
+              RealVectorView info) {
+            algorithm.template processFrame<Policy>(
+                out, start, threshold, minDur, minDist, forget, rand,
+                temperature, segmentJumps, info);
+          },
+          audio, path);
+    });
+
+    auto dest = BufferAdaptor::Access(get<kDestination>().get());
+    Result resizeResult = dest.resize(duration, numVariations, sampleRate);
+    if (!resizeResult.ok()) return resizeResult;
+    for (index v = 0; v < numVariations; v++) dest.samps(v) = audio.row(v);
+
+    if (get<kFramePath>()) {
+      auto pathBuf = BufferAdaptor::Access(get<kFramePath>().get());
+      resizeResult = pathBuf.resize(numHops, numVariations,
+                                    sampleRate / get<kFFT>().hopSize());
+      if (!resizeResult.ok()) return resizeResult;
+      for (index v = 0; v < numVariations; v++)
+        pathBuf.samps(v) = path.row(v);
+    }
+    return {Result::Status::kOk, ""};
+  }
+};
+} // namespace bufgraphplay
+
+using NRTThreadedBufGraphPlayClient =
+    NRTThreadingAdaptor<ClientWrapper<bufgraphplay::BufGraphPlayClient>>;
+
+} // namespace client
+} // namespace fluid
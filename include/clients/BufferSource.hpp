@@ -0,0 +1,46 @@
+/*
+Part of the Fluid Corpus Manipulation Project (http://www.flucoma.org/)
+Copyright 2017-2019 University of Huddersfield.
+Licensed under the BSD-3 License.
+See license.md file in the project root for full license information.
+This project has received funding from the European Research Council (ERC)
+under the European Union’s Horizon 2020 research and innovation programme
+(grant agreement No 725899).
+*/
+#pragma once
+
+#include "algorithms/AudioSource.hpp"
+#include "clients/common/BufferAdaptor.hpp"
+#include <algorithm>
+
+namespace fluid {
+namespace client {
+
+// Reads one channel of a locked buffer on demand, so the graph analysis
+// works on hop-aligned chunks instead of a double copy of the whole source.
+// The ReadAccess has to outlive the analysis.
+class BufferSource : public algorithm::AudioSource {
+
+public:
+  BufferSource(BufferAdaptor::ReadAccess& buffer, index channel = 0)
+      : mBuffer(buffer), mChannel(channel) {}
+
+  index size() const override { return mBuffer.numFrames(); }
+
+  void read(index start, RealVectorView out) const override {
+    index first, length;
+    index offset = clip(start, out.size(), first, length);
+    std::fill(out.begin(), out.end(), 0);
+    if (length > 0) {
+      auto samples = mBuffer.samps(first, length, mChannel);
+      std::copy(samples.begin(), samples.end(), out.begin() + offset);
+    }
+  }
+
+private:
+  BufferAdaptor::ReadAccess& mBuffer;
+  index                      mChannel;
+};
+
+} // namespace client
+} // namespace fluid
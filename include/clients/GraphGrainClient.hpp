@@ -10,7 +10,10 @@ under the European Union’s Horizon 2020 research and innovation programme
 #pragma once
 
 #include "algorithms/GraphGrain.hpp"
+#include "algorithms/JumpCrossfade.hpp"
+#include "algorithms/WalkPlanner.hpp"
 #include "algorithms/public/MelBands.hpp"
+#include "clients/BufferSource.hpp"
 #include "clients/common/BufferAdaptor.hpp"
 #include "clients/common/BufferedProcess.hpp"
 #include "clients/common/FluidBaseClient.hpp"
@@ -20,6 +23,11 @@ under the European Union’s Horizon 2020 research and innovation programme
 #include "clients/common/ParameterTypes.hpp"
 #include "clients/nrt/NRTClient.hpp"
 #include <clients/common/Result.hpp>
+#include <atomic>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <tuple>
 
 namespace fluid {
 namespace client {
@@ -27,28 +35,56 @@ namespace graphgrain {
 
 enum GraphGrainParamIndex {
   kSourceBuf,
+  kCorpusBuf,
   kNumBands,
+  kSegmentSize,
+  kCoarseNeighbours,
+  kSearch,
+  kMaxJump,
   kThreshold,
   kNumClusters,
   kForget,
   kRand,
+  kTemperature,
+  kPolicy,
   kPhase,
   kStart,
   kOutputBuffer,
+  kLookAhead,
+  kMaxMemory,
+  kJumpTo,
+  kFade,
+  kSynthesisWindow,
   kFFT,
   kMaxFFTSize
 };
 
 constexpr auto GraphGrainParams = defineParameters(
     InputBufferParam("source", "Source Buffer"),
+    InputBufferParam("corpus", "Corpus Buffer"),
     LongParam("numBands", "Number of Mel bands", 64),
+    LongParam("segmentSize", "Coarse segment size (frames)", 1, Min(1)),
+    LongParam("coarseNeighbours", "Segments refined per segment", 8, Min(1)),
+    EnumParam("search", "Segment search", 0, "Exact", "Compressed"),
+    LongParam("maxJumpDistance", "Max jump distance (frames, 0: any)", 0,
+              Min(0)),
     FloatParam("threshold", "Threshold", 0.3, Min(0), Max(1.0)),
     LongParam("nClusters", "Number of clusters", 10, Min(0), Max(50)),
     LongParam("forgetfulness", "Forgetfulness", 100, Min(0)),
     FloatParam("randomness", "Randomness", 0.1, Min(0), Max(1.0)),
+    FloatParam("temperature", "Temperature", 1, Min(0.01)),
+    EnumParam("policy", "Walk policy", 1, "Nearest", "Rank random",
+              "Probability", "Uniform"),
     EnumParam("phase", "Phase generation", 1, "Original", "RTPGHI"),
     FloatParam("start", "Start point", 0, Min(0), Max(1)),
     BufferParam("outputBuffer", "Output buffer"),
+    LongParam<Fixed<true>>("lookAhead", "Frames planned ahead (0: off)", 0,
+                           Min(0)),
+    LongParam("maxMemory", "Memory budget (MB, 0: no limit)", 0, Min(0)),
+    EnumParam("jumpTo", "Trigger jumps to", 0, "Start", "Neighbour"),
+    LongParam("fade", "Jump crossfade (samples)", 64, Min(1)),
+    LongParam("synthesisWindow",
+              "Low-latency synthesis window (0: off)", 0, Min(0)),
     FFTParam<kMaxFFTSize>("fftSettings", "FFT Settings", 2048, 512, -1),
     LongParam<Fixed<true>>("maxFFTSize", "Maxiumm FFT Size", 16384, Min(4),
                            PowerOfTwo{}));
@@ -57,6 +93,19 @@ constexpr auto STFTParams = defineParameters(
     LongParam<Fixed<true>>("maxFFTSize", "Maxiumm FFT Size", 16384, Min(4),
                            PowerOfTwo{}));
 
+// walk parameters sent to the planner thread
+struct PlanParams {
+  double start, threshold, randomness, temperature;
+  index  forget, policy;
+
+  bool operator!=(const PlanParams &other) const {
+    return std::tie(start, threshold, randomness, temperature, forget,
+                    policy) != std::tie(other.start, other.threshold,
+                                        other.randomness, other.temperature,
+                                        other.forget, other.policy);
+  }
+};
+
 class GraphGrainClient : public FluidBaseClient, public AudioIn, AudioOut, ModelObject {
 public:
   using ParamDescType = decltype(GraphGrainParams);
@@ -80,17 +129,37 @@ public:
 
   GraphGrainClient(ParamSetViewType &p)
       : mParams{p}, mSTFTProcessor{get<kMaxFFTSize>(), 0, 1} {
-    audioChannelsIn(0);
+    // the playback STFTs are allocated here, not on the audio thread
+    mAlgorithm.preparePlayback(get<kMaxFFTSize>());
+    mNewAlgorithm.preparePlayback(get<kMaxFFTSize>());
+    // the input is a trigger for immediate jumps
+    audioChannelsIn(1);
     audioChannelsOut(1);
+    // with lookAhead the walk runs on a planner thread and the audio thread
+    // only plays the frames it queues
+    if (get<kLookAhead>() > 0)
+      mPlanner = std::make_unique<algorithm::WalkPlanner<PlanParams>>(
+          get<kLookAhead>(),
+          [this](const PlanParams &p) {
+            index frame = 0;
+            algorithm::dispatchWalkPolicy(p.policy, [&](auto policy) {
+              frame = mAlgorithm.template step<decltype(policy)>(
+                  p.start, p.threshold, p.forget, p.randomness,
+                  p.temperature);
+            });
+            return frame;
+          },
+          [this](index frame) { mAlgorithm.moveTo(frame); });
   }
 
-  index latency() { return get<kFFT>().winSize(); }
+  index latency() { return playbackFFT().winSize(); }
 
   void reset() { mSTFTProcessor.reset(); }
 
   MessageResult<void> analyze() {
+    if (pending())
+      return {Result::Status::kError, "Previous analysis not playing yet"};
     using namespace algorithm;
-    algorithm::GraphGrain newAlgoritm;
     auto source = BufferAdaptor::ReadAccess(get<kSourceBuf>().get());
     double sampleRate = source.sampleRate();
     if (!source.exists())
@@ -98,58 +167,326 @@ public:
     index srcFrames = source.numFrames();
     if (srcFrames <= 0)
       return {Result::Status::kError, "Empty source buffer"};
-    RealVector srcTmp{source.samps(0, srcFrames, 0)};
+    BufferSource sourceAudio{source};
+    // with a corpus, the source is linked to it instead of to itself
+    auto corpus = BufferAdaptor::ReadAccess(get<kCorpusBuf>().get());
+    index corpusFrames = corpus.exists() ? corpus.numFrames() : 0;
+    if (corpus.exists() && corpusFrames <= 0)
+      return {Result::Status::kError, "Empty corpus buffer"};
+    BufferSource corpusAudio{corpus};
+    // checked before anything is allocated
+    AnalysisEstimate plan = budget(srcFrames, corpusFrames);
+    if (!fits(plan))
+      return {Result::Status::kError,
+              "Analysis won't fit in maxMemory: " + plan.report(kModelCopies)};
 
     RealVector outputData(1);
     auto outBuf = BufferAdaptor::Access(get<kOutputBuffer>().get());
     bool validOutput = (outBuf.exists() && outBuf.numFrames() == 1);
 
-    newAlgoritm.init(srcTmp, sampleRate, get<kFFT>().winSize(),
-                     get<kFFT>().fftSize(), get<kFFT>().hopSize(),
-                     get<kNumBands>(), 7, get<kThreshold>(),
-                     get<kNumClusters>(), outputData);
-    mNewAlgorithm = newAlgoritm;
-    mNewAlgorithmReady = true;
+    mAnalysis.init(sourceAudio, sampleRate, get<kFFT>().winSize(),
+                   get<kFFT>().fftSize(), plan.hopSize(),
+                   get<kNumBands>(), 7, get<kThreshold>(),
+                   get<kNumClusters>(), get<kSegmentSize>(),
+                   get<kCoarseNeighbours>(), outputData, plan.maxLinks(),
+                   get<kSearch>() == 1, maxJump(plan.hopSize()),
+                   corpus.exists() ? &corpusAudio : nullptr);
+    mNewAlgorithm = mAnalysis;
+    mNewAlgorithmReady.store(true, std::memory_order_release);
+    if (plan.hopSize() != get<kFFT>().hopSize() || plan.maxLinks() > 0)
+      return {Result::Status::kWarning,
+              "Compact analysis to fit maxMemory: " +
+                  plan.report(kModelCopies)};
+    return OK();
+  }
+
+  // re-analyses the part of the source buffer from startFrame after it has
+  // been written to, with the settings of the last analysis; numFrames -1
+  // is to the end of the buffer
+  MessageResult<void> reanalyze(index startFrame, index numFrames) {
+    if (pending())
+      return {Result::Status::kError, "Previous analysis not playing yet"};
+    if (!mAnalysis.initialized())
+      return {Result::Status::kError, "No analysis"};
+    auto source = BufferAdaptor::ReadAccess(get<kSourceBuf>().get());
+    if (!source.exists())
+      return {Result::Status::kError, "Source Buffer Supplied But Invalid"};
+    if (numFrames < 0) numFrames = source.numFrames() - startFrame;
+    BufferSource sourceAudio{source};
+    std::string error;
+    if (!mAnalysis.update(sourceAudio, startFrame, numFrames, error))
+      return {Result::Status::kError, error};
+    mNewAlgorithm = mAnalysis;
+    mNewAlgorithmReady.store(true, std::memory_order_release);
+    return OK();
+  }
+
+  // projected size and time of analyze with the current settings
+  MessageResult<std::string> estimate() {
+    auto source = BufferAdaptor::ReadAccess(get<kSourceBuf>().get());
+    if (!source.exists())
+      return {Result::Status::kError, "Source Buffer Supplied But Invalid"};
+    auto corpus = BufferAdaptor::ReadAccess(get<kCorpusBuf>().get());
+    algorithm::AnalysisEstimate plan = budget(
+        source.numFrames(), corpus.exists() ? corpus.numFrames() : 0);
+    return plan.report(kModelCopies) +
+           (fits(plan) ? "" : ", over maxMemory");
+  }
+
+  // loads an analysis saved by write or by graph_analyze for the source buffer
+  MessageResult<void> read(std::string path) {
+    if (pending())
+      return {Result::Status::kError, "Previous analysis not playing yet"};
+    auto source = BufferAdaptor::ReadAccess(get<kSourceBuf>().get());
+    if (!source.exists())
+      return {Result::Status::kError, "Source Buffer Supplied But Invalid"};
+    if (source.numFrames() <= 0)
+      return {Result::Status::kError, "Empty source buffer"};
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return {Result::Status::kError, "Can't open " + path};
+    BufferSource sourceAudio{source};
+    std::string error;
+    if (!mAnalysis.read(in, sourceAudio, error))
+      return {Result::Status::kError, error};
+    mNewAlgorithm = mAnalysis;
+    mNewAlgorithmReady.store(true, std::memory_order_release);
+    return OK();
+  }
+
+  MessageResult<void> write(std::string path) {
+    if (!mAnalysis.initialized())
+      return {Result::Status::kError, "No analysis"};
+    if (mAnalysis.cross())
+      return {Result::Status::kError, "Analyses with a corpus are not saved"};
+    std::ofstream out(path, std::ios::binary);
+    if (!out || !mAnalysis.write(out))
+      return {Result::Status::kError, "Can't write " + path};
+    return OK();
+  }
+
+  // threshold, links, mean links per frame, fraction of dead ends and
+  // components of the analysis at steps thresholds from 0 to 1, one channel
+  // each and one frame per threshold
+  MessageResult<void> sweep(BufferPtr destination, index steps) {
+    if (!mAnalysis.initialized())
+      return {Result::Status::kError, "No analysis"};
+    if (mAnalysis.cross())
+      return {Result::Status::kError,
+              "No self-similarity graph with a corpus"};
+    if (steps < 2)
+      return {Result::Status::kError, "At least 2 steps needed"};
+    if (!destination)
+      return {Result::Status::kError, "No destination buffer"};
+    BufferAdaptor::Access buf(destination.get());
+    if (!buf.exists())
+      return {Result::Status::kError, "Destination buffer invalid"};
+    RealMatrix curves(algorithm::ThresholdSweep::kNumCurves, steps);
+    mAnalysis.sweep(curves);
+    Result resizeResult = buf.resize(steps, curves.rows(), buf.sampleRate());
+    if (!resizeResult.ok())
+      return {resizeResult.status(), resizeResult.message()};
+    for (index i = 0; i < curves.rows(); i++) buf.samps(i) = curves.row(i);
     return OK();
   }
 
+  MessageResult<std::string> stats() {
+    // a pending analysis may be swapped in at any moment, but mAnalysis is
+    // its copy and only changes on this thread
+    if (pending()) return mAnalysis.stats().report();
+    if (!mAlgorithm.initialized())
+      return {Result::Status::kError, "No analysis"};
+    return mAlgorithm.stats().report();
+  }
+
   template <typename T>
-  void process(std::vector<HostVector<T>> &, std::vector<HostVector<T>> &output,
-               FluidContext &c) {
+  void process(std::vector<HostVector<T>> &input,
+               std::vector<HostVector<T>> &output, FluidContext &c) {
     assert(audioChannelsOut() && "No control channels");
     assert(output.size() >= asUnsigned(audioChannelsOut()) &&
            "Too few output channels");
-    if (mNewAlgorithmReady) {
+    // the planner has to be parked before its walk is swapped
+    if (pending() && (!mPlanner || mPlanner->pause())) {
       std::swap(mAlgorithm, mNewAlgorithm);
-      mNewAlgorithmReady = false;
-      mSTFTParams.template get<0>() = FFTParams(
-          mAlgorithm.mWindowSize, mAlgorithm.mHopSize, mAlgorithm.mFFTSize);
+      mNewAlgorithmReady.store(false, std::memory_order_release);
+      mJump.reset();
+      mJumpFrom = -1;
+      if (mPlanner) {
+        mPlanned = planParams();
+        mPlanStale = !mPlanner->update(mPlanned, mAlgorithm.playing());
+        mPlanner->resume();
+      }
     }
 
     RealVector outputData(2);
     auto outBuf = BufferAdaptor::Access(get<kOutputBuffer>().get());
     bool validOutput = (outBuf.exists() && outBuf.numFrames() == 2);
-    mSTFTProcessor.processOutput(
-        mSTFTParams, output, c, [&](ComplexMatrixView out) {
-          if(mAlgorithm.initialized()){
-            mAlgorithm.processFrame(out.row(0), get<kStart>(), get<kThreshold>(),
-                                  get<kForget>(), get<kRand>(), get<kPhase>(),
-                                  outputData);
-            if (validOutput)  outBuf.samps(0) = outputData;
-            }
-        });
+    // playback runs at the current fftSettings or synthesisWindow; frames at
+    // a resolution other than the analysis one are cut from the source buffer
+    FFTParams playback = playbackFFT();
+    mSTFTParams.template get<0>() = playback;
+    auto source = BufferAdaptor::ReadAccess(get<kSourceBuf>().get());
+    BufferSource sourceAudio{source};
+    auto corpus = BufferAdaptor::ReadAccess(get<kCorpusBuf>().get());
+    BufferSource corpusAudio{corpus};
+    mAlgorithm.setPlayback(playback.winSize(), playback.fftSize(),
+                           playback.hopSize(),
+                           source.exists() ? &sourceAudio : nullptr,
+                           corpus.exists() ? &corpusAudio : nullptr);
+    algorithm::dispatchWalkPolicy(get<kPolicy>(), [&](auto policy) {
+      using Policy = decltype(policy);
+      mSTFTProcessor.processOutput(
+          mSTFTParams, output, c, [&](ComplexMatrixView out) {
+            if (mAlgorithm.initialized() && mPlanner) {
+              PlanParams params = planParams();
+              // a triggered jump restarts the plan until it delivers
+              index from = mJumpFrom >= 0 ? mJumpFrom : mAlgorithm.playing();
+              if ((mPlanStale || params != mPlanned) &&
+                  mPlanner->update(params, from)) {
+                mPlanned = params;
+                mPlanStale = false;
+              }
+              index frame = mAlgorithm.playing();
+              index hops = mAlgorithm.hopsDue();
+              for (index i = 0; i < hops; i++) {
+                if (!mPlanner->next(frame)) {
+                  // after an underrun the plan restarts from what was played
+                  mPlanStale = true;
+                  if (i == 0) frame = -1;
+                  break;
+                }
+                mJumpFrom = -1;
+              }
+              mAlgorithm.playFrame(out.row(0), frame, get<kPhase>(),
+                                   outputData);
+              if (validOutput) outBuf.samps(0) = outputData;
+            } else if (mAlgorithm.initialized()) {
+              mAlgorithm.template processFrame<Policy>(out.row(0),
+                  get<kStart>(), get<kThreshold>(), get<kForget>(),
+                  get<kRand>(), get<kTemperature>(), get<kPhase>(),
+                  outputData);
+              if (validOutput)  outBuf.samps(0) = outputData;
+              }
+          });
+    });
+    // triggers jump at the sample they arrive: the source itself plays from
+    // the target until the STFT output has caught up
+    if (mAlgorithm.initialized() && source.exists() && input.size() > 0 &&
+        input[0].data()) {
+      index hop = mAlgorithm.mHopSize;
+      index catchUp = playback.winSize() + playback.hopSize() +
+                      output[0].size();
+      mJump.setLengths(get<kFade>(), catchUp - get<kFade>());
+      mJump.process(input[0], output[0], sourceAudio, [&]() {
+        index frame = jumpTarget();
+        moveWalk(frame + playback.winSize() / hop);
+        return frame * hop;
+      });
+    }
+    mAlgorithm.setPlayback(playback.winSize(), playback.fftSize(),
+                           playback.hopSize(), nullptr);
   }
 
   static auto getMessageDescriptors() {
-    return defineMessages(makeMessage("analyze", &GraphGrainClient::analyze));
+    return defineMessages(makeMessage("analyze", &GraphGrainClient::analyze),
+                          makeMessage("reanalyze",
+                                      &GraphGrainClient::reanalyze),
+                          makeMessage("stats", &GraphGrainClient::stats),
+                          makeMessage("estimate", &GraphGrainClient::estimate),
+                          makeMessage("read", &GraphGrainClient::read),
+                          makeMessage("write", &GraphGrainClient::write),
+                          makeMessage("sweep", &GraphGrainClient::sweep));
   }
 
 private:
+  // the fftSettings, or with synthesisWindow a shorter playback window with
+  // their overlap; frames are then cut from the source buffer
+  FFTParams playbackFFT() const {
+    index window = std::min(get<kSynthesisWindow>(), get<kMaxFFTSize>());
+    if (window <= 0 || window >= get<kFFT>().winSize()) return get<kFFT>();
+    auto resolution = algorithm::lowLatencyResolution(
+        window, get<kFFT>().winSize(), get<kFFT>().hopSize());
+    return FFTParams(resolution.windowSize, resolution.hopSize,
+                     resolution.fftSize);
+  }
+
+  // the model being analysed, the one playing and the one waiting to swap
+  static constexpr index kModelCopies = 3;
+
+  // least compact analysis settings within maxMemory
+  algorithm::AnalysisEstimate budget(index numSamples,
+                                     index corpusSamples) const {
+    return algorithm::fitBudget(
+        get<kMaxMemory>() * 1e6, kModelCopies, get<kFFT>().hopSize(),
+        get<kFFT>().winSize(), [&](index hopSize, index maxLinks) {
+          return algorithm::GraphGrain::estimate(
+              numSamples, get<kFFT>().winSize(), get<kFFT>().fftSize(),
+              hopSize, get<kNumBands>(), get<kNumClusters>(),
+              get<kSegmentSize>(), get<kCoarseNeighbours>(), maxLinks,
+              maxJump(hopSize), corpusSamples);
+        });
+  }
+
+  // maxJumpDistance, given in frames of the configured hop, in frames of
+  // hopSize: the same span of time when the budget coarsens the hop
+  index maxJump(index hopSize) const {
+    index frames = get<kMaxJump>();
+    return frames > 0 ? std::max(frames * get<kFFT>().hopSize() / hopSize,
+                                 index(1))
+                      : 0;
+  }
+
+  // whether the last analysis is still waiting for the audio thread, which
+  // owns mNewAlgorithm until it has swapped it in
+  bool pending() const {
+    return mNewAlgorithmReady.load(std::memory_order_acquire);
+  }
+
+  bool fits(const algorithm::AnalysisEstimate& plan) const {
+    return get<kMaxMemory>() <= 0 ||
+           plan.totalBytes(kModelCopies) <= get<kMaxMemory>() * 1e6;
+  }
+
+  // start, or the nearest neighbour of what is heard with jumpTo 1
+  index jumpTarget() {
+    index numFrames = mAlgorithm.numFrames();
+    if (get<kJumpTo>() == 1) {
+      index from = mJump.active() ? mJump.position() / mAlgorithm.mHopSize
+                                  : mAlgorithm.playing();
+      index frame = mAlgorithm.nearest(std::min(from, numFrames - 1),
+                                       get<kThreshold>());
+      if (frame >= 0) return frame;
+    }
+    return std::lrint(get<kStart>() * (numFrames - 1));
+  }
+
+  // the walk carries on from frame; with a planner, once it has restarted
+  void moveWalk(index frame) {
+    frame %= mAlgorithm.numFrames();
+    if (mPlanner) {
+      mJumpFrom = frame;
+      mPlanStale = true;
+    } else
+      mAlgorithm.moveTo(frame);
+  }
+
+  PlanParams planParams() const {
+    return {get<kStart>(),       get<kThreshold>(), get<kRand>(),
+            get<kTemperature>(), get<kForget>(),    get<kPolicy>()};
+  }
+
   ParameterTrackChanges<double> mTrackValues;
   STFTBufferedProcess<STFTParamSetType, 0, true> mSTFTProcessor;
   algorithm::GraphGrain mAlgorithm;
   algorithm::GraphGrain mNewAlgorithm;
-  bool mNewAlgorithmReady{false};
+  // keeps the stage results between analyze calls
+  algorithm::GraphGrain mAnalysis;
+  std::atomic<bool> mNewAlgorithmReady{false};
+  // declared after mAlgorithm, so that its thread stops first
+  std::unique_ptr<algorithm::WalkPlanner<PlanParams>> mPlanner;
+  PlanParams mPlanned{};
+  bool mPlanStale{true};
+  algorithm::JumpCrossfade mJump;
+  index mJumpFrom{-1};
 };
 
 } // namespace graphgrain
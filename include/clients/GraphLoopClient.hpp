@@ -10,7 +10,9 @@ under the European Union’s Horizon 2020 research and innovation programme
 #pragma once
 
 #include "algorithms/GraphLoop.hpp"
+#include "algorithms/JumpCrossfade.hpp"
 #include "algorithms/public/MelBands.hpp"
+#include "clients/BufferSource.hpp"
 #include "clients/common/BufferedProcess.hpp"
 #include "clients/common/FluidBaseClient.hpp"
 #include "clients/nrt/NRTClient.hpp"
@@ -20,6 +22,9 @@ under the European Union’s Horizon 2020 research and innovation programme
 #include "clients/common/ParameterTypes.hpp"
 #include "clients/common/BufferAdaptor.hpp"
 #include <clients/common/Result.hpp>
+#include <atomic>
+#include <fstream>
+#include <string>
 
 namespace fluid {
 namespace client {
@@ -28,10 +33,15 @@ namespace graphloop {
   enum GraphLoopParamTags {
     kSourceBuf,
     kNumBands,
+    kMaxJump,
     kThreshold,
     kQuant,
     kStart,
     kEnd,
+    kRank,
+    kMaxMemory,
+    kFade,
+    kSynthesisWindow,
     kOutputBuffer,
     kFFT,
     kMaxFFTSize
@@ -40,10 +50,18 @@ namespace graphloop {
   constexpr auto GraphLoopParams = defineParameters(
     InputBufferParam("source", "Source Buffer"),
     LongParam("numBands", "Number of Mel bands", 64),
+    LongParam("maxJumpDistance", "Max jump distance (frames, 0: any)", 0,
+              Min(0)),
     FloatParam("threshold", "Threshold", 0.3, Min(0), Max(1.0)),
     EnumParam("quantize", "Quantize", 0 , "No", "Yes"),
     FloatParam("start", "start point", 0, Min(0), Max(1), UpperLimit<kEnd>()),
     FloatParam("end", "end point", 1, Min(0), Max(1), LowerLimit<kStart>()),
+    LongParam("rank", "Loop alternative", 0, Min(0),
+              Max(algorithm::LoopCatalogue::kAlternatives - 1)),
+    LongParam("maxMemory", "Memory budget (MB, 0: no limit)", 0, Min(0)),
+    LongParam("fade", "Jump crossfade (samples)", 64, Min(1)),
+    LongParam("synthesisWindow",
+              "Low-latency synthesis window (0: off)", 0, Min(0)),
     BufferParam("outputBuffer","Actual start/end points"),
     FFTParam<kMaxFFTSize>("fftSettings", "FFT Settings", 1024, -1, -1),
     LongParam<Fixed<true>>("maxFFTSize", "Maxiumm FFT Size", 16384, Min(4), PowerOfTwo{}));
@@ -78,18 +96,23 @@ class GraphLoopClient : public FluidBaseClient, ModelObject, AudioOut {
 
   GraphLoopClient(ParamSetViewType &p)
       : mParams{p}, mSTFTProcessor{get<kMaxFFTSize>(), 0, 1} {
-    audioChannelsIn(0);
+    // the playback STFTs are allocated here, not on the audio thread
+    mAlgorithm.preparePlayback(get<kMaxFFTSize>());
+    mNewAlgorithm.preparePlayback(get<kMaxFFTSize>());
+    // the input is a trigger that restarts the loop immediately
+    audioChannelsIn(1);
     audioChannelsOut(1);
   }
 
 
-  index latency() { return get<kFFT>().winSize(); }
+  index latency() { return playbackFFT().winSize(); }
 
   void reset() { mSTFTProcessor.reset();}
 
   MessageResult<void> analyze(){
+    if(pending())
+      return {Result::Status::kError, "Previous analysis not playing yet"};
     using namespace algorithm;
-    algorithm::GraphLoop newAlgoritm;
     auto source = BufferAdaptor::ReadAccess(get<kSourceBuf>().get());
     double sampleRate = source.sampleRate();
     auto fftParams = get<kFFT>();
@@ -98,66 +121,249 @@ class GraphLoopClient : public FluidBaseClient, ModelObject, AudioOut {
     index srcFrames = source.numFrames();
     if (srcFrames <= 0)
       return {Result::Status::kError, "Empty source buffer"};
-    RealVector srcTmp{source.samps(0, srcFrames, 0)};
+    BufferSource sourceAudio{source};
+    // checked before anything is allocated
+    AnalysisEstimate plan = budget(srcFrames);
+    if(!fits(plan))
+      return {Result::Status::kError,
+              "Analysis won't fit in maxMemory: " + plan.report(kModelCopies)};
+    if(!GraphLoop::beatSearchable(maxJump(plan.hopSize())))
+      return {Result::Status::kError,
+              "maxJumpDistance too short to find a beat in"};
     RealVector outputData(4);
     auto outBuf = BufferAdaptor::Access(get<kOutputBuffer>().get());
-    newAlgoritm.init(srcTmp, sampleRate,
+    mAnalysis.init(sourceAudio, sampleRate,
                 get<kFFT>().winSize(),
                 get<kFFT>().fftSize(),
-                get<kFFT>().hopSize(),
+                plan.hopSize(),
                 get<kNumBands>(),
                 7,
                 get<kThreshold>(),
                 get<kQuant>(),
-                outputData
+                outputData,
+                maxJump(plan.hopSize())
     );
 
-    mNewAlgorithm = newAlgoritm;
-    mNewAlgorithmReady = true;
+    mNewAlgorithm = mAnalysis;
+    mNewAlgorithmReady.store(true, std::memory_order_release);
 
+    if(plan.hopSize() != get<kFFT>().hopSize())
+      return {Result::Status::kWarning,
+              "Coarser analysis hop to fit maxMemory: " +
+              plan.report(kModelCopies)};
     return OK();
   }
 
+  // re-analyses the part of the source buffer from startFrame after it has
+  // been written to, with the settings of the last analysis; numFrames -1
+  // is to the end of the buffer
+  MessageResult<void> reanalyze(index startFrame, index numFrames){
+    if(pending())
+      return {Result::Status::kError, "Previous analysis not playing yet"};
+    if(!mAnalysis.initialized())
+      return {Result::Status::kError, "No analysis"};
+    auto source = BufferAdaptor::ReadAccess(get<kSourceBuf>().get());
+    if(!source.exists())
+      return {Result::Status::kError, "Source Buffer Supplied But Invalid"};
+    if(numFrames < 0) numFrames = source.numFrames() - startFrame;
+    BufferSource sourceAudio{source};
+    std::string error;
+    if(!mAnalysis.update(sourceAudio, startFrame, numFrames, error))
+      return {Result::Status::kError, error};
+    mNewAlgorithm = mAnalysis;
+    mNewAlgorithmReady.store(true, std::memory_order_release);
+    return OK();
+  }
+
+  // projected size and time of analyze with the current settings
+  MessageResult<std::string> estimate(){
+    auto source = BufferAdaptor::ReadAccess(get<kSourceBuf>().get());
+    if(!source.exists())
+      return {Result::Status::kError, "Source Buffer Supplied But Invalid"};
+    algorithm::AnalysisEstimate plan = budget(source.numFrames());
+    return plan.report(kModelCopies) +
+           (fits(plan) ? "" : ", over maxMemory");
+  }
+
+
+  // loads an analysis saved by write or by graph_analyze for the source buffer
+  MessageResult<void> read(std::string path){
+    if(pending())
+      return {Result::Status::kError, "Previous analysis not playing yet"};
+    auto source = BufferAdaptor::ReadAccess(get<kSourceBuf>().get());
+    if(!source.exists())
+      return {Result::Status::kError, "Source Buffer Supplied But Invalid"};
+    if(source.numFrames() <= 0)
+      return {Result::Status::kError, "Empty source buffer"};
+    std::ifstream in(path, std::ios::binary);
+    if(!in) return {Result::Status::kError, "Can't open " + path};
+    BufferSource sourceAudio{source};
+    std::string error;
+    if(!mAnalysis.read(in, sourceAudio, error))
+      return {Result::Status::kError, error};
+    mNewAlgorithm = mAnalysis;
+    mNewAlgorithmReady.store(true, std::memory_order_release);
+    return OK();
+  }
+
+  MessageResult<void> write(std::string path){
+    if(!mAnalysis.initialized())
+      return {Result::Status::kError, "No analysis"};
+    std::ofstream out(path, std::ios::binary);
+    if(!out || !mAnalysis.write(out))
+      return {Result::Status::kError, "Can't write " + path};
+    return OK();
+  }
+
+  // threshold, links, mean links per frame, fraction of dead ends and
+  // components of the analysis at steps thresholds from 0 to 1, one channel
+  // each and one frame per threshold
+  MessageResult<void> sweep(BufferPtr destination, index steps){
+    if(!mAnalysis.initialized())
+      return {Result::Status::kError, "No analysis"};
+    if(steps < 2)
+      return {Result::Status::kError, "At least 2 steps needed"};
+    if(!destination)
+      return {Result::Status::kError, "No destination buffer"};
+    BufferAdaptor::Access buf(destination.get());
+    if(!buf.exists())
+      return {Result::Status::kError, "Destination buffer invalid"};
+    RealMatrix curves(algorithm::ThresholdSweep::kNumCurves, steps);
+    mAnalysis.sweep(curves);
+    Result resizeResult = buf.resize(steps, curves.rows(), buf.sampleRate());
+    if(!resizeResult.ok())
+      return {resizeResult.status(), resizeResult.message()};
+    for(index i = 0; i < curves.rows(); i++) buf.samps(i) = curves.row(i);
+    return OK();
+  }
+
+  MessageResult<std::string> stats() {
+    // a pending analysis may be swapped in at any moment, but mAnalysis is
+    // its copy and only changes on this thread
+    if (pending()) return mAnalysis.stats().report();
+    if (!mAlgorithm.initialized())
+      return {Result::Status::kError, "No analysis"};
+    return mAlgorithm.stats().report();
+  }
 
   template <typename T>
-  void process(std::vector<HostVector<T>> &,
+  void process(std::vector<HostVector<T>> &input,
                std::vector<HostVector<T>> &output, FluidContext &c) {
     assert(audioChannelsOut() && "No control channels");
     assert(output.size() >= asUnsigned(audioChannelsOut()) &&
            "Too few output channels");
-    if(mNewAlgorithmReady){
+    if(pending()){
       std::swap(mAlgorithm, mNewAlgorithm);
-      mNewAlgorithmReady = false;
-      mSTFTParams.template get<0>() = FFTParams(mAlgorithm.mWindowSize,
-        mAlgorithm.mHopSize,
-        mAlgorithm.mFFTSize);
+      mNewAlgorithmReady.store(false, std::memory_order_release);
+      mJump.reset();
       }
     RealVector outputData(4);
     auto outBuf = BufferAdaptor::Access(get<kOutputBuffer>().get());
     bool validOutput = (outBuf.exists() && outBuf.numFrames() == 4);
+    // playback runs at the current fftSettings or synthesisWindow; frames at
+    // a resolution other than the analysis one are cut from the source buffer
+    FFTParams playback = playbackFFT();
+    mSTFTParams.template get<0>() = playback;
+    auto source = BufferAdaptor::ReadAccess(get<kSourceBuf>().get());
+    BufferSource sourceAudio{source};
+    mAlgorithm.setPlayback(playback.winSize(), playback.fftSize(),
+                           playback.hopSize(),
+                           source.exists() ? &sourceAudio : nullptr);
     mSTFTProcessor.processOutput(
           mSTFTParams, output, c,
           [&](ComplexMatrixView out) {
             if(mAlgorithm.initialized()){
-              mAlgorithm.processFrame(out.row(0), get<kStart>(), get<kEnd>(), outputData);
+              mAlgorithm.processFrame(out.row(0), get<kStart>(), get<kEnd>(),
+                                      get<kRank>(), outputData);
               if(validOutput) outBuf.samps(0) = outputData;
             }
           });
+    // triggers restart the loop at the sample they arrive: the source itself
+    // plays from the loop start until the STFT output has caught up
+    if(mAlgorithm.initialized() && source.exists() && input.size() > 0 &&
+       input[0].data()){
+      index hop = mAlgorithm.mHopSize;
+      index catchUp = playback.winSize() + playback.hopSize() +
+                      output[0].size();
+      mJump.setLengths(get<kFade>(), catchUp - get<kFade>());
+      mJump.process(input[0], output[0], sourceAudio, [&](){
+        index frame = mAlgorithm.loopStart();
+        mAlgorithm.moveTo(frame + playback.winSize() / hop);
+        return frame * hop;
+      });
+    }
+    mAlgorithm.setPlayback(playback.winSize(), playback.fftSize(),
+                           playback.hopSize(), nullptr);
     }
 
     static auto getMessageDescriptors()
     {
       return defineMessages(
-        makeMessage("analyze", &GraphLoopClient::analyze)
+        makeMessage("analyze", &GraphLoopClient::analyze),
+        makeMessage("reanalyze", &GraphLoopClient::reanalyze),
+        makeMessage("stats", &GraphLoopClient::stats),
+        makeMessage("estimate", &GraphLoopClient::estimate),
+        makeMessage("read", &GraphLoopClient::read),
+        makeMessage("write", &GraphLoopClient::write),
+        makeMessage("sweep", &GraphLoopClient::sweep)
       );
   }
 
 private:
+  // the fftSettings, or with synthesisWindow a shorter playback window with
+  // their overlap; frames are then cut from the source buffer
+  FFTParams playbackFFT() const {
+    index window = std::min(get<kSynthesisWindow>(), get<kMaxFFTSize>());
+    if(window <= 0 || window >= get<kFFT>().winSize()) return get<kFFT>();
+    auto resolution = algorithm::lowLatencyResolution(
+        window, get<kFFT>().winSize(), get<kFFT>().hopSize());
+    return FFTParams(resolution.windowSize, resolution.hopSize,
+                     resolution.fftSize);
+  }
+
+  // the model being analysed, the one playing and the one waiting to swap
+  static constexpr index kModelCopies = 3;
+
+  // analysis hop within maxMemory
+  algorithm::AnalysisEstimate budget(index numSamples) const {
+    return algorithm::fitBudget(
+        get<kMaxMemory>() * 1e6, kModelCopies, get<kFFT>().hopSize(),
+        get<kFFT>().winSize(), [&](index hopSize, index) {
+          return algorithm::GraphLoop::estimate(
+              numSamples, get<kFFT>().winSize(), get<kFFT>().fftSize(),
+              hopSize, get<kNumBands>(), get<kThreshold>(),
+              maxJump(hopSize));
+        });
+  }
+
+  // maxJumpDistance, given in frames of the configured hop, in frames of
+  // hopSize: the same span of time when the budget coarsens the hop
+  index maxJump(index hopSize) const {
+    index frames = get<kMaxJump>();
+    return frames > 0 ? std::max(frames * get<kFFT>().hopSize() / hopSize,
+                                 index(1))
+                      : 0;
+  }
+
+  // whether the last analysis is still waiting for the audio thread, which
+  // owns mNewAlgorithm until it has swapped it in
+  bool pending() const {
+    return mNewAlgorithmReady.load(std::memory_order_acquire);
+  }
+
+  bool fits(const algorithm::AnalysisEstimate& plan) const {
+    return get<kMaxMemory>() <= 0 ||
+           plan.totalBytes(kModelCopies) <= get<kMaxMemory>() * 1e6;
+  }
+
   ParameterTrackChanges<double, index> mTrackValues;
   STFTBufferedProcess<STFTParamSetType, 0, true> mSTFTProcessor;
   algorithm::GraphLoop mAlgorithm;
   algorithm::GraphLoop mNewAlgorithm;
-  bool mNewAlgorithmReady{false};
+  // keeps the stage results between analyze calls
+  algorithm::GraphLoop mAnalysis;
+  std::atomic<bool> mNewAlgorithmReady{false};
+  algorithm::JumpCrossfade mJump;
 };
 }
 using RTGraphLoopClient = ClientWrapper<graphloop::GraphLoopClient>;
@@ -0,0 +1,17 @@
+/*
+Part of the Fluid Corpus Manipulation Project (http://www.flucoma.org/)
+Copyright 2017-2019 University of Huddersfield.
+Licensed under the BSD-3 License.
+See license.md file in the project root for full license information.
+This project has received funding from the European Research Council (ERC)
+under the European Union’s Horizon 2020 research and innovation programme
+(grant agreement No 725899).
+*/
+#include <clients/BufGraphGrainClient.hpp>
+#include "FluidMaxWrapper.hpp" //nb: this include is order-sensitive because of macro name clashes in Eigen and C74
+
+void ext_main(void*)
+{
+  using namespace fluid::client;
+  makeMaxWrapper<NRTThreadedBufGraphGrainClient>("fluid.bufgraphgrain~");
+}
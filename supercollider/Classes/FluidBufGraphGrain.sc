@@ -0,0 +1,52 @@
+FluidBufGraphGrain : FluidBufProcessor {
+
+	*kr { |source, corpus, numBands = 64, segmentSize = 1, coarseNeighbours = 8, search = 0, maxJumpDistance = 0, threshold = 0.3, numClusters = 10,
+  forgetfulness = 100, randomness = 0.1, temperature = 1, policy = 1,
+  phase = 1, start = 0, duration = -1,
+  seed = -1, numVariations = 1, destination, framePath, windowSize = 2048,
+  hopSize = 512, fftSize = -1, trig = 1, blocking = 0|
+		source = source.asUGenInput;
+		corpus = corpus ?? {-1};
+		corpus = corpus.asUGenInput;
+		destination = destination.asUGenInput;
+		framePath = framePath ?? {-1};
+		source.isNil.if {"FluidBufGraphGrain:  Invalid source buffer".throw};
+		destination.isNil.if {"FluidBufGraphGrain:  Invalid destination buffer".throw};
+		^FluidProxyUgen.kr(\FluidBufGraphGrainTrigger, -1, source, corpus, numBands, segmentSize, coarseNeighbours, search, maxJumpDistance,
+    threshold, numClusters, forgetfulness, randomness, temperature, policy, phase, start, duration,
+    seed, numVariations, destination, framePath, windowSize, hopSize, fftSize,
+    trig, blocking);
+	}
+
+	*process { |server, source, corpus, numBands = 64, segmentSize = 1, coarseNeighbours = 8, search = 0, maxJumpDistance = 0, threshold = 0.3, numClusters = 10,
+  forgetfulness = 100, randomness = 0.1, temperature = 1, policy = 1,
+  phase = 1, start = 0, duration = -1,
+  seed = -1, numVariations = 1, destination, framePath, windowSize = 2048,
+  hopSize = 512, fftSize = -1, freeWhenDone = true, action|
+		framePath = framePath ?? {-1};
+		corpus = corpus ?? {-1};
+		source.isNil.if {"FluidBufGraphGrain:  Invalid source buffer".throw};
+		destination.isNil.if {"FluidBufGraphGrain:  Invalid destination buffer".throw};
+		^this.new(server, nil, [destination, framePath].select{|x| x != -1})
+		.processList([source, corpus, numBands, segmentSize, coarseNeighbours, search, maxJumpDistance, threshold, numClusters, forgetfulness,
+    randomness, temperature, policy, phase, start, duration, seed, numVariations, destination,
+    framePath, windowSize, hopSize, fftSize, 0], freeWhenDone, action);
+	}
+
+	*processBlocking { |server, source, corpus, numBands = 64, segmentSize = 1, coarseNeighbours = 8, search = 0, maxJumpDistance = 0, threshold = 0.3,
+  numClusters = 10, forgetfulness = 100, randomness = 0.1, temperature = 1, policy = 1,
+  phase = 1, start = 0,
+  duration = -1, seed = -1, numVariations = 1, destination, framePath,
+  windowSize = 2048, hopSize = 512, fftSize = -1, freeWhenDone = true, action|
+		framePath = framePath ?? {-1};
+		corpus = corpus ?? {-1};
+		source.isNil.if {"FluidBufGraphGrain:  Invalid source buffer".throw};
+		destination.isNil.if {"FluidBufGraphGrain:  Invalid destination buffer".throw};
+		^this.new(server, nil, [destination, framePath].select{|x| x != -1})
+		.processList([source, corpus, numBands, segmentSize, coarseNeighbours, search, maxJumpDistance, threshold, numClusters, forgetfulness,
+    randomness, temperature, policy, phase, start, duration, seed, numVariations, destination,
+    framePath, windowSize, hopSize, fftSize, 1], freeWhenDone, action);
+	}
+}
+
+FluidBufGraphGrainTrigger : FluidProxyUgen {}
@@ -0,0 +1,41 @@
+FluidBufGraphLoop : FluidBufProcessor {
+
+	*kr { |source, numBands = 64, maxJumpDistance = 0, threshold = 0.3, quantize = 0, start = 0,
+  end = 1, rank = 0, duration = -1, destination, framePath, windowSize = 1024,
+  hopSize = -1, fftSize = -1, trig = 1, blocking = 0|
+		source = source.asUGenInput;
+		destination = destination.asUGenInput;
+		framePath = framePath ?? {-1};
+		source.isNil.if {"FluidBufGraphLoop:  Invalid source buffer".throw};
+		destination.isNil.if {"FluidBufGraphLoop:  Invalid destination buffer".throw};
+		^FluidProxyUgen.kr(\FluidBufGraphLoopTrigger, -1, source, numBands, maxJumpDistance,
+    threshold, quantize, start, end, rank, duration, destination, framePath,
+    windowSize, hopSize, fftSize, trig, blocking);
+	}
+
+	*process { |server, source, numBands = 64, maxJumpDistance = 0, threshold = 0.3, quantize = 0,
+  start = 0, end = 1, rank = 0, duration = -1, destination, framePath, windowSize = 1024,
+  hopSize = -1, fftSize = -1, freeWhenDone = true, action|
+		framePath = framePath ?? {-1};
+		source.isNil.if {"FluidBufGraphLoop:  Invalid source buffer".throw};
+		destination.isNil.if {"FluidBufGraphLoop:  Invalid destination buffer".throw};
+		^this.new(server, nil, [destination, framePath].select{|x| x != -1})
+		.processList([source, numBands, maxJumpDistance, threshold, quantize, start, end, rank, duration,
+    destination, framePath, windowSize, hopSize, fftSize, 0],
+    freeWhenDone, action);
+	}
+
+	*processBlocking { |server, source, numBands = 64, maxJumpDistance = 0, threshold = 0.3,
+  quantize = 0, start = 0, end = 1, rank = 0, duration = -1, destination, framePath,
+  windowSize = 1024, hopSize = -1, fftSize = -1, freeWhenDone = true, action|
+		framePath = framePath ?? {-1};
+		source.isNil.if {"FluidBufGraphLoop:  Invalid source buffer".throw};
+		destination.isNil.if {"FluidBufGraphLoop:  Invalid destination buffer".throw};
+		^this.new(server, nil, [destination, framePath].select{|x| x != -1})
+		.processList([source, numBands, maxJumpDistance, threshold, quantize, start, end, rank, duration,
+    destination, framePath, windowSize, hopSize, fftSize, 1],
+    freeWhenDone, action);
+	}
+}
+
+FluidBufGraphLoopTrigger : FluidProxyUgen {}
@@ -1,23 +1,35 @@
 FluidGraphGrain : FluidRealTimeModel {
-	var <>source, <>numBands, <>threshold,
-	<>numClusters, <>forgetfulness, <>randomness, <>phase, <>start,
-	<>output, <>windowSize, <>hopSize, <>fftSize, <>maxFFTSize;
+	var <>source, <>corpus, <>numBands, <>segmentSize, <>coarseNeighbours, <>search, <>maxJumpDistance, <>threshold,
+	<>numClusters, <>forgetfulness, <>randomness, <>temperature, <>policy, <>phase, <>start,
+	<>output, <>lookAhead, <>maxMemory, <>jumpTo, <>fade, <>synthesisWindow, <>windowSize, <>hopSize, <>fftSize, <>maxFFTSize;
 
-		*new {|server, source = -1, numBands = 64, threshold = 0.3,
-  numClusters = 10, forgetfulness = 100, randomness = 0.1,
-  phase = 1, start = 0, output, windowSize = 1024, hopSize = -1,
+		*new {|server, source = -1, corpus = -1, numBands = 64, segmentSize = 1, coarseNeighbours = 8, search = 0, maxJumpDistance = 0, threshold = 0.3,
+  numClusters = 10, forgetfulness = 100, randomness = 0.1, temperature = 1,
+  policy = 1, phase = 1, start = 0, output, lookAhead = 0, maxMemory = 0, jumpTo = 0, fade = 64, synthesisWindow = 0, windowSize = 1024, hopSize = -1,
   fftSize = -1, maxFFTSize = 16384|
-		^super.new(server,[source, numBands, threshold, numClusters, forgetfulness,
-    randomness, phase, start, output,windowSize, hopSize, fftSize, maxFFTSize])
+		^super.new(server,[source, corpus, numBands, segmentSize, coarseNeighbours, search, maxJumpDistance, threshold, numClusters, forgetfulness,
+    randomness, temperature, policy, phase, start, output, lookAhead, maxMemory, jumpTo, fade, synthesisWindow, windowSize, hopSize, fftSize, maxFFTSize])
 		.source_(source)
+		.corpus_(corpus)
 		.numBands_(numBands)
+		.segmentSize_(segmentSize)
+		.coarseNeighbours_(coarseNeighbours)
+		.search_(search)
+		.maxJumpDistance_(maxJumpDistance)
 		.threshold_(threshold)
 		.numClusters_(numClusters)
 		.forgetfulness_(forgetfulness)
 		.randomness_(randomness)
+		.temperature_(temperature)
+		.policy_(policy)
 		.phase_(phase)
 		.start_(start)
 		.output_(output)
+		.lookAhead_(lookAhead)
+		.maxMemory_(maxMemory)
+		.jumpTo_(jumpTo)
+		.fade_(fade)
+		.synthesisWindow_(synthesisWindow)
 		.windowSize_(windowSize)
 		.hopSize_(hopSize)
 		.fftSize_(fftSize)
@@ -25,8 +37,8 @@ FluidGraphGrain : FluidRealTimeModel {
 	}
 
 	prGetParams{^[
-		this.source, this.numBands,this.threshold, this.numClusters, this.forgetfulness,
-		this.randomness, this.phase, this.start, this.output, this.windowSize,
+		this.source, this.corpus, this.numBands, this.segmentSize, this.coarseNeighbours, this.search, this.maxJumpDistance, this.threshold, this.numClusters, this.forgetfulness,
+		this.randomness, this.temperature, this.policy, this.phase, this.start, this.output, this.lookAhead, this.maxMemory, this.jumpTo, this.fade, this.synthesisWindow, this.windowSize,
 		this.hopSize,this.fftSize, this.maxFFTSize,-1,-1];}
 
 	analyze{|action|
@@ -34,11 +46,44 @@ FluidGraphGrain : FluidRealTimeModel {
 		this.prSendMsg(this.prMakeMsg(\analyze, id));
 	}
 
-	ar { arg start = 0, threshold = 0.1, forgetfulness = 100, randomness = 0.1, phase = 1;
+	reanalyze{|startFrame = 0, numFrames = -1, action|
+		actions[\reanalyze] = [nil,action];
+		this.prSendMsg(this.prMakeMsg(\reanalyze, id, startFrame, numFrames));
+	}
+
+	stats{|action|
+		actions[\stats] = [string(FluidMessageResponse,_,_), action];
+		this.prSendMsg(this.prMakeMsg(\stats, id));
+	}
+
+	estimate{|action|
+		actions[\estimate] = [string(FluidMessageResponse,_,_), action];
+		this.prSendMsg(this.prMakeMsg(\estimate, id));
+	}
+
+	read{|filename, action|
+		actions[\read] = [nil,action];
+		this.prSendMsg(this.prMakeMsg(\read, id, filename.asString));
+	}
+
+	write{|filename, action|
+		actions[\write] = [nil,action];
+		this.prSendMsg(this.prMakeMsg(\write, id, filename.asString));
+	}
+
+	sweep{|destination, steps = 100, action|
+		destination = this.prEncodeBuffer(destination);
+		actions[\sweep] = [nil,action];
+		this.prSendMsg(this.prMakeMsg(\sweep, id, destination, steps,
+			["/b_query", destination.asUGenInput]));
+	}
+
+	ar { arg start = 0, threshold = 0.1, forgetfulness = 100, randomness = 0.1, temperature = 1, phase = 1, trig = 0;
 		source = source ?? {-1};
+		corpus = corpus ?? {-1};
 		output = output ?? {-1};
-		^FluidGraphGrainQuery.ar(this, source, numBands, threshold, numClusters, forgetfulness,
-			randomness, phase, start, output, windowSize, hopSize, fftSize, maxFFTSize);
+		^FluidGraphGrainQuery.ar(trig, this, source, corpus, numBands, segmentSize, coarseNeighbours, search, maxJumpDistance, threshold, numClusters, forgetfulness,
+			randomness, temperature, policy, phase, start, output, lookAhead, maxMemory, jumpTo, fade, synthesisWindow, windowSize, hopSize, fftSize, maxFFTSize);
 	}
 
 }
@@ -49,8 +94,8 @@ FluidGraphGrainQuery : UGen
 {
 	var <>pluginname;
 
-	*ar { |...args|
-        args = [1] ++ args.collect{|x| x.asUGenInput};
+	*ar { |trig ...args|
+        args = [trig.asAudioRateInput] ++ args.collect{|x| x.asUGenInput};
 		^this.new1('audio',  "FluidGraphGrainQuery", *args)
 	}
 
@@ -1,19 +1,24 @@
 FluidGraphLoop : FluidRealTimeModel {
-	var <>source, <>numBands, <>threshold,
-	<>quantize, <>start, <>end,
+	var <>source, <>numBands, <>maxJumpDistance, <>threshold,
+	<>quantize, <>start, <>end, <>rank, <>maxMemory, <>fade, <>synthesisWindow,
 	<>output, <>windowSize, <>hopSize, <>fftSize, <>maxFFTSize;
 
-		*new {|server, source = -1, numBands = 64, threshold = 0.3,
-  quantize = 0, start = 0, end = 1, output, windowSize = 1024, hopSize = -1,
+		*new {|server, source = -1, numBands = 64, maxJumpDistance = 0, threshold = 0.3,
+  quantize = 0, start = 0, end = 1, rank = 0, maxMemory = 0, fade = 64, synthesisWindow = 0, output, windowSize = 1024, hopSize = -1,
   fftSize = -1, maxFFTSize = 16384|
-		^super.new(server,[source, numBands, threshold, quantize, start,
-    end, output,windowSize, hopSize, fftSize, maxFFTSize])
+		^super.new(server,[source, numBands, maxJumpDistance, threshold, quantize, start,
+    end, rank, maxMemory, fade, synthesisWindow, output,windowSize, hopSize, fftSize, maxFFTSize])
 		.source_(source)
 		.numBands_(numBands)
+		.maxJumpDistance_(maxJumpDistance)
 		.threshold_(threshold)
 		.quantize_(quantize)
 		.start_(start)
 		.end_(end)
+		.rank_(rank)
+		.maxMemory_(maxMemory)
+		.fade_(fade)
+		.synthesisWindow_(synthesisWindow)
 		.output_(output)
 		.windowSize_(windowSize)
 		.hopSize_(hopSize)
@@ -22,8 +27,8 @@ FluidGraphLoop : FluidRealTimeModel {
 	}
 
 	prGetParams{^[
-		this.source, this.numBands,this.threshold, this.quantize, this.start,
-		this.end, this.output, this.windowSize,
+		this.source, this.numBands, this.maxJumpDistance, this.threshold, this.quantize, this.start,
+		this.end, this.rank, this.maxMemory, this.fade, this.synthesisWindow, this.output, this.windowSize,
 		this.hopSize,this.fftSize, this.maxFFTSize,-1,-1];}
 
 	analyze{|action|
@@ -31,11 +36,43 @@ FluidGraphLoop : FluidRealTimeModel {
 		this.prSendMsg(this.prMakeMsg(\analyze, id));
 	}
 
-	ar { arg start = 0, end = 1;
+	reanalyze{|startFrame = 0, numFrames = -1, action|
+		actions[\reanalyze] = [nil,action];
+		this.prSendMsg(this.prMakeMsg(\reanalyze, id, startFrame, numFrames));
+	}
+
+	stats{|action|
+		actions[\stats] = [string(FluidMessageResponse,_,_), action];
+		this.prSendMsg(this.prMakeMsg(\stats, id));
+	}
+
+	estimate{|action|
+		actions[\estimate] = [string(FluidMessageResponse,_,_), action];
+		this.prSendMsg(this.prMakeMsg(\estimate, id));
+	}
+
+	read{|filename, action|
+		actions[\read] = [nil,action];
+		this.prSendMsg(this.prMakeMsg(\read, id, filename.asString));
+	}
+
+	write{|filename, action|
+		actions[\write] = [nil,action];
+		this.prSendMsg(this.prMakeMsg(\write, id, filename.asString));
+	}
+
+	sweep{|destination, steps = 100, action|
+		destination = this.prEncodeBuffer(destination);
+		actions[\sweep] = [nil,action];
+		this.prSendMsg(this.prMakeMsg(\sweep, id, destination, steps,
+			["/b_query", destination.asUGenInput]));
+	}
+
+	ar { arg start = 0, end = 1, rank = 0, trig = 0;
 		source = source ?? {-1};
 		output = output ?? {-1};
-		^FluidGraphLoopQuery.ar(this, source, numBands, threshold, quantize, start,
-    end, output,windowSize, hopSize, fftSize, maxFFTSize);
+		^FluidGraphLoopQuery.ar(trig, this, source, numBands, maxJumpDistance, threshold, quantize, start,
+    end, rank, maxMemory, fade, synthesisWindow, output,windowSize, hopSize, fftSize, maxFFTSize);
 	}
 
 }
@@ -46,8 +83,8 @@ FluidGraphLoopQuery : UGen
 {
 	var <>pluginname;
 
-	*ar { |...args|
-        args = [1] ++ args.collect{|x| x.asUGenInput};
+	*ar { |trig ...args|
+        args = [trig.asAudioRateInput] ++ args.collect{|x| x.asUGenInput};
 		^this.new1('audio',  "FluidGraphLoopQuery", *args)
 	}
 
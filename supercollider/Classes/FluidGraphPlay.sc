@@ -1,21 +1,37 @@
 FluidGraphPlay : FluidRealTimeModel {
-	var <>source, <>numBands, <>threshold, <>minDur, <>minDist,
-    <>forget, <>start, <>output, <>windowSize, <>hopSize, <>fftSize, <>maxFFTSize;
+	var <>source, <>corpus, <>numBands, <>segmentSize, <>coarseNeighbours, <>search, <>maxJumpDistance, <>threshold, <>minDur, <>minDist,
+    <>forget, <>randomness, <>temperature, <>policy, <>jumps, <>start, <>output, <>lookAhead, <>maxMemory, <>jumpTo, <>fade, <>synthesisWindow, <>windowSize, <>hopSize, <>fftSize, <>maxFFTSize;
 
-		*new {|server, source = -1, numBands = 64, threshold = 0.3,
-  minDur = 10, minDist = 10, forget = 1, start = 0, output,
+		*new {|server, source = -1, corpus = -1, numBands = 64, segmentSize = 1, coarseNeighbours = 8, search = 0, maxJumpDistance = 0, threshold = 0.3,
+  minDur = 10, minDist = 10, forget = 1, randomness = 0.1, temperature = 1, policy = 3, jumps = 0,
+  start = 0, output, lookAhead = 0, maxMemory = 0, jumpTo = 0, fade = 64, synthesisWindow = 0,
 		windowSize = 1024, hopSize = -1,
   fftSize = -1, maxFFTSize = 16384|
-		^super.new(server,[source, numBands, threshold, minDur, minDist,
-    forget, start, output, windowSize, hopSize, fftSize, maxFFTSize])
+		^super.new(server,[source, corpus, numBands, segmentSize, coarseNeighbours, search, maxJumpDistance, threshold, minDur, minDist,
+    forget, randomness, temperature, policy, jumps, start, output, lookAhead, maxMemory, jumpTo, fade, synthesisWindow, windowSize, hopSize, fftSize,
+    maxFFTSize])
 		.source_(source)
+		.corpus_(corpus)
 		.numBands_(numBands)
+		.segmentSize_(segmentSize)
+		.coarseNeighbours_(coarseNeighbours)
+		.search_(search)
+		.maxJumpDistance_(maxJumpDistance)
 		.threshold_(threshold)
 		.minDur_(minDur)
 		.minDist_(minDist)
 		.forget_(forget)
+		.randomness_(randomness)
+		.temperature_(temperature)
+		.policy_(policy)
+		.jumps_(jumps)
 		.start_(start)
 		.output_(output)
+		.lookAhead_(lookAhead)
+		.maxMemory_(maxMemory)
+		.jumpTo_(jumpTo)
+		.fade_(fade)
+		.synthesisWindow_(synthesisWindow)
 		.windowSize_(windowSize)
 		.hopSize_(hopSize)
 		.fftSize_(fftSize)
@@ -23,8 +39,8 @@ FluidGraphPlay : FluidRealTimeModel {
 	}
 
 	prGetParams{^[
-		this.source, this.numBands,this.threshold, this.minDur, this.minDist,
-		this.forget, this.start, this.output, this.windowSize,
+		this.source, this.corpus, this.numBands, this.segmentSize, this.coarseNeighbours, this.search, this.maxJumpDistance, this.threshold, this.minDur, this.minDist,
+		this.forget, this.randomness, this.temperature, this.policy, this.jumps, this.start, this.output, this.lookAhead, this.maxMemory, this.jumpTo, this.fade, this.synthesisWindow, this.windowSize,
 		this.hopSize,this.fftSize, this.maxFFTSize,-1,-1];}
 
 	analyze{|action|
@@ -32,11 +48,46 @@ FluidGraphPlay : FluidRealTimeModel {
 		this.prSendMsg(this.prMakeMsg(\analyze, id));
 	}
 
-	ar { arg start = 0, threshold = 0.1, minDur = 10, minDist = 10, forget = 100;
+	reanalyze{|startFrame = 0, numFrames = -1, action|
+		actions[\reanalyze] = [nil,action];
+		this.prSendMsg(this.prMakeMsg(\reanalyze, id, startFrame, numFrames));
+	}
+
+	stats{|action|
+		actions[\stats] = [string(FluidMessageResponse,_,_), action];
+		this.prSendMsg(this.prMakeMsg(\stats, id));
+	}
+
+	estimate{|action|
+		actions[\estimate] = [string(FluidMessageResponse,_,_), action];
+		this.prSendMsg(this.prMakeMsg(\estimate, id));
+	}
+
+	read{|filename, action|
+		actions[\read] = [nil,action];
+		this.prSendMsg(this.prMakeMsg(\read, id, filename.asString));
+	}
+
+	write{|filename, action|
+		actions[\write] = [nil,action];
+		this.prSendMsg(this.prMakeMsg(\write, id, filename.asString));
+	}
+
+	sweep{|destination, steps = 100, action|
+		destination = this.prEncodeBuffer(destination);
+		actions[\sweep] = [nil,action];
+		this.prSendMsg(this.prMakeMsg(\sweep, id, destination, steps,
+			["/b_query", destination.asUGenInput]));
+	}
+
+	ar { arg start = 0, threshold = 0.1, minDur = 10, minDist = 10, forget = 100,
+    randomness = 0.1, temperature = 1, trig = 0;
 		source = source ?? {-1};
+		corpus = corpus ?? {-1};
 		output = output ?? {-1};
-		^FluidGraphPlayQuery.ar(this, source, numBands, threshold, minDur, minDist,
-    forget, start, output, windowSize, hopSize, fftSize, maxFFTSize);
+		^FluidGraphPlayQuery.ar(trig, this, source, corpus, numBands, segmentSize, coarseNeighbours, search, maxJumpDistance, threshold, minDur, minDist,
+    forget, randomness, temperature, policy, jumps, start, output, lookAhead, maxMemory, jumpTo, fade, synthesisWindow, windowSize, hopSize, fftSize,
+    maxFFTSize);
 	}
 
 }
@@ -47,8 +98,8 @@ FluidGraphPlayQuery : UGen
 {
 	var <>pluginname;
 
-	*ar { |...args|
-        args = [1] ++ args.collect{|x| x.asUGenInput};
+	*ar { |trig ...args|
+        args = [trig.asAudioRateInput] ++ args.collect{|x| x.asUGenInput};
 		^this.new1('audio',  "FluidGraphPlayQuery", *args)
 	}
 
@@ -0,0 +1,221 @@
+/*
+Part of the Fluid Corpus Manipulation Project (http://www.flucoma.org/)
+Copyright 2017-2019 University of Huddersfield.
+Licensed under the BSD-3 License.
+See license.md file in the project root for full license information.
+This project has received funding from the European Research Council (ERC)
+under the European Union’s Horizon 2020 research and innovation programme
+(grant agreement No 725899).
+*/
+
+// Analysis and per-hop playback cost of GraphGrain, GraphPlay and GraphLoop
+// on synthetic audio of increasing length and/or on sound files.
+//
+// usage: graph_benchmark [--lengths 5,10,20] [--hops 2000] [--fft 1024,512]
+//                        [--sr 44100] [--segment 1] [--stats] [file.wav ...]
+
+#include "../common/Memory.hpp"
+#include "../common/MappedWavSource.hpp"
+#include "../common/Synthetic.hpp"
+#include <algorithms/GraphGrain.hpp>
+#include <algorithms/GraphLoop.hpp>
+#include <algorithms/GraphPlay.hpp>
+#include <algorithms/AudioSource.hpp>
+#include <algorithms/GraphPlayUtils.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+using namespace fluid;
+using namespace fluid::algorithm;
+// glibc declares ::index in <strings.h>
+using fluid::index;
+using Clock = std::chrono::steady_clock;
+
+struct Settings {
+  std::vector<double> lengths{5, 10, 20, 40};
+  index hops{2000};
+  index windowSize{1024};
+  index hopSize{512};
+  index fftSize{1024};
+  index numBands{64};
+  double threshold{0.3};
+  index numClusters{10};
+  index segmentSize{1};
+  double sampleRate{44100};
+  bool stats{false};
+  std::vector<std::string> files;
+};
+
+double msSince(Clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - start)
+      .count();
+}
+
+struct Latency {
+  double p50, p99, max;
+};
+
+Latency summarize(std::vector<double>& times) {
+  std::sort(times.begin(), times.end());
+  auto at = [&](double q) {
+    return times[std::min(times.size() - 1,
+                          static_cast<size_t>(q * times.size()))];
+  };
+  return {at(0.5), at(0.99), times.back()};
+}
+
+template <typename HopFunc>
+Latency measureHops(index hops, HopFunc hop) {
+  std::vector<double> times(hops);
+  for (index i = 0; i < hops; i++) {
+    auto start = Clock::now();
+    hop(i);
+    times[i] = 1000 * msSince(start);
+  }
+  return summarize(times);
+}
+
+void printHeader() {
+  std::printf("%-24s %8s %8s %9s %8s %8s %8s %8s %8s %8s %9s %8s %8s %8s\n",
+              "source", "frames", "stft", "mel", "dm", "onsets", "cluster",
+              "fit", "init", "rss(MB)", "algo", "p50(us)", "p99(us)",
+              "max(us)");
+}
+
+// stage timings as the algorithm's own init and fit recorded them
+void printRow(const std::string& name, index frames, const GraphStats& stats,
+              double init, double rss, const char* algo, Latency l) {
+  std::printf(
+      "%-24s %8td %8.1f %9.1f %8.1f %8.1f %8.1f %8.1f %8.1f %8.1f %9s %8.1f "
+      "%8.1f %8.1f\n",
+      name.c_str(), frames, stats.stageMs(GraphStats::kSTFT),
+      stats.stageMs(GraphStats::kMel), stats.stageMs(GraphStats::kDistance),
+      stats.stageMs(GraphStats::kOnsets),
+      stats.stageMs(GraphStats::kClustering),
+      stats.stageMs(GraphStats::kFit), init, rss, algo, l.p50, l.p99, l.max);
+}
+
+void run(const std::string& name, const AudioSource& audio,
+         const Settings& s) {
+  index frames = GraphPlayUtils::numFrames(audio.size(), s.hopSize);
+  RealVector output(4);
+  ComplexVector frame(s.fftSize / 2 + 1);
+
+  {
+    tools::resetPeakRSS();
+    GraphLoop loop;
+    auto t = Clock::now();
+    loop.init(audio, s.sampleRate, s.windowSize, s.fftSize, s.hopSize,
+              s.numBands, 7, s.threshold, false, output);
+    double init = msSince(t);
+    loop.fit(s.threshold, false);
+    double rss = tools::peakRSS();
+    GraphStats stages = loop.stats();
+    // move the loop bounds every 50 hops so that the catalogue is exercised
+    Latency l = measureHops(s.hops, [&](index i) {
+      double start = ((i / 50) % 10) * 0.05;
+      loop.processFrame(frame, start, start + 0.5, 0, output);
+    });
+    printRow(name, frames, stages, init, rss, "loop", l);
+    if (s.stats) std::printf("%s\n", loop.stats().report().c_str());
+  }
+  {
+    tools::resetPeakRSS();
+    GraphPlay play;
+    auto t = Clock::now();
+    play.init(audio, s.sampleRate, s.windowSize, s.fftSize, s.hopSize,
+              s.numBands, 7, s.threshold, s.segmentSize, 8, output);
+    double init = msSince(t);
+    double rss = tools::peakRSS();
+    GraphStats stages = play.stats();
+    Latency l = measureHops(s.hops, [&](index) {
+      play.processFrame(frame, 0, s.threshold, 10, 10, 1, 0.1, 1, false,
+                        output);
+    });
+    printRow(name, frames, stages, init, rss, "play", l);
+    if (s.stats) std::printf("%s\n", play.stats().report().c_str());
+  }
+  {
+    tools::resetPeakRSS();
+    GraphGrain grain;
+    auto t = Clock::now();
+    grain.init(audio, s.sampleRate, s.windowSize, s.fftSize, s.hopSize,
+               s.numBands, 7, s.threshold, s.numClusters, s.segmentSize, 8,
+               output);
+    double init = msSince(t);
+    double rss = tools::peakRSS();
+    GraphStats stages = grain.stats();
+    Latency l = measureHops(s.hops, [&](index) {
+      grain.processFrame(frame, 0, s.threshold, 100, 0.1, 1, 1, output);
+    });
+    printRow(name, frames, stages, init, rss, "grain", l);
+    if (s.stats) std::printf("%s\n", grain.stats().report().c_str());
+  }
+}
+
+std::vector<double> parseList(const std::string& arg) {
+  std::vector<double> values;
+  std::stringstream ss(arg);
+  std::string item;
+  while (std::getline(ss, item, ',')) values.push_back(std::stod(item));
+  return values;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  Settings s;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--lengths" && i + 1 < argc) {
+      s.lengths = parseList(argv[++i]);
+    } else if (arg == "--hops" && i + 1 < argc) {
+      s.hops = std::atol(argv[++i]);
+    } else if (arg == "--fft" && i + 1 < argc) {
+      auto fft = parseList(argv[++i]);
+      s.windowSize = s.fftSize = std::lrint(fft[0]);
+      s.hopSize = fft.size() > 1 ? std::lrint(fft[1]) : s.fftSize / 2;
+    } else if (arg == "--sr" && i + 1 < argc) {
+      s.sampleRate = std::atof(argv[++i]);
+    } else if (arg == "--segment" && i + 1 < argc) {
+      s.segmentSize = std::atol(argv[++i]);
+    } else if (arg == "--stats") {
+      s.stats = true;
+    } else if (arg == "--help") {
+      std::printf("usage: graph_benchmark [--lengths 5,10,20] [--hops 2000] "
+                  "[--fft 1024,512] [--sr 44100] [--segment 1] [--stats] "
+                  "[file.wav ...]\n");
+      return 0;
+    } else {
+      s.files.push_back(arg);
+    }
+  }
+  printHeader();
+  for (double seconds : s.lengths) {
+    RealVector audio = tools::synthetic(seconds, s.sampleRate);
+    run("synthetic " + std::to_string(static_cast<int>(seconds)) + "s",
+        VectorSource(audio), s);
+  }
+  for (auto& path : s.files) {
+    // mapped, so the analysis reads the file in chunks
+    tools::MappedWavSource file;
+    std::string error;
+    if (!file.open(path, error)) {
+      std::fprintf(stderr, "%s\n", error.c_str());
+      continue;
+    }
+    Settings fileSettings = s;
+    fileSettings.sampleRate = file.sampleRate();
+    std::string name = path.substr(path.find_last_of("/\\") + 1);
+    run(name, file, fileSettings);
+  }
+  return 0;
+}
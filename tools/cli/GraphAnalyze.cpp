@@ -0,0 +1,233 @@
+/*
+Part of the Fluid Corpus Manipulation Project (http://www.flucoma.org/)
+Copyright 2017-2019 University of Huddersfield.
+Licensed under the BSD-3 License.
+See license.md file in the project root for full license information.
+This project has received funding from the European Research Council (ERC)
+under the European Union’s Horizon 2020 research and innovation programme
+(grant agreement No 725899).
+*/
+
+// Batch pre-analysis of sound files for GraphPlay, GraphGrain or GraphLoop.
+// Each WAV file is analysed on one of a pool of worker threads and saved as
+// <name>.<algo>.graph, which the objects load with their read message.
+//
+// usage: graph_analyze play|grain|loop [--jobs N] [--fft 1024,512]
+//                      [--bands 64] [--threshold 0.3] [--clusters 10]
+//                      [--segment 1] [--quantize] [--out dir]
+//                      file.wav|dir ...
+
+#include "../common/Memory.hpp"
+#include "../common/MappedWavSource.hpp"
+#include <algorithms/GraphGrain.hpp>
+#include <algorithms/GraphLoop.hpp>
+#include <algorithms/GraphPlay.hpp>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using namespace fluid;
+using namespace fluid::algorithm;
+// glibc declares ::index in <strings.h>
+using fluid::index;
+using Clock = std::chrono::steady_clock;
+namespace fs = std::filesystem;
+
+struct Settings {
+  std::string algo;
+  index jobs{0};
+  index windowSize{1024};
+  index hopSize{512};
+  index fftSize{1024};
+  index numBands{64};
+  double threshold{0.3};
+  index numClusters{10};
+  index segmentSize{1};
+  index maxJump{0};
+  bool quantize{false};
+  fs::path out;
+  std::vector<fs::path> files;
+};
+
+double msSince(Clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - start)
+      .count();
+}
+
+template <typename Algorithm, typename InitFunc>
+bool analyse(const fs::path& path, InitFunc init, std::string& report,
+             std::string& error) {
+  Algorithm algorithm;
+  RealVector output(4);
+  init(algorithm, output);
+  std::ofstream out(path, std::ios::binary);
+  if (!out || !algorithm.write(out)) {
+    error = "can't write " + path.string();
+    return false;
+  }
+  report = algorithm.stats().report();
+  report = report.substr(0, report.find('\n'));
+  return true;
+}
+
+// analyses one file; returns false and sets error on failure
+bool process(const fs::path& file, const Settings& s, std::string& line,
+             std::string& error) {
+  auto t = Clock::now();
+  tools::MappedWavSource source;
+  if (!source.open(file.string(), error)) return false;
+  index sampleRate = static_cast<index>(source.sampleRate());
+  fs::path dir = s.out.empty() ? file.parent_path() : s.out;
+  fs::path target = dir / (file.stem().string() + "." + s.algo + ".graph");
+  std::string report;
+  index frames = 0;
+  bool ok = false;
+  if (s.algo == "play") {
+    ok = analyse<GraphPlay>(
+        target,
+        [&](GraphPlay& a, RealVector& output) {
+          a.init(source, sampleRate, s.windowSize, s.fftSize, s.hopSize,
+                 s.numBands, 7, s.threshold, s.segmentSize, 8, output, 0,
+                 false, s.maxJump);
+          frames = a.numFrames();
+        },
+        report, error);
+  } else if (s.algo == "grain") {
+    ok = analyse<GraphGrain>(
+        target,
+        [&](GraphGrain& a, RealVector& output) {
+          a.init(source, sampleRate, s.windowSize, s.fftSize, s.hopSize,
+                 s.numBands, 7, s.threshold, s.numClusters, s.segmentSize, 8,
+                 output, 0, false, s.maxJump);
+          frames = a.numFrames();
+        },
+        report, error);
+  } else {
+    ok = analyse<GraphLoop>(
+        target,
+        [&](GraphLoop& a, RealVector& output) {
+          a.init(source, sampleRate, s.windowSize, s.fftSize, s.hopSize,
+                 s.numBands, 7, s.threshold, s.quantize, output, s.maxJump);
+          frames = a.numFrames();
+        },
+        report, error);
+  }
+  if (!ok) return false;
+  std::error_code ec;
+  auto size = fs::file_size(target, ec);
+  std::ostringstream text;
+  text << file.filename().string() << ": " << frames << " frames, "
+       << msSince(t) << " ms, " << (ec ? 0 : size / 1024) << " kB -> "
+       << target.string() << "\n  " << report;
+  line = text.str();
+  return true;
+}
+
+void collect(const fs::path& path, std::vector<fs::path>& files) {
+  std::error_code ec;
+  if (fs::is_directory(path, ec)) {
+    for (auto& entry : fs::recursive_directory_iterator(path, ec)) {
+      auto ext = entry.path().extension().string();
+      if (entry.is_regular_file() && (ext == ".wav" || ext == ".WAV"))
+        files.push_back(entry.path());
+    }
+  } else
+    files.push_back(path);
+}
+
+void usage() {
+  std::printf("usage: graph_analyze play|grain|loop [--jobs N] "
+              "[--fft 1024,512] [--bands 64] [--threshold 0.3] "
+              "[--clusters 10] [--segment 1] [--max-jump 0] [--quantize] "
+              "[--out dir] "
+              "file.wav|dir ...\n");
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  Settings s;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--jobs" && i + 1 < argc) {
+      s.jobs = std::atol(argv[++i]);
+    } else if (arg == "--fft" && i + 1 < argc) {
+      std::stringstream ss(argv[++i]);
+      std::string item;
+      std::vector<fluid::index> fft;
+      while (std::getline(ss, item, ',')) fft.push_back(std::atol(item.c_str()));
+      s.windowSize = s.fftSize = fft[0];
+      s.hopSize = fft.size() > 1 ? fft[1] : s.fftSize / 2;
+    } else if (arg == "--bands" && i + 1 < argc) {
+      s.numBands = std::atol(argv[++i]);
+    } else if (arg == "--threshold" && i + 1 < argc) {
+      s.threshold = std::atof(argv[++i]);
+    } else if (arg == "--clusters" && i + 1 < argc) {
+      s.numClusters = std::atol(argv[++i]);
+    } else if (arg == "--segment" && i + 1 < argc) {
+      s.segmentSize = std::atol(argv[++i]);
+    } else if (arg == "--max-jump" && i + 1 < argc) {
+      s.maxJump = std::atol(argv[++i]);
+    } else if (arg == "--quantize") {
+      s.quantize = true;
+    } else if (arg == "--out" && i + 1 < argc) {
+      s.out = argv[++i];
+    } else if (arg == "--help") {
+      usage();
+      return 0;
+    } else if (s.algo.empty()) {
+      s.algo = arg;
+    } else {
+      collect(arg, s.files);
+    }
+  }
+  if ((s.algo != "play" && s.algo != "grain" && s.algo != "loop") ||
+      s.files.empty()) {
+    usage();
+    return 1;
+  }
+  if (s.algo == "loop" && !GraphLoop::beatSearchable(s.maxJump)) {
+    std::fprintf(stderr, "--max-jump too short to find a beat in\n");
+    return 1;
+  }
+  if (!s.out.empty()) fs::create_directories(s.out);
+  if (s.jobs <= 0)
+    s.jobs = std::max<fluid::index>(std::thread::hardware_concurrency(), 1);
+  s.jobs = std::min<fluid::index>(s.jobs, asSigned(s.files.size()));
+
+  auto               start = Clock::now();
+  std::atomic<size_t> next{0};
+  std::atomic<fluid::index>  failed{0};
+  std::mutex          printMutex;
+  std::vector<std::thread> workers;
+  for (fluid::index j = 0; j < s.jobs; j++) {
+    workers.emplace_back([&]() {
+      for (size_t i = next++; i < s.files.size(); i = next++) {
+        std::string line, error;
+        bool        ok = process(s.files[i], s, line, error);
+        std::lock_guard<std::mutex> lock(printMutex);
+        if (ok)
+          std::printf("%s\n", line.c_str());
+        else {
+          std::fprintf(stderr, "%s\n", error.c_str());
+          failed++;
+        }
+      }
+    });
+  }
+  for (auto& worker : workers) worker.join();
+  std::printf("%zu files, %td failed, %td jobs, %.1f s, peak rss %.1f MB\n",
+              s.files.size(), failed.load(), s.jobs, msSince(start) / 1000,
+              tools::peakRSS());
+  return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,145 @@
+/*
+Part of the Fluid Corpus Manipulation Project (http://www.flucoma.org/)
+Copyright 2017-2019 University of Huddersfield.
+Licensed under the BSD-3 License.
+See license.md file in the project root for full license information.
+This project has received funding from the European Research Council (ERC)
+under the European Union’s Horizon 2020 research and innovation programme
+(grant agreement No 725899).
+*/
+#pragma once
+
+#include "WavFile.hpp"
+#include <algorithms/AudioSource.hpp>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+namespace fluid {
+namespace tools {
+
+// WAVE file mapped into memory and decoded chunk by chunk as the analysis
+// reads it, mixed down to mono. Same formats as WavFile; nothing but the
+// mapping is held, so long files cost no resident memory up front.
+class MappedWavSource : public algorithm::AudioSource {
+
+public:
+  MappedWavSource() = default;
+  MappedWavSource(const MappedWavSource&) = delete;
+  MappedWavSource& operator=(const MappedWavSource&) = delete;
+
+  ~MappedWavSource() { close(); }
+
+  bool open(const std::string& path, std::string& error) {
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      error = "can't open " + path;
+      return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size < 12) {
+      ::close(fd);
+      error = path + " is not a WAVE file";
+      return false;
+    }
+    mMapSize = static_cast<size_t>(info.st_size);
+    void* map = mmap(nullptr, mMapSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) {
+      error = "can't map " + path;
+      return false;
+    }
+    mMap = static_cast<const char*>(map);
+    madvise(map, mMapSize, MADV_SEQUENTIAL);
+    if (!parse(path, error)) {
+      close();
+      return false;
+    }
+    return true;
+  }
+
+  void close() {
+    if (mMap) munmap(const_cast<char*>(mMap), mMapSize);
+    mMap = nullptr;
+    mData = nullptr;
+    mNumFrames = 0;
+  }
+
+  double sampleRate() const { return mSampleRate; }
+  int    numChannels() const { return mNumChannels; }
+
+  index size() const override { return mNumFrames; }
+
+  void read(index start, RealVectorView out) const override {
+    index first, length;
+    index offset = clip(start, out.size(), first, length);
+    std::fill(out.begin(), out.end(), 0);
+    index bytes = mBitsPerSample / 8;
+    for (index i = 0; i < length; i++) {
+      const char* frame = mData + (first + i) * bytes * mNumChannels;
+      double      sum = 0;
+      for (int c = 0; c < mNumChannels; c++)
+        sum += wav::decode(frame + c * bytes, mFormat, mBitsPerSample);
+      out(offset + i) = sum / mNumChannels;
+    }
+  }
+
+private:
+  bool parse(const std::string& path, std::string& error) {
+    if (std::strncmp(mMap, "RIFF", 4) != 0 ||
+        std::strncmp(mMap + 8, "WAVE", 4) != 0) {
+      error = path + " is not a WAVE file";
+      return false;
+    }
+    bool   haveFormat = false;
+    size_t pos = 12;
+    while (pos + 8 <= mMapSize) {
+      const char*   header = mMap + pos;
+      std::uint32_t chunkSize = wav::readLE(header + 4, 4);
+      size_t available = std::min<size_t>(chunkSize, mMapSize - pos - 8);
+      if (std::strncmp(header, "fmt ", 4) == 0 && available >= 16) {
+        const char* fmt = header + 8;
+        mFormat = static_cast<int>(wav::readLE(fmt, 2));
+        mNumChannels = static_cast<int>(wav::readLE(fmt + 2, 2));
+        mSampleRate = wav::readLE(fmt + 4, 4);
+        mBitsPerSample = static_cast<int>(wav::readLE(fmt + 14, 2));
+        if (mFormat == 0xFFFE && available >= 26)
+          mFormat = static_cast<int>(wav::readLE(fmt + 24, 2));
+        haveFormat = true;
+      } else if (std::strncmp(header, "data", 4) == 0) {
+        if (!haveFormat || mNumChannels <= 0) {
+          error = path + ": data chunk before format chunk";
+          return false;
+        }
+        if (!wav::supported(mFormat, mBitsPerSample)) {
+          error = path + ": unsupported sample format";
+          return false;
+        }
+        mData = header + 8;
+        mNumFrames = static_cast<index>(available) /
+                     (mBitsPerSample / 8 * mNumChannels);
+        return true;
+      }
+      pos += 8 + chunkSize + (chunkSize & 1);
+    }
+    error = path + ": no data chunk";
+    return false;
+  }
+
+  const char* mMap{nullptr};
+  size_t      mMapSize{0};
+  const char* mData{nullptr};
+  index       mNumFrames{0};
+  double      mSampleRate{0};
+  int         mNumChannels{0};
+  int         mFormat{0};
+  int         mBitsPerSample{0};
+};
+
+} // namespace tools
+} // namespace fluid
@@ -0,0 +1,37 @@
+/*
+Part of the Fluid Corpus Manipulation Project (http://www.flucoma.org/)
+Copyright 2017-2019 University of Huddersfield.
+Licensed under the BSD-3 License.
+See license.md file in the project root for full license information.
+This project has received funding from the European Research Council (ERC)
+under the European Union’s Horizon 2020 research and innovation programme
+(grant agreement No 725899).
+*/
+#pragma once
+
+#include <fstream>
+#include <string>
+
+namespace fluid {
+namespace tools {
+
+// Peak resident set size of this process in MB (Linux, from VmHWM)
+inline double peakRSS() {
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  while (std::getline(status, line)) {
+    if (line.compare(0, 6, "VmHWM:") == 0)
+      return std::stod(line.substr(6)) / 1024.0;
+  }
+  return 0;
+}
+
+// Reset the peak RSS counter so that the next reading covers only what
+// follows (Linux >= 4.0)
+inline void resetPeakRSS() {
+  std::ofstream clear("/proc/self/clear_refs");
+  if (clear) clear << "5";
+}
+
+} // namespace tools
+} // namespace fluid
@@ -0,0 +1,47 @@
+/*
+Part of the Fluid Corpus Manipulation Project (http://www.flucoma.org/)
+Copyright 2017-2019 University of Huddersfield.
+Licensed under the BSD-3 License.
+See license.md file in the project root for full license information.
+This project has received funding from the European Research Council (ERC)
+under the European Union’s Horizon 2020 research and innovation programme
+(grant agreement No 725899).
+*/
+#pragma once
+
+#include <algorithms/util/AlgorithmUtils.hpp>
+#include <data/FluidIndex.hpp>
+#include <data/TensorTypes.hpp>
+#include <cmath>
+#include <random>
+
+namespace fluid {
+namespace tools {
+
+// Notes drawn from a small pitch set with a bit of noise, so that the
+// similarity graph has plenty of links and a few clusters. The same seed
+// gives the same signal.
+inline RealVector synthetic(double seconds, double sampleRate,
+                            unsigned seed = 1234) {
+  using algorithm::pi;
+  std::mt19937 gen(seed);
+  std::uniform_int_distribution<int> note(0, 7);
+  std::normal_distribution<double> noise(0, 0.01);
+  const double pitches[] = {220, 247, 262, 294, 330, 349, 392, 440};
+  index length = static_cast<index>(seconds * sampleRate);
+  index noteLength = static_cast<index>(0.25 * sampleRate);
+  RealVector audio(length);
+  double freq = pitches[0];
+  for (index i = 0; i < length; i++) {
+    index t = i % noteLength;
+    if (t == 0) freq = pitches[note(gen)];
+    double env = std::exp(-4.0 * t / noteLength);
+    audio(i) = env * (0.5 * std::sin(2 * pi * freq * i / sampleRate) +
+                      0.2 * std::sin(4 * pi * freq * i / sampleRate)) +
+               noise(gen);
+  }
+  return audio;
+}
+
+} // namespace tools
+} // namespace fluid
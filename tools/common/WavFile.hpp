@@ -0,0 +1,125 @@
+/*
+Part of the Fluid Corpus Manipulation Project (http://www.flucoma.org/)
+Copyright 2017-2019 University of Huddersfield.
+Licensed under the BSD-3 License.
+See license.md file in the project root for full license information.
+This project has received funding from the European Research Council (ERC)
+under the European Union’s Horizon 2020 research and innovation programme
+(grant agreement No 725899).
+*/
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace fluid {
+namespace tools {
+
+namespace wav {
+
+inline std::uint32_t readLE(const char* p, int bytes) {
+  std::uint32_t value = 0;
+  for (int i = 0; i < bytes; i++)
+    value |= static_cast<std::uint32_t>(static_cast<unsigned char>(p[i]))
+             << (8 * i);
+  return value;
+}
+
+inline double decode(const char* p, int format, int bits) {
+  if (format == 3 && bits == 32) {
+    float f;
+    std::memcpy(&f, p, 4);
+    return f;
+  }
+  if (format == 3) {
+    double d;
+    std::memcpy(&d, p, 8);
+    return d;
+  }
+  std::uint32_t u = readLE(p, bits / 8) << (32 - bits);
+  return static_cast<std::int32_t>(u) / 2147483648.0;
+}
+
+inline bool supported(int format, int bits) {
+  return (format == 1 && (bits == 16 || bits == 24 || bits == 32)) ||
+         (format == 3 && (bits == 32 || bits == 64));
+}
+
+} // namespace wav
+
+// Minimal RIFF/WAVE reader for the command line tools: PCM 16/24/32 bit and
+// 32/64 bit float, mixed down to mono.
+struct WavFile {
+  std::vector<double> samples;
+  double sampleRate{0};
+  int numChannels{0};
+
+  bool read(const std::string& path, std::string& error) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+      error = "can't open " + path;
+      return false;
+    }
+    char riff[12];
+    if (!file.read(riff, 12) || std::strncmp(riff, "RIFF", 4) != 0 ||
+        std::strncmp(riff + 8, "WAVE", 4) != 0) {
+      error = path + " is not a WAVE file";
+      return false;
+    }
+    int format = 0;
+    int bitsPerSample = 0;
+    bool haveFormat = false;
+    char header[8];
+    while (file.read(header, 8)) {
+      std::uint32_t chunkSize = wav::readLE(header + 4, 4);
+      if (std::strncmp(header, "fmt ", 4) == 0) {
+        std::vector<char> fmt(chunkSize);
+        file.read(fmt.data(), chunkSize);
+        format = static_cast<int>(wav::readLE(fmt.data(), 2));
+        numChannels = static_cast<int>(wav::readLE(fmt.data() + 2, 2));
+        sampleRate = wav::readLE(fmt.data() + 4, 4);
+        bitsPerSample = static_cast<int>(wav::readLE(fmt.data() + 14, 2));
+        // WAVE_FORMAT_EXTENSIBLE: the actual format is in the sub-format GUID
+        if (format == 0xFFFE && chunkSize >= 26)
+          format = static_cast<int>(wav::readLE(fmt.data() + 24, 2));
+        haveFormat = true;
+      } else if (std::strncmp(header, "data", 4) == 0) {
+        if (!haveFormat || numChannels <= 0) {
+          error = path + ": data chunk before format chunk";
+          return false;
+        }
+        if (!wav::supported(format, bitsPerSample)) {
+          error = path + ": unsupported sample format";
+          return false;
+        }
+        std::vector<char> data(chunkSize);
+        file.read(data.data(), chunkSize);
+        index bytes = bitsPerSample / 8;
+        index numFrames =
+            static_cast<index>(file.gcount()) / (bytes * numChannels);
+        samples.assign(numFrames, 0);
+        for (index i = 0; i < numFrames; i++) {
+          double sum = 0;
+          for (int c = 0; c < numChannels; c++)
+            sum += wav::decode(data.data() + (i * numChannels + c) * bytes, format,
+                          bitsPerSample);
+          samples[i] = sum / numChannels;
+        }
+        return true;
+      } else {
+        file.seekg(chunkSize + (chunkSize & 1), std::ios::cur);
+      }
+    }
+    error = path + ": no data chunk";
+    return false;
+  }
+
+private:
+  using index = std::ptrdiff_t;
+};
+
+} // namespace tools
+} // namespace fluid
@@ -0,0 +1,1024 @@
+/*
+Part of the Fluid Corpus Manipulation Project (http://www.flucoma.org/)
+Copyright 2017-2019 University of Huddersfield.
+Licensed under the BSD-3 License.
+See license.md file in the project root for full license information.
+This project has received funding from the European Research Council (ERC)
+under the European Union’s Horizon 2020 research and innovation programme
+(grant agreement No 725899).
+*/
+
+// Checks the optimised analysis and playback paths of GraphGrain, GraphPlay
+// and GraphLoop against reference implementations on fixed seeds and
+// synthetic signals, and times both sides of each check:
+//
+//   spectrogram  chunked STFT from a source vs STFT::process on the signal
+//   mel          mel bands from the complex frames vs from magnitudes
+//   distances    coarse-to-fine matrix refining every segment vs dense
+//   neighbours   recall of each frame's nearest frames, coarse vs dense and
+//                compressed vs exact segment search
+//   clusters     spectral clustering of banded distances vs the dense
+//                matrix, up to relabelling
+//   loops        catalogued loops vs a brute-force nearest link search
+//   paths        walks from a copy and from a saved analysis vs the original
+//   reference    links, seeded paths and choices of each policy vs a naive
+//                walk over the full distance matrix
+//   updates      reanalysis of an overwritten second vs analysing again
+//   bands        banded distances, sweeps and walks vs the dense matrix
+//   cross        nearest corpus frames from the tree vs dense distances,
+//                exact for the cosine distance
+//
+// --record saves the loop points, beat, clusters and frame paths, and
+// --check compares them with a file recorded before a change, so that a
+// change shows both that it is correct and how much faster it is. The exit
+// status is 1 if any check fails.
+//
+// usage: graph_regression [--length 10] [--fft 1024,512] [--sr 44100]
+//                         [--segment 4] [--neighbours 8] [--hops 2000]
+//                         [--recall 0.95] [--coarse-recall 0.5]
+//                         [--record file] [--check file]
+
+#include "../common/Synthetic.hpp"
+#include <algorithms/AudioSource.hpp>
+#include <algorithms/CrossNeighbours.hpp>
+#include <algorithms/DistanceBand.hpp>
+#include <algorithms/GraphGrain.hpp>
+#include <algorithms/GraphLoop.hpp>
+#include <algorithms/GraphPlay.hpp>
+#include <algorithms/GraphPlayUtils.hpp>
+#include <algorithms/LoopCatalogue.hpp>
+#include <algorithms/ThresholdSweep.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <numeric>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+using namespace fluid;
+using namespace fluid::algorithm;
+// glibc declares ::index in <strings.h>
+using fluid::index;
+using Clock = std::chrono::steady_clock;
+
+// recall of a search that is exact but for ties between equal distances
+constexpr double kExactRecall = 0.999;
+
+// total variation distance between sampled and exact choices of a policy
+constexpr double kMaxChoiceDistance = 0.05;
+
+struct Settings {
+  double seconds{10};
+  index windowSize{1024};
+  index hopSize{512};
+  index fftSize{1024};
+  index numBands{64};
+  double threshold{0.3};
+  index numClusters{10};
+  index segmentSize{4};
+  index numNeighbours{8};
+  index hops{2000};
+  double sampleRate{44100};
+  double minRecall{0.95};
+  double minCoarseRecall{0.5};
+  std::string record;
+  std::string check;
+};
+
+double msSince(Clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - start)
+      .count();
+}
+
+// outcome of one check, with the time of the reference and optimised sides
+class Report {
+public:
+  void add(const std::string& name, bool ok, const std::string& detail,
+           double referenceMs, double optimisedMs) {
+    std::printf("%-12s %-4s %9s %9s %7s  %s\n", name.c_str(),
+                ok ? "ok" : "FAIL", time(referenceMs).c_str(),
+                time(optimisedMs).c_str(),
+                speedup(referenceMs, optimisedMs).c_str(), detail.c_str());
+    mFailures += ok ? 0 : 1;
+  }
+
+  void header() const {
+    std::printf("%-12s %-4s %9s %9s %7s  %s\n", "check", "", "ref(ms)",
+                "opt(ms)", "speedup", "detail");
+  }
+
+  index failures() const { return mFailures; }
+
+private:
+  // untimed sides are 0
+  static std::string time(double ms) {
+    if (ms <= 0) return "-";
+    char text[16];
+    std::snprintf(text, sizeof(text), "%.1f", ms);
+    return text;
+  }
+
+  static std::string speedup(double referenceMs, double optimisedMs) {
+    if (referenceMs <= 0 || optimisedMs <= 0) return "-";
+    char text[16];
+    std::snprintf(text, sizeof(text), "%.2fx", referenceMs / optimisedMs);
+    return text;
+  }
+
+  index mFailures{0};
+};
+
+// named results saved by --record and compared by --check
+using Results = std::map<std::string, std::vector<double>>;
+
+bool writeResults(const std::string& path, const Results& results) {
+  std::ofstream out(path);
+  for (auto& result : results) {
+    out << result.first << ' ' << result.second.size();
+    char value[32];
+    for (double x : result.second) {
+      std::snprintf(value, sizeof(value), " %.17g", x);
+      out << value;
+    }
+    out << '\n';
+  }
+  return static_cast<bool>(out);
+}
+
+bool readResults(const std::string& path, Results& results) {
+  std::ifstream in(path);
+  if (!in) return false;
+  std::string name;
+  size_t count;
+  while (in >> name >> count) {
+    std::vector<double>& values = results[name];
+    values.resize(count);
+    for (double& x : values) in >> x;
+  }
+  return !in.bad();
+}
+
+std::string format(const char* fmt, double a, double b = 0, double c = 0) {
+  char text[128];
+  std::snprintf(text, sizeof(text), fmt, a, b, c);
+  return text;
+}
+
+// largest difference between two equally sized ranges, relative to the
+// largest magnitude in the first
+template <typename A, typename B>
+double relativeError(const A& a, const B& b) {
+  double scale = 0, error = 0;
+  auto x = a.begin();
+  for (auto y = b.begin(); y != b.end(); ++x, ++y) {
+    scale = std::max(scale, std::abs(*x));
+    error = std::max(error, std::abs(*x - *y));
+  }
+  return scale > 0 ? error / scale : error;
+}
+
+// fraction of each frame's k nearest frames in reference that are also
+// among its k nearest in dm
+double recall(const Eigen::ArrayXXd& reference, const Eigen::ArrayXXd& dm,
+              index k) {
+  index n = reference.rows();
+  k = std::min(k, n - 1);
+  if (k <= 0) return 1;
+  std::vector<index> expected(n), found(n);
+  double hits = 0;
+  for (index i = 0; i < n; i++) {
+    auto nearest = [&](const Eigen::ArrayXXd& d, std::vector<index>& order) {
+      std::iota(order.begin(), order.end(), 0);
+      std::swap(order[i], order.back()); // not the frame itself
+      std::partial_sort(order.begin(), order.begin() + k, order.end() - 1,
+                        [&](index a, index b) { return d(i, a) < d(i, b); });
+    };
+    nearest(reference, expected);
+    nearest(dm, found);
+    std::sort(expected.begin(), expected.begin() + k);
+    for (index j = 0; j < k; j++)
+      hits += std::binary_search(expected.begin(), expected.begin() + k,
+                                 found[j]);
+  }
+  return hits / (n * k);
+}
+
+// whether two labellings make the same partition
+bool samePartition(const FluidTensor<index, 1>& a,
+                   const FluidTensor<index, 1>& b) {
+  if (a.size() != b.size()) return false;
+  std::map<index, index> forward, backward;
+  for (index i = 0; i < a.size(); i++) {
+    auto f = forward.emplace(a(i), b(i)).first;
+    auto r = backward.emplace(b(i), a(i)).first;
+    if (f->second != b(i) || r->second != a(i)) return false;
+  }
+  return true;
+}
+
+// frames visited by a walk of hops steps from the start
+template <typename Model, typename Step>
+std::vector<double> walk(Model& model, index hops, Step step) {
+  model.seed(1);
+  std::vector<double> path(hops);
+  for (index i = 0; i < hops; i++) path[i] = step(model);
+  return path;
+}
+
+// the same model saved and read back
+template <typename Model>
+bool reload(const Model& model, const AudioSource& source, Model& copy) {
+  std::stringstream archive;
+  std::string error;
+  if (!model.write(archive) || !copy.read(archive, source, error)) {
+    std::fprintf(stderr, "%s\n", error.c_str());
+    return false;
+  }
+  return true;
+}
+
+// The walk as GraphPlay first made it: links thresholded from the full
+// distance matrix, a dense matrix of hops left on each visited link, and
+// every choice a scan of the whole row. It is slow but has nothing to get
+// wrong, so the optimised walk is checked against it. Distances are compared
+// in single precision, as the transition table stores them.
+class ReferenceWalk {
+public:
+  explicit ReferenceWalk(const Eigen::ArrayXXd& dm)
+      : mDM(dm), mVisited(Eigen::ArrayXXi::Zero(dm.rows(), dm.cols())) {
+    mDM.matrix().diagonal().setZero();
+  }
+
+  void seed(index seed) { mUtils.seed(seed); }
+
+  index numFrames() const { return mDM.rows(); }
+
+  // frames linked from frame under threshold, nearest first
+  std::vector<index> links(index frame, double threshold) const {
+    std::vector<index> row;
+    for (index j = 0; j < numFrames(); j++)
+      if (j != frame && float(mDM(frame, j)) < float(threshold))
+        row.push_back(j);
+    std::sort(row.begin(), row.end(), [&](index a, index b) {
+      float da = float(mDM(frame, a)), db = float(mDM(frame, b));
+      return da < db || (da == db && a < b);
+    });
+    return row;
+  }
+
+  // the frames the walk may jump to from where it is, nearest first
+  std::vector<index> candidates(double threshold, index minDist) const {
+    std::vector<index> eligible;
+    for (index j : links(mPos, threshold))
+      if (std::abs(j - mPos) > minDist && mVisited(mPos, j) <= 0)
+        eligible.push_back(j);
+    return eligible;
+  }
+
+  // GraphPlay::step without segment jumps; choose picks one of the
+  // candidates, or -1 to play on
+  template <typename Choose>
+  index step(double start, double threshold, index minLength, index minDist,
+             index forget, Choose choose) {
+    mVisited = (mVisited - 1).max(0);
+    index startFrame = std::lrint(start * (numFrames() - 1));
+    if (startFrame != mStartFrame) {
+      mStartFrame = startFrame;
+      mPos = startFrame;
+      for (index k = 0; k < numFrames(); k++) {
+        index i = (startFrame + k) % numFrames();
+        if (!links(i, threshold).empty()) {
+          mPos = i;
+          break;
+        }
+      }
+      mCount = 0;
+    } else if (mCount < minLength) {
+      mPos = (mPos + 1) % numFrames();
+      mCount++;
+    } else {
+      index prevPos = mPos;
+      std::vector<index> eligible = candidates(threshold, minDist);
+      index next = eligible.empty() ? -1 : choose(eligible);
+      if (next >= 0) {
+        mPos = next;
+        mCount = 0;
+      } else
+        mPos = (mPos + 1) % numFrames();
+      mVisited(prevPos, mPos) = static_cast<int>(std::max(forget, index(0)));
+    }
+    return mPos;
+  }
+
+  // GraphPlay's rank random choice, drawing as its policy does
+  index rankRandom(const std::vector<index>& eligible, double randomness) {
+    return eligible[asUnsigned(mUtils.randInt(ranked(eligible, randomness)))];
+  }
+
+  // the chance of each candidate under policy
+  std::vector<double> probabilities(index policy,
+                                    const std::vector<index>& eligible,
+                                    double randomness,
+                                    double temperature) const {
+    std::vector<double> p(eligible.size(), 0);
+    switch (policy) {
+    case kNearest: p[0] = 1; break;
+    case kUniform: std::fill(p.begin(), p.end(), 1.0 / p.size()); break;
+    case kProbability:
+      for (size_t k = 0; k < p.size(); k++)
+        p[k] = std::pow(1 - mDM(mPos, eligible[k]), 1 / temperature);
+      break;
+    default: std::fill_n(p.begin(), ranked(eligible, randomness), 1.0);
+    }
+    double total = std::accumulate(p.begin(), p.end(), 0.0);
+    for (double& x : p) x /= total;
+    return p;
+  }
+
+  void moveTo(index frame) { mPos = frame; }
+
+private:
+  // candidates the rank random choice is among
+  static index ranked(const std::vector<index>& eligible, double randomness) {
+    index n = asSigned(eligible.size());
+    return std::max(index(1), static_cast<index>(lrint(randomness * n)));
+  }
+
+  Eigen::ArrayXXd mDM;
+  Eigen::ArrayXXi mVisited;
+  GraphPlayUtils  mUtils;
+  index           mPos{0};
+  index           mStartFrame{-1};
+  index           mCount{0};
+};
+
+void checkAnalysis(RealVector& signal, const Settings& s, Report& r,
+                   Results& results) {
+  GraphPlayUtils utils;
+  VectorSource source(signal);
+
+  auto t = Clock::now();
+  ComplexMatrix reference(utils.numFrames(signal.size(), s.hopSize),
+                          s.fftSize / 2 + 1);
+  STFT stft(s.windowSize, s.fftSize, s.hopSize);
+  stft.process(signal, reference);
+  double referenceMs = msSince(t);
+  t = Clock::now();
+  ComplexMatrix spectrogram =
+      utils.spectrogram(source, s.windowSize, s.fftSize, s.hopSize);
+  double error = relativeError(reference, spectrogram);
+  r.add("spectrogram", error < 1e-9, format("error %.3g", error),
+        referenceMs, msSince(t));
+
+  t = Clock::now();
+  RealMatrix magnitudes(spectrogram.rows(), spectrogram.cols());
+  std::transform(spectrogram.begin(), spectrogram.end(), magnitudes.begin(),
+                 [](std::complex<double> x) { return std::abs(x); });
+  RealMatrix referenceMel = utils.melSpectrogram(
+      magnitudes, s.numBands, s.sampleRate, s.windowSize, s.fftSize);
+  referenceMs = msSince(t);
+  t = Clock::now();
+  RealMatrix mel = utils.melSpectrogram(spectrogram, s.numBands, s.sampleRate,
+                                        s.windowSize, s.fftSize);
+  error = relativeError(referenceMel, mel);
+  r.add("mel", error < 1e-12, format("error %.3g", error), referenceMs,
+        msSince(t));
+
+  t = Clock::now();
+  Eigen::ArrayXXd dense = utils.distanceMatrix(mel, 7);
+  referenceMs = msSince(t);
+  index numSegments = (mel.rows() + s.segmentSize - 1) / s.segmentSize;
+  t = Clock::now();
+  Eigen::ArrayXXd full =
+      utils.distanceMatrix(mel, 7, s.segmentSize, numSegments);
+  error = (dense - full).abs().maxCoeff();
+  r.add("distances", error < 1e-12,
+        format("error %.3g refining all %.0f segments", error, numSegments),
+        referenceMs, msSince(t));
+
+  t = Clock::now();
+  Eigen::ArrayXXd coarse =
+      utils.distanceMatrix(mel, 7, s.segmentSize, s.numNeighbours);
+  double coarseMs = msSince(t);
+  t = Clock::now();
+  Eigen::ArrayXXd compressed =
+      utils.distanceMatrix(mel, 7, s.segmentSize, s.numNeighbours, true);
+  double compressedMs = msSince(t);
+  // refining fewer segments is an approximation by design, so its recall
+  // has a lower bound; compressed search has to find what the exact one finds
+  double coarseRecall = recall(dense, coarse, 10);
+  r.add("neighbours", coarseRecall >= s.minCoarseRecall,
+        format("coarse recall %.3f (min %.2f)", coarseRecall,
+               s.minCoarseRecall),
+        referenceMs, coarseMs);
+  double compressedRecall = recall(coarse, compressed, 10);
+  r.add("neighbours", compressedRecall >= s.minRecall,
+        format("compressed recall %.3f (min %.2f)", compressedRecall,
+               s.minRecall),
+        coarseMs, compressedMs);
+
+  // the graph built from a band against the one built from the dense
+  // matrix with the pairs outside the band set to 1, first with a band
+  // covering every pair; each clustering starts from the same seed
+  index n = dense.rows();
+  for (index width : {n - 1, std::max(n / 4, index(1))}) {
+    Eigen::ArrayXXd masked = Eigen::ArrayXXd::Ones(n, n);
+    DistanceBand    band(n, width);
+    for (index i = 0; i < n; i++)
+      for (index j = band.first(i); j < band.last(i); j++)
+        masked(i, j) = band.at(i, j) = dense(i, j);
+    t = Clock::now();
+    FluidTensor<index, 1> referenceClusters =
+        GraphPlayUtils().spectralClustering(masked, s.numClusters);
+    referenceMs = msSince(t);
+    t = Clock::now();
+    FluidTensor<index, 1> clusters =
+        GraphPlayUtils().spectralClustering(band, s.numClusters);
+    r.add("clusters", samePartition(referenceClusters, clusters),
+          format("band of %.0f vs dense, %.0f frames", width, n),
+          referenceMs, msSince(t));
+    if (width == n - 1)
+      results["clusters"].assign(clusters.begin(), clusters.end());
+  }
+}
+
+void checkLoops(RealVector& signal, const Settings& s, Report& r,
+                Results& results) {
+  GraphPlayUtils utils;
+  VectorSource source(signal);
+  RealVector output(4);
+  ComplexVector frame(s.fftSize / 2 + 1);
+
+  GraphLoop loop;
+  loop.init(source, s.sampleRate, s.windowSize, s.fftSize, s.hopSize,
+            s.numBands, 7, s.threshold, false, output);
+  index numFrames = loop.numFrames();
+
+  // the links fit from, as GraphLoop makes them
+  ComplexMatrix spectrogram =
+      utils.spectrogram(source, s.windowSize, s.fftSize, s.hopSize);
+  RealMatrix mel = utils.melSpectrogram(spectrogram, s.numBands, s.sampleRate,
+                                        s.windowSize, s.fftSize);
+  Eigen::ArrayXXd dm = utils.distanceMatrix(mel, 7);
+  std::vector<std::pair<index, index>> links;
+  for (index i = 0; i < numFrames; i++)
+    for (index j = i + 1; j < numFrames; j++)
+      if (dm(i, j) < s.threshold) links.push_back({i, j});
+
+  // a catalogued loop is the nearest link to its cell's centre, so it is at
+  // most a cell diagonal further from the requested points than the nearest
+  const index grid = 16;
+  double cell = double(numFrames) /
+                std::min(numFrames, index(LoopCatalogue::kMaxCells));
+  double slack = std::sqrt(2.0) * cell + 1e-9;
+  std::vector<std::pair<double, double>> points;
+  for (index i = 0; i < grid; i++)
+    for (index j = i + 1; j <= grid; j++)
+      points.push_back({double(i) / grid, double(j) / grid});
+
+  auto t = Clock::now();
+  std::vector<double> nearest;
+  for (auto& point : points) {
+    double start = std::lrint(point.first * numFrames);
+    double end = std::lrint(point.second * numFrames);
+    double best = -1;
+    for (auto& link : links) {
+      double d = std::hypot(link.first - start, link.second - end);
+      if (best < 0 || d < best) best = d;
+    }
+    nearest.push_back(best);
+  }
+  double referenceMs = msSince(t);
+
+  t = Clock::now();
+  std::vector<double> found;
+  for (auto& point : points) {
+    loop.processFrame(frame, point.first, point.second, 0, output);
+    found.push_back(output(0));
+    found.push_back(output(1));
+  }
+  double loopMs = msSince(t);
+  index bad = 0;
+  for (size_t i = 0; i < points.size(); i++) {
+    if (nearest[i] < 0) continue; // no links at all
+    index start = static_cast<index>(found[2 * i]);
+    index end = static_cast<index>(found[2 * i + 1]);
+    double d = std::hypot(start - std::lrint(points[i].first * numFrames),
+                          end - std::lrint(points[i].second * numFrames));
+    bool isLink = start >= 0 && end > start && end < numFrames &&
+                  dm(start, end) < s.threshold;
+    if (!isLink || d > nearest[i] + slack) bad++;
+  }
+  r.add("loops", bad == 0,
+        format("%.0f of %.0f lookups off, %.0f links", bad, points.size(),
+               links.size()),
+        referenceMs, loopMs);
+  results["loops"] = found;
+  results["beat"] = {output(2)};
+
+  GraphLoop copy;
+  bool reloaded = reload(loop, source, copy);
+  std::vector<double> foundCopy;
+  for (auto& point : points) {
+    copy.processFrame(frame, point.first, point.second, 0, output);
+    foundCopy.push_back(output(0));
+    foundCopy.push_back(output(1));
+  }
+  bool sameBeat = output(2) == results["beat"][0];
+  r.add("loops", reloaded && foundCopy == found && sameBeat,
+        "read back from a saved analysis", 0, 0);
+}
+
+void checkPaths(RealVector& signal, const Settings& s, Report& r,
+                Results& results) {
+  VectorSource source(signal);
+  RealVector output(4);
+
+  auto playStep = [&](GraphPlay& model) {
+    return double(model.step(0, s.threshold, 10, 10, 1, 0.1, 1, false));
+  };
+  auto t = Clock::now();
+  GraphPlay dense;
+  dense.init(source, s.sampleRate, s.windowSize, s.fftSize, s.hopSize,
+             s.numBands, 7, s.threshold, 1, 8, output);
+  std::vector<double> densePath = walk(dense, s.hops, playStep);
+  double referenceMs = msSince(t);
+  t = Clock::now();
+  index numSegments =
+      (dense.numFrames() + s.segmentSize - 1) / s.segmentSize;
+  GraphPlay play;
+  play.init(source, s.sampleRate, s.windowSize, s.fftSize, s.hopSize,
+            s.numBands, 7, s.threshold, s.segmentSize, numSegments, output);
+  GraphPlay copy = play;
+  std::vector<double> path = walk(play, s.hops, playStep);
+  double playMs = msSince(t);
+  r.add("paths", path == densePath,
+        "play, refining all segments vs dense", referenceMs, playMs);
+  r.add("paths", walk(copy, s.hops, playStep) == path, "play, copied", 0, 0);
+  GraphPlay reloaded;
+  bool ok = reload(play, source, reloaded);
+  r.add("paths", ok && walk(reloaded, s.hops, playStep) == path,
+        "play, read back from a saved analysis", 0, 0);
+  results["play"] = path;
+
+  auto grainStep = [&](GraphGrain& model) {
+    return double(model.step(0, s.threshold, 100, 0.1, 1));
+  };
+  t = Clock::now();
+  GraphGrain grain;
+  grain.init(source, s.sampleRate, s.windowSize, s.fftSize, s.hopSize,
+             s.numBands, 7, s.threshold, s.numClusters, 1, 8, output);
+  GraphGrain grainCopy = grain;
+  std::vector<double> grainPath = walk(grain, s.hops, grainStep);
+  double grainMs = msSince(t);
+  r.add("paths", walk(grainCopy, s.hops, grainStep) == grainPath,
+        "grain, copied", 0, grainMs);
+  GraphGrain grainReloaded;
+  ok = reload(grain, source, grainReloaded);
+  r.add("paths", ok && walk(grainReloaded, s.hops, grainStep) == grainPath,
+        "grain, read back from a saved analysis", 0, 0);
+  results["grain"] = grainPath;
+}
+
+// GraphPlay against the reference walk over the full distance matrix: the
+// same linked frames nearest first, the same seeded paths for the policies
+// that draw as the reference does, every jump of the others among the
+// reference's candidates, and one-step choices from a few frames
+// distributed as each policy says
+void checkReference(RealVector& signal, const Settings& s, Report& r) {
+  GraphPlayUtils utils;
+  VectorSource   source(signal);
+  RealMatrix     mel = utils.melSpectrogram(
+      utils.spectrogram(source, s.windowSize, s.fftSize, s.hopSize),
+      s.numBands, s.sampleRate, s.windowSize, s.fftSize);
+  Eigen::ArrayXXd dm = utils.distanceMatrix(mel, 7);
+  ReferenceWalk   reference(dm);
+  index           n = reference.numFrames();
+  RealVector      output(4);
+  GraphPlay       play;
+  play.init(source, s.sampleRate, s.windowSize, s.fftSize, s.hopSize,
+            s.numBands, 7, s.threshold, 1, s.numNeighbours, output);
+
+  auto t = Clock::now();
+  std::vector<std::vector<index>> links(asUnsigned(n));
+  for (index i = 0; i < n; i++) links[asUnsigned(i)] = reference.links(i, s.threshold);
+  double referenceMs = msSince(t);
+  t = Clock::now();
+  dm.matrix().diagonal().setZero();
+  TransitionTable table;
+  table.init(dm, [](index, index) { return 1; });
+  index differ = 0;
+  for (index i = 0; i < n; i++) {
+    const std::vector<index>& expected = links[asUnsigned(i)];
+    index degree = table.degree(i, s.threshold);
+    bool  same = degree == asSigned(expected.size()) &&
+                play.nearest(i, s.threshold) ==
+                    (expected.empty() ? -1 : expected[0]);
+    for (index k = 0; same && k < degree; k++)
+      same = table.neighbour(i, k) == expected[asUnsigned(k)];
+    differ += !same;
+  }
+  r.add("reference", differ == 0,
+        format("%.0f of %.0f frames linked differently", differ, n),
+        referenceMs, msSince(t));
+
+  // short stays and a long memory, so that visited links get in the way
+  const index  minLength = 4, minDist = 10, forget = 200;
+  const double randomness = 0.3, temperature = 0.5;
+  auto path = [&](index policy, GraphPlay model) {
+    model.seed(1);
+    std::vector<index> frames;
+    dispatchWalkPolicy(policy, [&](auto p) {
+      for (index hop = 0; hop < s.hops; hop++)
+        frames.push_back(model.template step<decltype(p)>(
+            0, s.threshold, minLength, minDist, forget, randomness,
+            temperature, false));
+    });
+    return frames;
+  };
+
+  // drawing as the policies do, the paths are the same
+  for (index policy : {index(kNearest), index(kRankRandom)}) {
+    t = Clock::now();
+    ReferenceWalk walker = reference;
+    walker.seed(1);
+    std::vector<index> expected;
+    for (index hop = 0; hop < s.hops; hop++)
+      expected.push_back(walker.step(
+          0, s.threshold, minLength, minDist, forget,
+          [&](const std::vector<index>& eligible) {
+            return policy == kNearest
+                       ? eligible[0]
+                       : walker.rankRandom(eligible, randomness);
+          }));
+    referenceMs = msSince(t);
+    t = Clock::now();
+    std::vector<index> frames = path(policy, play);
+    r.add("reference", frames == expected,
+          policy == kNearest ? "play, nearest path"
+                             : "play, rank random path",
+          referenceMs, msSince(t));
+  }
+
+  // otherwise each jump has to be one the reference could make from there
+  for (index policy : {index(kUniform), index(kProbability)}) {
+    std::vector<index> frames = path(policy, play);
+    ReferenceWalk      shadow = reference;
+    index              illegal = 0;
+    for (index frame : frames) {
+      index at = shadow.step(0, s.threshold, minLength, minDist, forget,
+                             [&](const std::vector<index>& eligible) {
+                               illegal += std::find(eligible.begin(),
+                                                    eligible.end(),
+                                                    frame) == eligible.end();
+                               return frame;
+                             });
+      illegal += at != frame;
+    }
+    r.add("reference", illegal == 0,
+          format(policy == kUniform
+                     ? "play, uniform path, %.0f of %.0f steps not allowed"
+                     : "play, probability path, %.0f of %.0f steps not "
+                       "allowed",
+                 illegal, frames.size()),
+          0, 0);
+  }
+
+  // and from a few frames, its choices are distributed as the policy says
+  for (index policy :
+       {index(kRankRandom), index(kUniform), index(kProbability)}) {
+    double worst = 0;
+    for (index at = 0; at < n; at += std::max(n / 5, index(1))) {
+      ReferenceWalk probe = reference;
+      probe.moveTo(at);
+      std::vector<index> eligible = probe.candidates(s.threshold, minDist);
+      if (eligible.size() < 3) continue;
+      std::vector<double> expected = probe.probabilities(
+          policy, eligible, randomness, temperature);
+      // enough draws that sampling alone stays well inside the bound
+      index draws = std::max(index(20000), 400 * asSigned(eligible.size()));
+      std::map<index, double> counts;
+      GraphPlay model = play;
+      model.seed(7);
+      dispatchWalkPolicy(policy, [&](auto p) {
+        using Policy = decltype(p);
+        auto choose = [&]() {
+          return model.template step<Policy>(0, s.threshold, 0, minDist, 0,
+                                             randomness, temperature, false);
+        };
+        choose(); // from the start frame
+        for (index draw = 0; draw < draws; draw++) {
+          model.moveTo(at);
+          counts[choose()] += 1.0 / double(draws);
+        }
+      });
+      double distance = 0;
+      for (size_t k = 0; k < eligible.size(); k++) {
+        distance += std::abs(counts[eligible[k]] - expected[k]);
+        counts.erase(eligible[k]);
+      }
+      for (auto& count : counts) distance += count.second;
+      worst = std::max(worst, distance / 2);
+    }
+    const char* name = policy == kRankRandom ? "rank random"
+                       : policy == kUniform  ? "uniform"
+                                             : "probability";
+    r.add("reference", worst <= kMaxChoiceDistance,
+          std::string("play, ") + name +
+              format(" choices, distance %.3f (max %.2f)", worst,
+                     kMaxChoiceDistance),
+          0, 0);
+  }
+}
+
+// a second of the signal overwritten with other notes, updated in place vs
+// analysed again
+void checkUpdates(const RealVector& signal, const Settings& s, Report& r) {
+  RealVector edited(signal);
+  RealVector notes = fluid::tools::synthetic(1, s.sampleRate, 99);
+  index start = edited.size() / 2;
+  index count = std::min(notes.size(), edited.size() - start);
+  VectorSource source(edited);
+  RealVector output(4);
+
+  auto playStep = [&](GraphPlay& model) {
+    return double(model.step(0, s.threshold, 10, 10, 1, 0.1, 1, false));
+  };
+  for (index segmentSize : {index(1), s.segmentSize}) {
+    GraphPlay play;
+    play.init(source, s.sampleRate, s.windowSize, s.fftSize, s.hopSize,
+              s.numBands, 7, s.threshold, segmentSize, s.numNeighbours,
+              output);
+    std::copy_n(notes.data(), count, edited.data() + start);
+    auto t = Clock::now();
+    GraphPlay reference;
+    reference.init(source, s.sampleRate, s.windowSize, s.fftSize,
+                   s.hopSize, s.numBands, 7, s.threshold, segmentSize,
+                   s.numNeighbours, output);
+    double referenceMs = msSince(t);
+    t = Clock::now();
+    std::string error;
+    bool ok = play.update(source, start, count, error);
+    double updateMs = msSince(t);
+      r.add("updates",
+          ok && walk(play, s.hops, playStep) ==
+                    walk(reference, s.hops, playStep),
+          format("play, segments of %.0f", segmentSize), referenceMs,
+          updateMs);
+    std::copy_n(signal.data() + start, count, edited.data() + start);
+  }
+
+  GraphLoop loop;
+  loop.init(source, s.sampleRate, s.windowSize, s.fftSize, s.hopSize,
+            s.numBands, 7, s.threshold, false, output);
+  std::copy_n(notes.data(), count, edited.data() + start);
+  auto t = Clock::now();
+  GraphLoop reference;
+  reference.init(source, s.sampleRate, s.windowSize, s.fftSize, s.hopSize,
+                 s.numBands, 7, s.threshold, false, output);
+  double referenceMs = msSince(t);
+  t = Clock::now();
+  std::string error;
+  bool ok = loop.update(source, start, count, error);
+  double updateMs = msSince(t);
+  // the same loop for every cell and rank
+  ComplexVector frame(s.fftSize / 2 + 1);
+  RealVector loopOutput(4);
+  index cells = std::min(loop.numFrames(), index(16));
+  for (index i = 0; ok && i < cells; i++)
+    for (index rank = 0; rank < 3; rank++) {
+      double at = double(i) / cells;
+      loop.processFrame(frame, at, at + 0.5 / cells, rank, loopOutput);
+      reference.processFrame(frame, at, at + 0.5 / cells, rank, output);
+      ok = ok && loopOutput(0) == output(0) && loopOutput(1) == output(1) &&
+           loopOutput(2) == output(2) && loopOutput(3) == output(3);
+    }
+  r.add("updates", ok, "loops", referenceMs, updateMs);
+}
+
+// banded distances against the dense matrix with the pairs outside the band
+// set to 1, which is what the band reads them as, and a banded walk against
+// its band
+void checkBands(RealVector& signal, const Settings& s, Report& r) {
+  GraphPlayUtils utils;
+  VectorSource   source(signal);
+  ComplexMatrix  spectrogram =
+      utils.spectrogram(source, s.windowSize, s.fftSize, s.hopSize);
+  RealMatrix mel = utils.melSpectrogram(spectrogram, s.numBands,
+                                        s.sampleRate, s.windowSize,
+                                        s.fftSize);
+  index width = std::max(mel.rows() / 8, index(1));
+
+  auto            t = Clock::now();
+  Eigen::MatrixXd reference = utils.distanceMatrix(mel, 7);
+  for (index i = 0; i < reference.rows(); i++)
+    for (index j = 0; j < reference.cols(); j++)
+      if (std::abs(i - j) > width) reference(i, j) = 1;
+  reference.diagonal().setZero();
+  double referenceMs = msSince(t);
+  t = Clock::now();
+  DistanceBand band = utils.bandDistances(mel, 7, width);
+  band.zeroDiagonal();
+  double bandMs = msSince(t);
+  double error = 0;
+  for (index i = 0; i < reference.rows(); i++)
+    for (index j = 0; j < reference.cols(); j++)
+      error = std::max(error, std::abs(band(i, j) - reference(i, j)));
+  r.add("bands", error < 1e-12,
+        format("distances within %.0f frames, error %.3g", width, error),
+        referenceMs, bandMs);
+
+  index          steps = 50;
+  RealMatrix     referenceSweep(ThresholdSweep::kNumCurves, steps);
+  RealMatrix     sweep(ThresholdSweep::kNumCurves, steps);
+  ThresholdSweep sweeper;
+  t = Clock::now();
+  sweeper.process(reference, referenceSweep);
+  referenceMs = msSince(t);
+  t = Clock::now();
+  sweeper.process(band, sweep);
+  r.add("bands",
+        std::equal(sweep.begin(), sweep.end(), referenceSweep.begin()),
+        "threshold sweep", referenceMs, msSince(t));
+
+  GraphPlay  play;
+  RealVector output(4);
+  play.init(source, s.sampleRate, s.windowSize, s.fftSize, s.hopSize,
+            s.numBands, 7, s.threshold, 1, s.numNeighbours, output, 0, false,
+            width);
+  index far = 0, jumps = 0, previous = 0;
+  for (index hop = 0; hop < s.hops; hop++) {
+    index frame = play.step(0, s.threshold, 10, 10, 1, 0.1, 1, false);
+    if (hop > 0 && frame != (previous + 1) % play.numFrames()) {
+      jumps++;
+      if (std::abs(frame - previous) > width) far++;
+    }
+    previous = frame;
+  }
+  r.add("bands", far == 0,
+        format("play, %.0f jumps, %.0f beyond the band", jumps, far), 0, 0);
+}
+
+// each frame's nearest frames of another signal, the corpus, from the tree
+// against the dense distances between both, and a walk jumping into it
+void checkCross(RealVector& signal, const Settings& s, Report& r) {
+  GraphPlayUtils utils;
+  RealVector     notes = fluid::tools::synthetic(s.seconds / 2, s.sampleRate,
+                                                 99);
+  VectorSource   source(signal);
+  VectorSource   corpus(notes);
+  auto mel = [&](const AudioSource& audio) {
+    return utils.melSpectrogram(
+        utils.spectrogram(audio, s.windowSize, s.fftSize, s.hopSize),
+        s.numBands, s.sampleRate, s.windowSize, s.fftSize);
+  };
+  RealMatrix target = mel(source);
+  RealMatrix other = mel(corpus);
+  index      n = target.rows(), m = other.rows();
+  index      k = std::min(index(CrossNeighbours::kNeighbours), m);
+
+  auto       t = Clock::now();
+  RealMatrix both(n + m, s.numBands);
+  for (index i = 0; i < n; i++) both.row(i) = target.row(i);
+  for (index i = 0; i < m; i++) both.row(n + i) = other.row(i);
+  Eigen::ArrayXXd reference = utils.distanceMatrix(both, 7);
+  double          referenceMs = msSince(t);
+  t = Clock::now();
+  CrossNeighbours cross = utils.crossNeighbours(target, other, 7, k);
+  double          crossMs = msSince(t);
+  std::vector<index> expected(m);
+  double             hits = 0;
+  for (index i = 0; i < n; i++) {
+    std::iota(expected.begin(), expected.end(), n);
+    std::partial_sort(expected.begin(), expected.begin() + k,
+                      expected.end(), [&](index a, index b) {
+                        return reference(i, a) < reference(i, b);
+                      });
+    std::sort(expected.begin(), expected.begin() + k);
+    for (index j = 0; j < k; j++)
+      hits += std::binary_search(expected.begin(), expected.begin() + k,
+                                 n + cross.neighbour(i, j));
+  }
+  // the tree's order is the cosine one, so up to ties it finds them all
+  double found = hits / (n * k);
+  r.add("cross", found >= kExactRecall,
+        format("recall %.4f of %.0f corpus frames (min %.3f)", found, k,
+               kExactRecall),
+        referenceMs, crossMs);
+
+  GraphPlay  play;
+  RealVector output(4);
+  play.init(source, s.sampleRate, s.windowSize, s.fftSize, s.hopSize,
+            s.numBands, 7, s.threshold, 1, s.numNeighbours, output, 0, false,
+            0, &corpus);
+  index fromCorpus = 0, outside = 0;
+  for (index hop = 0; hop < s.hops; hop++) {
+    index frame = play.step(0, s.threshold, 10, 10, 1, 0.1, 1, false);
+    fromCorpus += frame >= n;
+    outside += frame < 0 || frame >= n + m;
+  }
+  r.add("cross", outside == 0,
+        format("play, %.0f of %.0f frames from the corpus", fromCorpus,
+               s.hops),
+        0, 0);
+}
+
+// the recorded results that differ from these
+void compare(const Results& recorded, const Results& results, Report& r) {
+  for (auto& result : results) {
+    auto found = recorded.find(result.first);
+    if (found == recorded.end()) {
+      r.add("recorded", false, result.first + " not recorded", 0, 0);
+      continue;
+    }
+    const std::vector<double>& a = found->second;
+    const std::vector<double>& b = result.second;
+    index differ = 0;
+    if (a.size() != b.size())
+      differ = asSigned(b.size());
+    else
+      for (size_t i = 0; i < a.size(); i++) differ += a[i] != b[i];
+    r.add("recorded", differ == 0,
+          result.first + format(": %.0f of %.0f values differ", differ,
+                                b.size()),
+          0, 0);
+  }
+}
+
+std::vector<double> parseList(const std::string& arg) {
+  std::vector<double> values;
+  std::stringstream ss(arg);
+  std::string item;
+  while (std::getline(ss, item, ',')) values.push_back(std::stod(item));
+  return values;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  Settings s;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--length" && i + 1 < argc) {
+      s.seconds = std::atof(argv[++i]);
+    } else if (arg == "--fft" && i + 1 < argc) {
+      auto fft = parseList(argv[++i]);
+      s.windowSize = s.fftSize = static_cast<fluid::index>(fft[0]);
+      s.hopSize =
+          fft.size() > 1 ? static_cast<fluid::index>(fft[1]) : s.fftSize / 2;
+    } else if (arg == "--sr" && i + 1 < argc) {
+      s.sampleRate = std::atof(argv[++i]);
+    } else if (arg == "--segment" && i + 1 < argc) {
+      s.segmentSize = std::max(std::atol(argv[++i]), 2L);
+    } else if (arg == "--neighbours" && i + 1 < argc) {
+      s.numNeighbours = std::atol(argv[++i]);
+    } else if (arg == "--hops" && i + 1 < argc) {
+      s.hops = std::atol(argv[++i]);
+    } else if (arg == "--recall" && i + 1 < argc) {
+      s.minRecall = std::atof(argv[++i]);
+    } else if (arg == "--coarse-recall" && i + 1 < argc) {
+      s.minCoarseRecall = std::atof(argv[++i]);
+    } else if (arg == "--record" && i + 1 < argc) {
+      s.record = argv[++i];
+    } else if (arg == "--check" && i + 1 < argc) {
+      s.check = argv[++i];
+    } else {
+      std::printf("usage: graph_regression [--length 10] [--fft 1024,512] "
+                  "[--sr 44100] [--segment 4] [--neighbours 8] "
+                  "[--hops 2000] [--recall 0.95] [--coarse-recall 0.5] "
+                  "[--record file] [--check file]\n");
+      return arg == "--help" ? 0 : 1;
+    }
+  }
+  RealVector signal = fluid::tools::synthetic(s.seconds, s.sampleRate);
+  Report report;
+  Results results;
+  report.header();
+  checkAnalysis(signal, s, report, results);
+  checkLoops(signal, s, report, results);
+  checkPaths(signal, s, report, results);
+  checkReference(signal, s, report);
+  checkUpdates(signal, s, report);
+  checkBands(signal, s, report);
+  checkCross(signal, s, report);
+  if (!s.check.empty()) {
+    Results recorded;
+    if (!readResults(s.check, recorded)) {
+      std::fprintf(stderr, "Can't read %s\n", s.check.c_str());
+      return 1;
+    }
+    compare(recorded, results, report);
+  }
+  if (!s.record.empty() && !writeResults(s.record, results)) {
+    std::fprintf(stderr, "Can't write %s\n", s.record.c_str());
+    return 1;
+  }
+  return report.failures() > 0 ? 1 : 0;
+}